@@ -0,0 +1,404 @@
+// Measures the cost of the PEP handlers against an in-memory stand-in for the catalog.
+//
+// A synthetic tree of collections is created in the stand-in. Every operation targets a data
+// object in a randomly chosen leaf collection, so each one walks the full ancestor chain. For
+// each scenario, the benchmark reports the throughput, the number of catalog requests and the
+// number of heap allocations per operation.
+
+#include "handler.hpp"
+#include "instance_configuration.hpp"
+#include "mock_catalog.hpp"
+
+#include <irods/dataObjInpOut.h>
+#include <irods/irods_get_l1desc.hpp>
+#include <irods/objDesc.hpp>
+#include <irods/objInfo.h>
+
+#include <boost/any.hpp>
+#include <fmt/format.h>
+#include <nlohmann/json.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+	namespace bm = irods::benchmarks;
+	namespace handler = irods::handler;
+
+	std::atomic<std::uint64_t> allocations{0};
+
+	struct benchmark_options
+	{
+		int depth = 6;
+		int fanout = 3;
+
+		// Every Nth level of the tree is monitored. The root is always monitored.
+		int monitored_every = 2;
+
+		int iterations = 10000;
+		std::int64_t cache_time_to_live = 0;
+		std::int64_t index_time_to_live = 0;
+		std::int64_t write_behind_maximum_pending_updates = 0;
+		std::int64_t compare_and_swap_retries = 0;
+		std::int64_t counter_shards = 0;
+		std::int64_t reserve_in_flight_changes = 0;
+	}; // struct benchmark_options
+
+	struct scenario_result
+	{
+		double seconds;
+		bm::catalog_statistics catalog;
+		std::uint64_t allocations;
+	}; // struct scenario_result
+
+	const std::string instance_name = "irods_rule_engine_plugin-logical_quotas-instance";
+	const std::string root_collection = "/tempZone/home/benchmark";
+
+	auto print_usage() -> void
+	{
+		std::cout << "Usage: irods_logical_quotas_benchmark [OPTION]...\n"
+		             "\n"
+		             "  --depth N                 Number of levels below the root collection. (default: 6)\n"
+		             "  --fanout N                Number of child collections per collection. (default: 3)\n"
+		             "  --monitored-every N       Monitor every Nth level of the tree. (default: 2)\n"
+		             "  --iterations N            Number of operations per scenario. (default: 10000)\n"
+		             "  --cache-ttl SECONDS       Value of cache_time_to_live_in_seconds. (default: 0)\n"
+		             "  --index-ttl SECONDS       Value of index_time_to_live_in_seconds. (default: 0)\n"
+		             "  --write-behind N          Value of write_behind_maximum_pending_updates. (default: 0)\n"
+		             "  --cas-retries N           Value of compare_and_swap_retries. (default: 0)\n"
+		             "  --counter-shards N        Value of counter_shards. (default: 0)\n"
+		             "  --reserve-in-flight 0|1   Value of reserve_in_flight_changes. (default: 0)\n"
+		             "  --help                    Display this help and exit.\n";
+	}
+
+	auto parse_options(int _argc, char* _argv[]) -> benchmark_options
+	{
+		benchmark_options opts;
+
+		for (int i = 1; i < _argc; ++i) {
+			const std::string_view arg = _argv[i];
+
+			if ("--help" == arg) {
+				print_usage();
+				std::exit(0);
+			}
+
+			if (i + 1 >= _argc) {
+				throw std::invalid_argument{fmt::format("Missing value for option [{}]", arg)};
+			}
+
+			const auto value = std::stoll(_argv[++i]);
+
+			// clang-format off
+			if      ("--depth" == arg)             { opts.depth = static_cast<int>(value); }
+			else if ("--fanout" == arg)            { opts.fanout = static_cast<int>(value); }
+			else if ("--monitored-every" == arg)   { opts.monitored_every = static_cast<int>(value); }
+			else if ("--iterations" == arg)        { opts.iterations = static_cast<int>(value); }
+			else if ("--cache-ttl" == arg)         { opts.cache_time_to_live = value; }
+			else if ("--index-ttl" == arg)         { opts.index_time_to_live = value; }
+			else if ("--write-behind" == arg)      { opts.write_behind_maximum_pending_updates = value; }
+			else if ("--cas-retries" == arg)       { opts.compare_and_swap_retries = value; }
+			else if ("--counter-shards" == arg)    { opts.counter_shards = value; }
+			else if ("--reserve-in-flight" == arg) { opts.reserve_in_flight_changes = value; }
+			else { throw std::invalid_argument{fmt::format("Unknown option [{}]", arg)}; }
+			// clang-format on
+		}
+
+		if (opts.depth < 0 || opts.fanout < 1 || opts.monitored_every < 1 || opts.iterations < 1) {
+			throw std::invalid_argument{"Option values must be positive"};
+		}
+
+		return opts;
+	}
+
+	// Creates the tree of collections and returns the paths of the leaves.
+	auto make_tree(const irods::attributes& _attrs, const benchmark_options& _opts) -> std::vector<std::string>
+	{
+		auto& catalog = bm::mock_catalog::instance();
+
+		// The ancestors of the root are never monitored, but the handlers still look at them.
+		catalog.add_collection("/");
+		catalog.add_collection("/tempZone");
+		catalog.add_collection("/tempZone/home");
+
+		std::vector<std::string> level{root_collection};
+
+		for (int depth = 0;; ++depth) {
+			for (auto&& path : level) {
+				catalog.add_collection(path);
+
+				if (0 == depth % _opts.monitored_every) {
+					catalog.add_metadata(path, _attrs.total_number_of_data_objects(), "0");
+					catalog.add_metadata(path, _attrs.total_size_in_bytes(), "0");
+				}
+			}
+
+			if (depth == _opts.depth) {
+				return level;
+			}
+
+			std::vector<std::string> next;
+			next.reserve(level.size() * _opts.fanout);
+
+			for (auto&& path : level) {
+				for (int i = 0; i < _opts.fanout; ++i) {
+					next.push_back(fmt::format("{}/c{}", path, i));
+				}
+			}
+
+			level = std::move(next);
+		}
+	}
+
+	auto check(const irods::error& _result, std::string_view _pep) -> void
+	{
+		if (!_result.ok()) {
+			throw std::runtime_error{fmt::format("{} failed: {}", _pep, _result.result())};
+		}
+	}
+
+	template <typename Function>
+	auto run_scenario(int _iterations, Function _func) -> scenario_result
+	{
+		auto& stats = bm::mock_catalog::instance().statistics();
+
+		const auto stats_before = stats;
+		const auto allocations_before = allocations.load();
+		const auto start = std::chrono::steady_clock::now();
+
+		for (int i = 0; i < _iterations; ++i) {
+			_func(i);
+		}
+
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		return {elapsed.count(),
+		        {stats.gen_queries - stats_before.gen_queries,
+		         stats.specific_queries - stats_before.specific_queries,
+		         stats.object_stats - stats_before.object_stats,
+		         stats.metadata_writes - stats_before.metadata_writes},
+		        allocations.load() - allocations_before};
+	}
+
+	auto print_result(std::string_view _name, int _iterations, const scenario_result& _r) -> void
+	{
+		const auto per_op = [_iterations](std::uint64_t _n) { return static_cast<double>(_n) / _iterations; };
+
+		std::cout << fmt::format("{:<24} {:>12.0f} {:>10.2f} {:>10.2f} {:>10.2f} {:>10.2f} {:>10.2f} {:>12.1f}\n",
+		                         _name,
+		                         _iterations / _r.seconds,
+		                         per_op(_r.catalog.total()),
+		                         per_op(_r.catalog.gen_queries),
+		                         per_op(_r.catalog.specific_queries),
+		                         per_op(_r.catalog.object_stats),
+		                         per_op(_r.catalog.metadata_writes),
+		                         per_op(_r.allocations));
+	}
+} // anonymous namespace
+
+// Counts every allocation made by the process. The handlers are single-threaded, so the count
+// observed around a scenario belongs to that scenario.
+auto operator new(std::size_t _size) -> void*
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+
+	if (auto* p = std::malloc(_size ? _size : 1); p) {
+		return p;
+	}
+
+	throw std::bad_alloc{};
+}
+
+auto operator delete(void* _p) noexcept -> void
+{
+	std::free(_p);
+}
+
+auto operator delete(void* _p, std::size_t) noexcept -> void
+{
+	std::free(_p);
+}
+
+auto main(int _argc, char* _argv[]) -> int
+{
+	try {
+		const auto opts = parse_options(_argc, _argv);
+
+		irods::instance_options options;
+		options.cache_time_to_live = std::chrono::seconds{opts.cache_time_to_live};
+		options.index_time_to_live = std::chrono::seconds{opts.index_time_to_live};
+		options.write_behind.maximum_pending_updates = opts.write_behind_maximum_pending_updates;
+		options.compare_and_swap_retries = opts.compare_and_swap_retries;
+		options.counter_shards = opts.counter_shards;
+		options.reserve_in_flight_changes = opts.reserve_in_flight_changes != 0;
+
+		irods::attributes attrs{"irods::logical_quotas",
+		                        "maximum_number_of_data_objects",
+		                        "maximum_size_in_bytes",
+		                        "total_number_of_data_objects",
+		                        "total_size_in_bytes"};
+
+		std::shared_ptr<irods::monitored_collection_index> index;
+
+		if (options.index_time_to_live.count() > 0) {
+			index = std::make_shared<irods::monitored_collection_index>(
+				fmt::format("{}-benchmark-{}", instance_name, getpid()), options.index_time_to_live);
+		}
+
+		std::shared_ptr<irods::reservation_ledger> reservations;
+
+		if (options.reserve_in_flight_changes) {
+			reservations =
+				std::make_shared<irods::reservation_ledger>(fmt::format("{}-benchmark-{}", instance_name, getpid()));
+		}
+
+		irods::instance_configuration_map configs;
+		configs.insert_or_assign(
+			instance_name,
+			irods::instance_configuration{attrs, options, std::move(index), nullptr, nullptr, std::move(reservations)});
+
+		const auto leaves = make_tree(attrs, opts);
+
+		std::mt19937_64 rng{42};
+		std::uniform_int_distribution<std::size_t> pick_leaf{0, leaves.size() - 1};
+
+		std::vector<std::string> paths;
+		paths.reserve(opts.iterations);
+
+		for (int i = 0; i < opts.iterations; ++i) {
+			paths.push_back(fmt::format("{}/d{}", leaves[pick_leaf(rng)], i));
+		}
+
+		// The handlers only use the effect handler to report errors. Every configuration used here
+		// is valid and no quota is set, so the handlers never report one. A failure is therefore
+		// a bug in the benchmark and is detected via the error returned by the handler.
+		alignas(irods::callback) std::byte effect_handler_storage[sizeof(irods::callback)]{};
+		auto& effect_handler = *reinterpret_cast<irods::callback*>(effect_handler_storage);
+
+		auto& catalog = bm::mock_catalog::instance();
+
+		dataObjInp_t input{};
+		std::list<boost::any> args{instance_name, static_cast<rsComm_t*>(nullptr), &input};
+
+		const auto set_path = [&input](const std::string& _path) {
+			std::snprintf(input.objPath, sizeof(input.objPath), "%s", _path.c_str());
+		};
+
+		std::cout << fmt::format(
+			"Tree: depth={}, fanout={}, leaves={}, monitored every {} level(s)\n"
+			"Options: cache_ttl={}s, index_ttl={}s, write_behind_maximum_pending_updates={}, "
+			"compare_and_swap_retries={}, counter_shards={}, reserve_in_flight_changes={}\n\n",
+			opts.depth,
+			opts.fanout,
+			leaves.size(),
+			opts.monitored_every,
+			opts.cache_time_to_live,
+			opts.index_time_to_live,
+			opts.write_behind_maximum_pending_updates,
+			opts.compare_and_swap_retries,
+			opts.counter_shards,
+			opts.reserve_in_flight_changes != 0);
+
+		std::cout << fmt::format("{:<24} {:>12} {:>10} {:>10} {:>10} {:>10} {:>10} {:>12}\n",
+		                         "scenario",
+		                         "ops/sec",
+		                         "calls/op",
+		                         "genquery",
+		                         "specific",
+		                         "objstat",
+		                         "md_write",
+		                         "allocs/op");
+
+		const auto create = run_scenario(opts.iterations, [&](int i) {
+			set_path(paths[i]);
+			input.dataSize = 0;
+			check(handler::pep_api_data_obj_create_pre(instance_name, configs, args, nullptr, effect_handler),
+			      "pep_api_data_obj_create_pre");
+			catalog.add_data_object(paths[i], 0);
+			check(handler::pep_api_data_obj_create_post(instance_name, configs, args, nullptr, effect_handler),
+			      "pep_api_data_obj_create_post");
+		});
+		print_result("data_obj_create", opts.iterations, create);
+
+		const auto put = run_scenario(opts.iterations, [&](int i) {
+			set_path(paths[i]);
+			input.dataSize = 1024;
+			check(handler::pep_api_data_obj_put::pre(instance_name, configs, args, nullptr, effect_handler),
+			      "pep_api_data_obj_put_pre");
+			catalog.set_data_object_size(paths[i], input.dataSize);
+			check(handler::pep_api_data_obj_put::post(instance_name, configs, args, nullptr, effect_handler),
+			      "pep_api_data_obj_put_post");
+		});
+		print_result("data_obj_put (overwrite)", opts.iterations, put);
+
+		// Opening with O_CREAT and writing via the replica API. The l1 descriptor returned by the
+		// stand-in for irods::get_l1desc() describes the replica being closed.
+		dataObjInfo_t info{};
+		dataObjInp_t open_input{};
+		auto& l1desc = irods::get_l1desc(3);
+		l1desc.dataObjInp = &open_input;
+		l1desc.dataObjInfo = &info;
+
+		std::string close_json = nlohmann::json{{"fd", 3}}.dump();
+		BytesBuf close_input{static_cast<int>(close_json.size()), close_json.data()};
+		std::list<boost::any> close_args{instance_name, static_cast<rsComm_t*>(nullptr), &close_input};
+
+		const auto write = run_scenario(opts.iterations, [&](int i) {
+			const auto path = paths[i] + ".new";
+			set_path(path);
+			input.openFlags = O_CREAT | O_WRONLY;
+			check(handler::pep_api_data_obj_open_pre(instance_name, configs, args, nullptr, effect_handler),
+			      "pep_api_data_obj_open_pre");
+
+			catalog.add_data_object(path, 0);
+			open_input.openFlags = input.openFlags;
+			l1desc.openType = CREATE_TYPE;
+			info.dataSize = 0;
+			std::snprintf(info.objPath, sizeof(info.objPath), "%s", path.c_str());
+
+			check(handler::pep_api_replica_close::pre(instance_name, configs, close_args, nullptr, effect_handler),
+			      "pep_api_replica_close_pre");
+			catalog.set_data_object_size(path, 2048);
+			check(handler::pep_api_replica_close::post(instance_name, configs, close_args, nullptr, effect_handler),
+			      "pep_api_replica_close_post");
+		});
+		print_result("open + replica_close", opts.iterations, write);
+
+		const auto unlink = run_scenario(opts.iterations, [&](int i) {
+			set_path(paths[i]);
+			check(handler::pep_api_data_obj_unlink::pre(instance_name, configs, args, nullptr, effect_handler),
+			      "pep_api_data_obj_unlink_pre");
+			catalog.remove_data_object(paths[i]);
+			check(handler::pep_api_data_obj_unlink::post(instance_name, configs, args, nullptr, effect_handler),
+			      "pep_api_data_obj_unlink_post");
+		});
+		print_result("data_obj_unlink", opts.iterations, unlink);
+
+		handler::flush_pending_quota_updates(configs.at(instance_name));
+	}
+	catch (const std::exception& e) {
+		std::cerr << "error: " << e.what() << '\n';
+		return 1;
+	}
+
+	return 0;
+}
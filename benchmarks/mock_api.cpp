@@ -0,0 +1,495 @@
+// Replacements for the client API functions used by the plugin.
+//
+// The benchmark executable defines these functions itself. Because the executable is searched
+// before the iRODS shared libraries, these definitions are used instead of the ones which would
+// send a request to a server. This includes calls made from within the iRODS libraries, such as
+// those made by the filesystem library.
+
+#include "mock_catalog.hpp"
+
+#include <irods/atomic_apply_metadata_operations.h>
+#include <irods/genQuery.h>
+#include <irods/irods_get_l1desc.hpp>
+#include <irods/modAVUMetadata.h>
+#include <irods/objStat.h>
+#include <irods/rcConnect.h>
+#include <irods/rodsErrorTable.h>
+#include <irods/rodsGenQuery.h>
+#include <irods/specificQuery.h>
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+	namespace bm = irods::benchmarks;
+
+	using row_type = std::vector<std::string>;
+
+	// Evaluates a GenQuery condition such as "= 'a' || like 'b%'" against "_value".
+	auto matches(const std::string& _value, std::string_view _condition) -> bool
+	{
+		const auto next_quoted = [](std::string_view& _s) -> std::string {
+			const auto first = _s.find('\'');
+			const auto last = _s.find('\'', first + 1);
+			std::string v{_s.substr(first + 1, last - first - 1)};
+			_s.remove_prefix(last + 1);
+			return v;
+		};
+
+		while (!_condition.empty()) {
+			const auto sep = _condition.find("||");
+			auto term = _condition.substr(0, sep);
+			_condition = (std::string_view::npos == sep) ? std::string_view{} : _condition.substr(sep + 2);
+
+			term.remove_prefix(std::min(term.find_first_not_of(' '), term.size()));
+
+			bool result = false;
+
+			if (term.rfind("in", 0) == 0) {
+				while (term.find('\'') != std::string_view::npos) {
+					if (next_quoted(term) == _value) {
+						result = true;
+						break;
+					}
+				}
+			}
+			else if (term.rfind("not like", 0) == 0) {
+				result = !bm::sql_like(_value, next_quoted(term));
+			}
+			else if (term.rfind("like", 0) == 0) {
+				result = bm::sql_like(_value, next_quoted(term));
+			}
+			else if (term.rfind("<>", 0) == 0 || term.rfind("!=", 0) == 0) {
+				result = next_quoted(term) != _value;
+			}
+			else if (term.rfind("=", 0) == 0) {
+				result = next_quoted(term) == _value;
+			}
+
+			if (result) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// Returns a function which extracts the value of "_column" from the current row, or an empty
+	// function if the column is not supported.
+	auto column_getter(int _column,
+	                   const std::string*& _coll_name,
+	                   const bm::collection*& _coll,
+	                   const bm::data_object*& _data,
+	                   const std::pair<std::string, std::string>*& _avu) -> std::function<std::string()>
+	{
+		switch (_column) {
+			// clang-format off
+			case COL_COLL_NAME:            return [&] { return *_coll_name; };
+			case COL_COLL_ID:              return [&] { return std::to_string(_coll->id); };
+			case COL_DATA_NAME:            return [&] { return _data ? _data->name : std::string{}; };
+			case COL_D_DATA_ID:            return [&] { return _data ? std::to_string(_data->id) : std::string{}; };
+			case COL_DATA_SIZE:            return [&] { return _data ? std::to_string(_data->size) : std::string{}; };
+			case COL_DATA_REPL_NUM:        return [] { return std::string{"0"}; };
+			case COL_D_REPL_STATUS:        return [] { return std::string{"1"}; };
+			case COL_D_MODIFY_TIME:        return [] { return std::string{"01700000000"}; };
+			case COL_META_COLL_ATTR_NAME:  return [&] { return _avu ? _avu->first : std::string{}; };
+			case COL_META_COLL_ATTR_VALUE: return [&] { return _avu ? _avu->second : std::string{}; };
+			default:                       return {};
+			// clang-format on
+		}
+	}
+
+	auto make_output(const std::vector<int>& _columns, const std::vector<row_type>& _rows) -> genQueryOut_t*
+	{
+		auto* out = static_cast<genQueryOut_t*>(std::calloc(1, sizeof(genQueryOut_t)));
+		out->rowCnt = static_cast<int>(_rows.size());
+		out->attriCnt = static_cast<int>(_columns.size());
+		out->totalRowCount = out->rowCnt;
+
+		for (std::size_t c = 0; c < _columns.size(); ++c) {
+			std::size_t len = 1;
+
+			for (auto&& r : _rows) {
+				len = std::max(len, r[c].size() + 1);
+			}
+
+			auto& result = out->sqlResult[c];
+			result.attriInx = _columns[c];
+			result.len = static_cast<int>(len);
+			result.value = static_cast<char*>(std::calloc(std::max<std::size_t>(_rows.size(), 1), len));
+
+			for (std::size_t r = 0; r < _rows.size(); ++r) {
+				std::memcpy(result.value + r * len, _rows[r][c].c_str(), _rows[r][c].size());
+			}
+		}
+
+		return out;
+	}
+} // anonymous namespace
+
+auto rcGenQuery(rcComm_t*, genQueryInp_t* _input, genQueryOut_t** _output) -> int
+{
+	*_output = nullptr;
+
+	if (_input->maxRows <= 0) {
+		return 0;
+	}
+
+	auto& catalog = bm::mock_catalog::instance();
+	++catalog.statistics().gen_queries;
+
+	const std::string* coll_name{};
+	const bm::collection* coll{};
+	const bm::data_object* data{};
+	const std::pair<std::string, std::string>* avu{};
+
+	bool uses_data = false;
+	bool uses_metadata = false;
+
+	const auto classify = [&](int _column) {
+		uses_data = uses_data || COL_DATA_NAME == _column || COL_DATA_SIZE == _column || COL_D_DATA_ID == _column ||
+		            COL_DATA_REPL_NUM == _column || COL_D_REPL_STATUS == _column || COL_D_MODIFY_TIME == _column;
+		uses_metadata = uses_metadata || COL_META_COLL_ATTR_NAME == _column || COL_META_COLL_ATTR_VALUE == _column;
+	};
+
+	std::vector<int> columns;
+	std::vector<int> aggregates;
+	std::vector<std::function<std::string()>> getters;
+
+	for (int i = 0; i < _input->selectInp.len; ++i) {
+		const auto column = _input->selectInp.inx[i];
+		auto getter = column_getter(column, coll_name, coll, data, avu);
+
+		// Unsupported columns (e.g. permissions) produce no rows.
+		if (!getter) {
+			return CAT_NO_ROWS_FOUND;
+		}
+
+		classify(column);
+		columns.push_back(column);
+		aggregates.push_back(_input->selectInp.value[i] & 0xff);
+		getters.push_back(std::move(getter));
+	}
+
+	std::vector<std::pair<std::function<std::string()>, std::string_view>> conditions;
+
+	for (int i = 0; i < _input->sqlCondInp.len; ++i) {
+		const auto column = _input->sqlCondInp.inx[i];
+		auto getter = column_getter(column, coll_name, coll, data, avu);
+
+		if (!getter) {
+			return CAT_NO_ROWS_FOUND;
+		}
+
+		classify(column);
+		conditions.emplace_back(std::move(getter), _input->sqlCondInp.value[i]);
+	}
+
+	// count() and sum() are applied to every matching row. Otherwise, only distinct rows are returned.
+	const auto has_aggregates = std::any_of(std::begin(aggregates), std::end(aggregates), [](int _a) {
+		return SELECT_COUNT == _a || SELECT_SUM == _a;
+	});
+
+	std::vector<row_type> all_rows;
+
+	const auto visit_all = [&] {
+		for (auto&& [get, cond] : conditions) {
+			if (!matches(get(), cond)) {
+				return;
+			}
+		}
+
+		row_type r;
+		r.reserve(getters.size());
+
+		for (auto&& get : getters) {
+			r.push_back(get());
+		}
+
+		all_rows.push_back(std::move(r));
+	};
+
+	if (uses_data) {
+		for (auto&& [path, d] : catalog.data_objects()) {
+			data = &d;
+			coll_name = &catalog.collection_path(d.collection_id);
+			coll = catalog.find_collection(*coll_name);
+			visit_all();
+		}
+	}
+	else {
+		for (auto&& [path, c] : catalog.collections()) {
+			coll_name = &path;
+			coll = &c;
+
+			if (uses_metadata) {
+				for (auto&& a : c.metadata) {
+					avu = &a;
+					visit_all();
+				}
+			}
+			else {
+				visit_all();
+			}
+		}
+	}
+
+	std::vector<row_type> result;
+
+	if (has_aggregates) {
+		row_type r;
+
+		for (std::size_t c = 0; c < columns.size(); ++c) {
+			if (SELECT_COUNT == aggregates[c]) {
+				r.push_back(std::to_string(all_rows.size()));
+			}
+			else if (SELECT_SUM == aggregates[c]) {
+				std::int64_t sum = 0;
+
+				for (auto&& row : all_rows) {
+					sum += row[c].empty() ? 0 : std::stoll(row[c]);
+				}
+
+				r.push_back(all_rows.empty() ? std::string{} : std::to_string(sum));
+			}
+			else {
+				r.push_back(all_rows.empty() ? std::string{} : all_rows.front()[c]);
+			}
+		}
+
+		result.push_back(std::move(r));
+	}
+	else {
+		std::set<row_type> distinct(std::begin(all_rows), std::end(all_rows));
+		result.assign(std::begin(distinct), std::end(distinct));
+	}
+
+	if (result.empty()) {
+		return CAT_NO_ROWS_FOUND;
+	}
+
+	*_output = make_output(columns, result);
+
+	return 0;
+}
+
+auto rcSpecificQuery(rcComm_t*, specificQueryInp_t* _input, genQueryOut_t** _output) -> int
+{
+	*_output = nullptr;
+
+	if (_input->maxRows <= 0) {
+		return 0;
+	}
+
+	auto& catalog = bm::mock_catalog::instance();
+	++catalog.statistics().specific_queries;
+
+	const std::string_view name = _input->sql;
+	const std::string_view pattern = _input->args[0] ? _input->args[0] : "";
+
+	if (name == "logical_quotas_count_and_sum_data_objects_in_subtree") {
+		const std::string_view lower = _input->args[1] ? _input->args[1] : "";
+		const std::string_view upper = _input->args[2] ? _input->args[2] : "";
+
+		std::int64_t count = 0;
+		std::int64_t sum = 0;
+
+		for (auto&& [path, d] : catalog.data_objects()) {
+			if (const std::string_view coll = catalog.collection_path(d.collection_id);
+			    coll == pattern || (lower <= coll && coll < upper))
+			{
+				++count;
+				sum += d.size;
+			}
+		}
+
+		*_output = make_output({0, 1}, {{std::to_string(count), (count > 0) ? std::to_string(sum) : std::string{}}});
+
+		return 0;
+	}
+
+	if (name == "logical_quotas_count_and_sum_data_objects_by_collection") {
+		std::map<std::string, std::pair<std::int64_t, std::int64_t>> totals_by_collection;
+
+		for (auto&& [path, d] : catalog.data_objects()) {
+			if (const auto& coll = catalog.collection_path(d.collection_id); bm::sql_like(coll, pattern)) {
+				auto& [count, sum] = totals_by_collection[coll];
+				++count;
+				sum += d.size;
+			}
+		}
+
+		if (totals_by_collection.empty()) {
+			return CAT_NO_ROWS_FOUND;
+		}
+
+		std::vector<row_type> rows;
+
+		for (auto&& [coll, totals] : totals_by_collection) {
+			rows.push_back({coll, std::to_string(totals.first), std::to_string(totals.second)});
+		}
+
+		*_output = make_output({0, 1, 2}, rows);
+
+		return 0;
+	}
+
+	std::int64_t count = 0;
+	std::int64_t sum = 0;
+
+	for (auto&& [path, d] : catalog.data_objects()) {
+		if (bm::sql_like(catalog.collection_path(d.collection_id), pattern)) {
+			++count;
+			sum += d.size;
+		}
+	}
+
+	const auto sum_or_null = (count > 0) ? std::to_string(sum) : std::string{};
+
+	if (name == "logical_quotas_count_data_objects_recursive") {
+		*_output = make_output({0}, {{std::to_string(count)}});
+	}
+	else if (name == "logical_quotas_sum_data_object_sizes_recursive") {
+		*_output = make_output({0}, {{sum_or_null}});
+	}
+	else if (name == "logical_quotas_count_and_sum_data_objects_recursive") {
+		*_output = make_output({0, 1}, {{std::to_string(count), sum_or_null}});
+	}
+	else {
+		return CAT_UNKNOWN_SPECIFIC_QUERY;
+	}
+
+	return 0;
+}
+
+auto rcObjStat(rcComm_t*, dataObjInp_t* _input, rodsObjStat_t** _output) -> int
+{
+	*_output = nullptr;
+
+	auto& catalog = bm::mock_catalog::instance();
+	++catalog.statistics().object_stats;
+
+	if (const auto* d = catalog.find_data_object(_input->objPath); d) {
+		*_output = static_cast<rodsObjStat_t*>(std::calloc(1, sizeof(rodsObjStat_t)));
+		(*_output)->objType = DATA_OBJ_T;
+		(*_output)->objSize = d->size;
+		std::snprintf((*_output)->dataId, sizeof((*_output)->dataId), "%lld", static_cast<long long>(d->id));
+		return DATA_OBJ_T;
+	}
+
+	if (const auto* c = catalog.find_collection(_input->objPath); c) {
+		*_output = static_cast<rodsObjStat_t*>(std::calloc(1, sizeof(rodsObjStat_t)));
+		(*_output)->objType = COLL_OBJ_T;
+		std::snprintf((*_output)->dataId, sizeof((*_output)->dataId), "%lld", static_cast<long long>(c->id));
+		return COLL_OBJ_T;
+	}
+
+	return OBJ_PATH_DOES_NOT_EXIST;
+}
+
+auto rcModAVUMetadata(rcComm_t*, modAVUMetadataInp_t* _input) -> int
+{
+	auto& catalog = bm::mock_catalog::instance();
+	++catalog.statistics().metadata_writes;
+
+	const std::string_view op = _input->arg0;
+	const std::string path = _input->arg2;
+	const std::string name = _input->arg3 ? _input->arg3 : "";
+	const std::string value = _input->arg4 ? _input->arg4 : "";
+
+	auto* c = catalog.find_collection(path);
+	const auto avu = std::make_pair(name, value);
+	const auto exists = c && std::find(std::begin(c->metadata), std::end(c->metadata), avu) != std::end(c->metadata);
+
+	if (op == "set") {
+		catalog.set_metadata(path, name, value);
+	}
+	else if (op == "add") {
+		// Like the catalog, an AVU cannot be added twice.
+		if (exists) {
+			return CATALOG_ALREADY_HAS_ITEM_BY_THAT_NAME;
+		}
+
+		catalog.add_metadata(path, name, value);
+	}
+	else if (op == "rm") {
+		if (!exists) {
+			return CAT_SUCCESS_BUT_WITH_NO_INFO;
+		}
+
+		catalog.remove_metadata(path, name, value);
+	}
+	else if (op == "rmw") {
+		// The name and the value are patterns.
+		if (c) {
+			auto& md = c->metadata;
+			md.erase(std::remove_if(std::begin(md),
+			                        std::end(md),
+			                        [&](const auto& _avu) {
+										return bm::sql_like(_avu.first, name) && bm::sql_like(_avu.second, value);
+									}),
+			         std::end(md));
+		}
+	}
+	else if (op == "mod") {
+		// Only changes of value (i.e. "v:<value>") are supported. Like the catalog, the operation
+		// fails if the existing AVU is not found.
+		if (!exists) {
+			return CAT_SUCCESS_BUT_WITH_NO_INFO;
+		}
+
+		catalog.remove_metadata(path, name, value);
+		catalog.add_metadata(path, name, std::string{_input->arg5}.substr(2));
+	}
+
+	return 0;
+}
+
+auto rc_atomic_apply_metadata_operations(RcComm*, const char* _json_input, char** _json_output) -> int
+{
+	auto& catalog = bm::mock_catalog::instance();
+	++catalog.statistics().metadata_writes;
+
+	const auto input = nlohmann::json::parse(_json_input);
+	const auto& path = input.at("entity_name").get_ref<const std::string&>();
+
+	for (auto&& op : input.at("operations")) {
+		const auto& name = op.at("attribute").get_ref<const std::string&>();
+		const auto& value = op.at("value").get_ref<const std::string&>();
+
+		if (op.at("operation") == "add") {
+			catalog.add_metadata(path, name, value);
+		}
+		else {
+			catalog.remove_metadata(path, name, value);
+		}
+	}
+
+	*_json_output = strdup("{}");
+
+	return 0;
+}
+
+namespace irods
+{
+	namespace
+	{
+		l1desc_t benchmark_l1desc{};
+	} // anonymous namespace
+
+	auto get_l1desc(const int) -> l1desc_t&
+	{
+		return benchmark_l1desc;
+	}
+} // namespace irods
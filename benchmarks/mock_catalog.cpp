@@ -0,0 +1,127 @@
+#include "mock_catalog.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string_view>
+
+namespace irods::benchmarks
+{
+	auto mock_catalog::instance() -> mock_catalog&
+	{
+		static mock_catalog catalog;
+		return catalog;
+	}
+
+	auto mock_catalog::add_collection(const std::string& _path) -> std::int64_t
+	{
+		if (const auto iter = collections_.find(_path); iter != std::end(collections_)) {
+			return iter->second.id;
+		}
+
+		const auto id = next_id_++;
+		collections_.emplace(_path, collection{id, {}});
+		collection_paths_.emplace(id, _path);
+
+		return id;
+	}
+
+	auto mock_catalog::add_data_object(const std::string& _path, std::int64_t _size) -> void
+	{
+		const auto slash = _path.find_last_of('/');
+		const auto parent = (0 == slash) ? std::string{"/"} : _path.substr(0, slash);
+
+		const auto* coll = find_collection(parent);
+
+		if (!coll) {
+			throw std::invalid_argument{"mock_catalog: parent collection does not exist: " + parent};
+		}
+
+		data_objects_.insert_or_assign(_path, data_object{next_id_++, coll->id, _path.substr(slash + 1), _size});
+	}
+
+	auto mock_catalog::remove_data_object(const std::string& _path) -> void
+	{
+		data_objects_.erase(_path);
+	}
+
+	auto mock_catalog::set_data_object_size(const std::string& _path, std::int64_t _size) -> void
+	{
+		if (auto* d = find_data_object(_path); d) {
+			d->size = _size;
+		}
+	}
+
+	auto mock_catalog::find_collection(const std::string& _path) -> collection*
+	{
+		const auto iter = collections_.find(_path);
+		return (iter != std::end(collections_)) ? &iter->second : nullptr;
+	}
+
+	auto mock_catalog::find_data_object(const std::string& _path) -> data_object*
+	{
+		const auto iter = data_objects_.find(_path);
+		return (iter != std::end(data_objects_)) ? &iter->second : nullptr;
+	}
+
+	auto mock_catalog::add_metadata(const std::string& _path, const std::string& _name, const std::string& _value)
+		-> void
+	{
+		if (auto* coll = find_collection(_path); coll) {
+			coll->metadata.emplace_back(_name, _value);
+		}
+	}
+
+	auto mock_catalog::set_metadata(const std::string& _path, const std::string& _name, const std::string& _value)
+		-> void
+	{
+		remove_metadata(_path, _name, std::nullopt);
+		add_metadata(_path, _name, _value);
+	}
+
+	auto mock_catalog::remove_metadata(const std::string& _path,
+	                                   const std::string& _name,
+	                                   const std::optional<std::string>& _value) -> void
+	{
+		if (auto* coll = find_collection(_path); coll) {
+			auto& md = coll->metadata;
+			md.erase(std::remove_if(std::begin(md),
+			                        std::end(md),
+			                        [&](const auto& _avu) {
+										return _avu.first == _name && (!_value || _avu.second == *_value);
+									}),
+			         std::end(md));
+		}
+	}
+
+	auto mock_catalog::collection_path(std::int64_t _id) const -> const std::string&
+	{
+		return collection_paths_.at(_id);
+	}
+
+	auto sql_like(std::string_view _value, std::string_view _pattern) -> bool
+	{
+		if (_pattern.empty()) {
+			return _value.empty();
+		}
+
+		if ('%' == _pattern[0]) {
+			for (std::size_t i = 0; i <= _value.size(); ++i) {
+				if (sql_like(_value.substr(i), _pattern.substr(1))) {
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		if (_value.empty()) {
+			return false;
+		}
+
+		if ('_' == _pattern[0] || _pattern[0] == _value[0]) {
+			return sql_like(_value.substr(1), _pattern.substr(1));
+		}
+
+		return false;
+	}
+} // namespace irods::benchmarks
@@ -0,0 +1,99 @@
+#ifndef IRODS_LOGICAL_QUOTAS_BENCHMARKS_MOCK_CATALOG_HPP
+#define IRODS_LOGICAL_QUOTAS_BENCHMARKS_MOCK_CATALOG_HPP
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace irods::benchmarks
+{
+	// Counts the calls made against the catalog stand-in.
+	struct catalog_statistics
+	{
+		std::uint64_t gen_queries = 0;
+		std::uint64_t specific_queries = 0;
+		std::uint64_t object_stats = 0;
+		std::uint64_t metadata_writes = 0;
+
+		auto total() const noexcept -> std::uint64_t
+		{
+			return gen_queries + specific_queries + object_stats + metadata_writes;
+		}
+	}; // struct catalog_statistics
+
+	struct data_object
+	{
+		std::int64_t id;
+		std::int64_t collection_id;
+		std::string name;
+		std::int64_t size;
+	}; // struct data_object
+
+	struct collection
+	{
+		std::int64_t id;
+		std::vector<std::pair<std::string, std::string>> metadata;
+	}; // struct collection
+
+	// An in-memory stand-in for the parts of the catalog used by the plugin.
+	//
+	// The stand-in is reached through replacements for the client API functions (rcGenQuery,
+	// rcObjStat, etc.) defined in mock_api.cpp. It is not thread-safe.
+	class mock_catalog final
+	{
+	  public:
+		static auto instance() -> mock_catalog&;
+
+		auto add_collection(const std::string& _path) -> std::int64_t;
+
+		auto add_data_object(const std::string& _path, std::int64_t _size) -> void;
+		auto remove_data_object(const std::string& _path) -> void;
+		auto set_data_object_size(const std::string& _path, std::int64_t _size) -> void;
+
+		auto find_collection(const std::string& _path) -> collection*;
+		auto find_data_object(const std::string& _path) -> data_object*;
+
+		auto add_metadata(const std::string& _path, const std::string& _name, const std::string& _value) -> void;
+		auto set_metadata(const std::string& _path, const std::string& _name, const std::string& _value) -> void;
+
+		// Removes the matching AVUs. If "_value" is not set, all AVUs having "_name" are removed.
+		auto remove_metadata(const std::string& _path,
+		                     const std::string& _name,
+		                     const std::optional<std::string>& _value) -> void;
+
+		auto collections() const noexcept -> const std::map<std::string, collection>&
+		{
+			return collections_;
+		}
+
+		auto data_objects() const noexcept -> const std::map<std::string, data_object>&
+		{
+			return data_objects_;
+		}
+
+		auto collection_path(std::int64_t _id) const -> const std::string&;
+
+		auto statistics() noexcept -> catalog_statistics&
+		{
+			return stats_;
+		}
+
+	  private:
+		mock_catalog() = default;
+
+		std::int64_t next_id_ = 10000;
+		std::map<std::string, collection> collections_;
+		std::map<std::int64_t, std::string> collection_paths_;
+		std::map<std::string, data_object> data_objects_;
+		catalog_statistics stats_;
+	}; // class mock_catalog
+
+	// Returns true if "_value" matches the SQL LIKE pattern "_pattern".
+	auto sql_like(std::string_view _value, std::string_view _pattern) -> bool;
+} // namespace irods::benchmarks
+
+#endif // IRODS_LOGICAL_QUOTAS_BENCHMARKS_MOCK_CATALOG_HPP
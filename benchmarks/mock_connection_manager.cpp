@@ -0,0 +1,23 @@
+// Replaces src/connection_manager.cpp. Every request sent over the connection is answered by the
+// catalog stand-in, so the connection is never used for I/O.
+
+#include "connection_manager.hpp"
+
+namespace irods::connection_manager
+{
+	auto get() -> RcComm&
+	{
+		static RcComm conn{};
+		return conn;
+	}
+
+	auto make_connection() -> std::shared_ptr<RcComm>
+	{
+		// The connection does not own anything, so the shared one is handed out.
+		return {std::shared_ptr<RcComm>{}, &get()};
+	}
+
+	auto release() noexcept -> void {}
+
+	auto release_if_broken(int) noexcept -> void {}
+} // namespace irods::connection_manager
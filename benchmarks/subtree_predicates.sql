@@ -0,0 +1,113 @@
+-- Compares the LIKE prefix predicate used by the original specific queries with the range predicate
+-- used by logical_quotas_count_and_sum_data_objects_in_subtree.
+--
+-- The script builds a synthetic copy of the two catalog tables involved in a scratch schema, so it
+-- must NOT be run against a production catalog database. Run it against an empty PostgreSQL
+-- database, e.g.:
+--
+--     createdb lq_bench
+--     psql -d lq_bench -v data_objects=10000000 -f benchmarks/subtree_predicates.sql
+--
+-- The catalog is a tree of collections, /tempZone/home/u<N>/p<N>/d<N>, holding "data_objects" rows
+-- spread evenly over the leaf collections (10 million by default). Every query is prepared and
+-- executed with a generic plan, the same way the server executes specific queries with bind
+-- variables. Compare the "Execution Time" and buffer counts reported by each EXPLAIN.
+
+\set ON_ERROR_STOP on
+\if :{?data_objects}
+\else
+	\set data_objects 10000000
+\endif
+
+\timing on
+
+drop schema if exists lq_bench cascade;
+create schema lq_bench;
+set search_path = lq_bench;
+
+-- Only the columns used by the specific queries are reproduced.
+create table r_coll_main (
+	coll_id bigint primary key,
+	parent_coll_name varchar(2700) not null,
+	coll_name varchar(2700) not null
+);
+
+create table r_data_main (
+	data_id bigint not null,
+	coll_id bigint not null,
+	data_repl_num integer not null,
+	data_size bigint not null,
+	data_is_dirty integer not null
+);
+
+-- 100 users, each with 20 projects of 50 collections: 100,000 leaf collections.
+insert into r_coll_main
+select row_number() over (), parent, name
+from (
+	select '/tempZone/home' as parent, '/tempZone/home/u' || u as name
+	from generate_series(1, 100) u
+	union all
+	select '/tempZone/home/u' || u, '/tempZone/home/u' || u || '/p' || p
+	from generate_series(1, 100) u, generate_series(1, 20) p
+	union all
+	select '/tempZone/home/u' || u || '/p' || p, '/tempZone/home/u' || u || '/p' || p || '/d' || d
+	from generate_series(1, 100) u, generate_series(1, 20) p, generate_series(1, 50) d
+) as t;
+
+-- One replica per data object, plus a second replica for every tenth one.
+insert into r_data_main
+select i, leaf.coll_id, 0, (i % 65536) + 1, 1
+from generate_series(1, :data_objects) i
+inner join (
+	select coll_id, row_number() over (order by coll_id) - 1 as n
+	from r_coll_main
+	where coll_name like '%/d%'
+) as leaf on leaf.n = i % 100000;
+
+insert into r_data_main
+select data_id, coll_id, 1, data_size, 1 from r_data_main where data_id % 10 = 0;
+
+-- The indexes the catalog defines on these columns, plus a byte-wise index on the collection name
+-- which the range predicate can use on databases whose default collation is not "C".
+create unique index idx_coll_main_coll_name on r_coll_main (coll_name);
+create index idx_coll_main_coll_name_c on r_coll_main (coll_name collate "C");
+create index idx_data_main_coll_id on r_data_main (coll_id);
+
+analyze r_coll_main;
+analyze r_data_main;
+
+select (select count(*) from r_coll_main) as collections, (select count(*) from r_data_main) as replicas;
+
+set plan_cache_mode = force_generic_plan;
+
+prepare like_prefix(text) as
+select count(distinct t.data_id), sum(t.data_size)
+from (
+	select distinct d.data_id, case when d.data_is_dirty in ('1', '4') then d.data_size end as data_size
+	from r_data_main d inner join r_coll_main c on d.coll_id = c.coll_id
+	where c.coll_name like $1
+) as t;
+
+prepare range(text, text, text) as
+select count(distinct t.data_id), sum(t.data_size)
+from (
+	select distinct d.data_id, case when d.data_is_dirty in ('1', '4') then d.data_size end as data_size
+	from r_data_main d inner join r_coll_main c on d.coll_id = c.coll_id
+	where c.coll_name = $1 or (c.coll_name collate "C" >= $2 and c.coll_name collate "C" < $3)
+) as t;
+
+-- A project (50 collections, about 5,000 data objects). The LIKE pattern also matches the
+-- projects p10 to p19, which share the prefix "p1".
+explain (analyze, buffers) execute like_prefix('/tempZone/home/u1/p1%');
+explain (analyze, buffers) execute range('/tempZone/home/u1/p1', '/tempZone/home/u1/p1/', '/tempZone/home/u1/p10');
+
+-- A user (1,000 collections, about 100,000 data objects).
+explain (analyze, buffers) execute like_prefix('/tempZone/home/u42%');
+explain (analyze, buffers) execute range('/tempZone/home/u42', '/tempZone/home/u42/', '/tempZone/home/u420');
+
+-- The results differ wherever the LIKE pattern matches sibling collections.
+execute like_prefix('/tempZone/home/u1/p1%');
+execute range('/tempZone/home/u1/p1', '/tempZone/home/u1/p1/', '/tempZone/home/u1/p10');
+
+deallocate like_prefix;
+deallocate range;
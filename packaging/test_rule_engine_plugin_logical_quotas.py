@@ -1,10 +1,14 @@
+import concurrent.futures
 import contextlib
 import json
 import os
 import shutil
+import signal
 import subprocess
 import sys
+import tempfile
 import textwrap
+import time
 import unittest
 
 from . import session
@@ -12,6 +16,7 @@ from .. import lib
 from .. import paths
 from .. import test
 from ..configuration import IrodsConfig
+from ..core_file import temporary_core_file
 from irods.controller import IrodsController
 
 admins = [('otherrods', 'rods'), ('anotherrods', 'rods')]
@@ -41,7 +46,25 @@ class Test_Rule_Engine_Plugin_Logical_Quotas(session.make_sessions_mixin(admins,
         self.admin1.assert_icommand(['iadmin', 'asq', sum_data_object_sizes,
                                     'logical_quotas_sum_data_object_sizes_recursive'])
 
+        self.admin1.assert_icommand(['iadmin', 'asq', self.count_and_sum_data_objects_query(),
+                                    'logical_quotas_count_and_sum_data_objects_recursive'])
+
+        self.admin1.assert_icommand(['iadmin', 'asq', self.count_and_sum_data_objects_by_collection_query(),
+                                    'logical_quotas_count_and_sum_data_objects_by_collection'])
+
+        self.admin1.assert_icommand(['iadmin', 'asq', self.count_and_sum_data_objects_in_subtree_query(),
+                                    'logical_quotas_count_and_sum_data_objects_in_subtree'])
+
     def tearDown(self):
+        self.admin1.assert_icommand(['iadmin', 'rsq',
+                                    'logical_quotas_count_and_sum_data_objects_in_subtree'])
+
+        self.admin1.assert_icommand(['iadmin', 'rsq',
+                                    'logical_quotas_count_and_sum_data_objects_by_collection'])
+
+        self.admin1.assert_icommand(['iadmin', 'rsq',
+                                    'logical_quotas_count_and_sum_data_objects_recursive'])
+
         self.admin1.assert_icommand(['iadmin', 'rsq',
                                     'logical_quotas_sum_data_object_sizes_recursive'])
 
@@ -509,6 +532,75 @@ class Test_Rule_Engine_Plugin_Logical_Quotas(session.make_sessions_mixin(admins,
             op_args = '*col={0}%*out='.format(col)
             self.admin1.assert_icommand(['irule', '-r', 'irods_rule_engine_plugin-irods_rule_language-instance', op, op_args, '*out'], 'STDOUT', expected_output)
 
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_logical_quotas_get_status_of_collections(self):
+        col = self.admin1.session_collection
+        col1 = os.path.join(col, 'col.1')
+        col2 = os.path.join(col, 'col.2')
+        not_monitored = os.path.join(col, 'col.3')
+
+        with self.rule_engine_plugin_enabled():
+            for c in [col1, col2, not_monitored]:
+                self.admin1.assert_icommand(['imkdir', c])
+
+            self.logical_quotas_start_monitoring_collection(col1)
+            self.logical_quotas_start_monitoring_collection(col2)
+            self.logical_quotas_set_maximum_number_of_data_objects(col2, '5')
+
+            contents = 'hello, iRODS!'
+            self.admin1.assert_icommand(['istream', 'write', os.path.join(col1, 'foo')], input=contents)
+
+            def get_status_of_collections(args):
+                args['operation'] = 'logical_quotas_get_status_of_collections'
+                _, out, _ = self.admin1.assert_icommand(['irule', '-r', 'irods_rule_engine_plugin-logical_quotas-instance', json.dumps(args), 'null', 'ruleExecOut'], 'STDOUT', ['collection'])
+                return [json.loads(line) for line in out.splitlines() if line.strip()]
+
+            # Every monitored collection under the subtree is reported, ordered by path.
+            statuses = get_status_of_collections({'collection': col})
+            self.assertEqual([s['collection'] for s in statuses], [col1, col2])
+            self.assertEqual(statuses[0][self.total_number_of_data_objects_attribute()], '1')
+            self.assertEqual(statuses[0][self.total_size_in_bytes_attribute()], str(len(contents)))
+            self.assertEqual(statuses[0][self.maximum_number_of_data_objects_attribute()], '')
+            self.assertEqual(statuses[1][self.total_number_of_data_objects_attribute()], '0')
+            self.assertEqual(statuses[1][self.maximum_number_of_data_objects_attribute()], '5')
+
+            # Collections in a list are reported in the order given, including those not monitored.
+            statuses = get_status_of_collections({'collections': [col2, not_monitored, col1]})
+            self.assertEqual([s['collection'] for s in statuses], [col2, not_monitored, col1])
+            self.assertEqual(statuses[0][self.maximum_number_of_data_objects_attribute()], '5')
+            self.assertIn('error', statuses[1])
+            self.assertEqual(statuses[2][self.total_number_of_data_objects_attribute()], '1')
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_executing_a_batch_of_operations(self):
+        col = self.admin1.session_collection
+        col1 = os.path.join(col, 'col.1')
+        col2 = os.path.join(col, 'col.2')
+
+        with self.rule_engine_plugin_enabled():
+            self.admin1.assert_icommand(['imkdir', col1, col2])
+
+            ops = []
+            for c in [col1, col2]:
+                ops.append({'operation': 'logical_quotas_start_monitoring_collection', 'collection': c})
+                ops.append({'operation': 'logical_quotas_set_maximum_number_of_data_objects', 'collection': c, 'value': '10'})
+            ops.append({'operation': 'logical_quotas_does_not_exist', 'collection': col1})
+            ops.append({'operation': 'logical_quotas_get_collection_status', 'collection': col2})
+
+            _, out, _ = self.admin1.assert_icommand(['irule', '-r', 'irods_rule_engine_plugin-logical_quotas-instance', json.dumps(ops), 'null', 'ruleExecOut'], 'STDOUT', ['error_code'])
+            results = json.loads(out)
+
+            # Every operation is reported, in order, and a failed operation does not stop the ones following it.
+            self.assertEqual(len(results), len(ops))
+            self.assertTrue(all(r['error_code'] == 0 for r in results[:4]))
+            self.assertNotEqual(results[4]['error_code'], 0)
+            self.assertEqual(results[5]['error_code'], 0)
+            self.assertEqual(results[5]['output'][self.maximum_number_of_data_objects_attribute()], '10')
+
+            for c in [col1, col2]:
+                values = self.get_logical_quotas_attribute_values(c, include_max_values=True)
+                self.assertEqual(values[self.maximum_number_of_data_objects_attribute()], 10)
+
     @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
     def test_adding_duplicate_attribute_names_with_different_values_or_units_is_not_allowed__issue_36(self):
         col = self.admin1.session_collection
@@ -981,16 +1073,650 @@ class Test_Rule_Engine_Plugin_Logical_Quotas(session.make_sessions_mixin(admins,
             self.admin1.assert_icommand(
                 ['irule', '-r', 'irods_rule_engine_plugin-logical_quotas-instance', op, 'null', 'ruleExecOut'], 'STDOUT', expected_output)
 
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_overwriting_and_appending_to_data_objects_applies_the_change_in_size_to_parent_collections(self):
+        for recalculate_totals_on_close in [False, True]:
+            with self.rule_engine_plugin_enabled(options={'recalculate_totals_on_close': recalculate_totals_on_close}):
+                monitored_collection_1 = self.user.session_collection
+                monitored_collection_2 = f'{monitored_collection_1}/lq_close_deltas'
+                self.user.assert_icommand(['imkdir', monitored_collection_2])
+
+                try:
+                    self.logical_quotas_start_monitoring_collection(monitored_collection_1)
+                    self.logical_quotas_start_monitoring_collection(monitored_collection_2)
+
+                    data_object = f'{monitored_collection_2}/foo'
+                    self.user.assert_icommand(['istream', 'write', data_object], input='0123456789')
+                    self.assert_quotas(monitored_collection_1, 1, 10)
+                    self.assert_quotas(monitored_collection_2, 1, 10)
+
+                    # Overwriting a data object with less data only changes the size.
+                    self.user.assert_icommand(['istream', 'write', data_object], input='01234')
+                    self.assert_quotas(monitored_collection_1, 1, 5)
+                    self.assert_quotas(monitored_collection_2, 1, 5)
+
+                    self.user.assert_icommand(['istream', 'write', '-a', data_object], input='567')
+                    self.assert_quotas(monitored_collection_1, 1, 8)
+                    self.assert_quotas(monitored_collection_2, 1, 8)
+
+                    # Opening a data object for writing without writing anything changes nothing.
+                    self.user.assert_icommand(['istream', 'write', '-a', data_object], input='')
+                    self.assert_quotas(monitored_collection_1, 1, 8)
+                    self.assert_quotas(monitored_collection_2, 1, 8)
+
+                finally:
+                    self.user.run_icommand(['irm', '-rf', monitored_collection_2])
+                    self.logical_quotas_stop_monitoring_collection(monitored_collection_1)
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_logical_quotas_get_statistics_reports_calls_and_catalog_requests_per_handler(self):
+        col = self.admin1.session_collection
+
+        with self.rule_engine_plugin_enabled():
+            def get_statistics():
+                op = json.dumps({'operation': 'logical_quotas_get_statistics'})
+                out, _, ec = self.admin1.run_icommand(['irule', '-r', 'irods_rule_engine_plugin-logical_quotas-instance', op, 'null', 'ruleExecOut'])
+                self.assertEqual(ec, 0)
+                return json.loads(out)
+
+            try:
+                self.logical_quotas_start_monitoring_collection(col)
+                self.logical_quotas_set_maximum_number_of_data_objects(col, '1')
+
+                before = get_statistics()
+                self.assertIn('collecting_since', before)
+
+                # Create a data object, then violate the quota.
+                self.admin1.assert_icommand(['istream', 'write', 'foo'], input='data')
+                self.admin1.assert_icommand_fail(['istream', 'write', 'bar'], input='data')
+
+                after = get_statistics()
+
+                for name in ['calls', 'gen_queries', 'metadata_writes', 'quota_violations']:
+                    self.assertGreater(after['totals'][name], before['totals'][name], msg=name)
+
+                # istream opens data objects via the replica API.
+                handler = after['handlers']['pep_api_replica_open_pre']
+                self.assertGreaterEqual(handler['calls'], 2)
+                self.assertGreaterEqual(handler['errors'], 1)
+                self.assertGreaterEqual(handler['quota_violations'], 1)
+                self.assertEqual(sum(b['count'] for b in handler['latency_histogram']), handler['calls'])
+                self.assertIsNone(handler['latency_histogram'][-1]['less_than_microseconds'])
+
+            finally:
+                self.admin1.run_icommand(['irm', '-f', 'foo'])
+                self.logical_quotas_stop_monitoring_collection(col)
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_recalculating_totals_works_with_and_without_the_combined_specific_query(self):
+        col = self.admin1.session_collection
+
+        with self.rule_engine_plugin_enabled():
+            try:
+                self.logical_quotas_start_monitoring_collection(col)
+
+                self.admin1.assert_icommand(['istream', 'write', 'foo'], input='0123456789')
+                self.admin1.assert_icommand(['istream', 'write', 'bar'], input='01234')
+                self.logical_quotas_recalculate_totals(col)
+                self.assert_quotas(col, 2, 15)
+
+                # Without the combined specific query, the plugin falls back to the two original
+                # specific queries.
+                self.admin1.assert_icommand(['iadmin', 'rsq', 'logical_quotas_count_and_sum_data_objects_recursive'])
+
+                try:
+                    self.admin1.assert_icommand(['irm', '-f', 'bar'])
+                    self.logical_quotas_recalculate_totals(col)
+                    self.assert_quotas(col, 1, 10)
+
+                finally:
+                    self.admin1.assert_icommand(['iadmin', 'asq', self.count_and_sum_data_objects_query(),
+                                                'logical_quotas_count_and_sum_data_objects_recursive'])
+
+            finally:
+                self.admin1.run_icommand(['irm', '-f', 'foo', 'bar'])
+                self.logical_quotas_stop_monitoring_collection(col)
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_recalculating_totals_removes_duplicate_total_avus(self):
+        col = self.admin1.session_collection
+
+        with self.rule_engine_plugin_enabled():
+            try:
+                self.logical_quotas_start_monitoring_collection(col)
+                self.admin1.assert_icommand(['istream', 'write', 'foo'], input='0123456789')
+
+                # Duplicates such as those left behind by a total written from a stale value.
+                self.add_duplicate_total_avus(col)
+
+                self.logical_quotas_recalculate_totals(col)
+                self.assert_single_avu_per_total(col)
+                self.assert_quotas(col, 1, 10)
+
+            finally:
+                self.admin1.run_icommand(['irm', '-f', 'foo'])
+                self.logical_quotas_stop_monitoring_collection(col)
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_recalculating_totals_in_chunks_counts_every_child_collection_once(self):
+        col = self.admin1.session_collection
+
+        # "a" and "ab" share a prefix. Neither may be counted twice.
+        for child, size in [('a', 1), ('ab', 2), ('ab/c', 4), ('d', 8)]:
+            self.admin1.assert_icommand(['imkdir', '-p', os.path.join(col, child)])
+            self.admin1.assert_icommand(['istream', 'write', os.path.join(col, child, 'foo')], input='x' * size)
+
+        self.admin1.assert_icommand(['istream', 'write', os.path.join(col, 'foo')], input='x' * 16)
+
+        try:
+            with self.rule_engine_plugin_enabled(options={'recalculation_threads': 2}):
+                self.logical_quotas_start_monitoring_collection(col)
+                self.logical_quotas_recalculate_totals(col)
+                self.assert_quotas(col, 5, 31)
+
+                self.logical_quotas_count_total_number_of_data_objects(col)
+                self.logical_quotas_count_total_size_in_bytes(col)
+                self.assert_quotas(col, 5, 31)
+
+                # The checkpoints are removed once every chunk is counted.
+                out, _, _ = self.admin1.run_icommand(['imeta', 'ls', '-C', col])
+                self.assertNotIn('recalculation_checkpoint', out)
+
+        finally:
+            with self.rule_engine_plugin_enabled():
+                self.logical_quotas_stop_monitoring_collection(col)
+            self.admin1.run_icommand(['irm', '-rf'] + [os.path.join(col, name) for name in ['a', 'ab', 'd', 'foo']])
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_totals_remain_exact_under_concurrent_writes_with_compare_and_swap(self):
+        col = self.admin1.session_collection
+        writers = 8
+        data_objects_per_writer = 5
+
+        def write_data_objects(writer):
+            for i in range(data_objects_per_writer):
+                self.admin1.assert_icommand(['istream', 'write', os.path.join(col, 'w{0}_{1}'.format(writer, i))], input='x')
+
+        try:
+            with self.rule_engine_plugin_enabled(options={'compare_and_swap_retries': 100}):
+                self.logical_quotas_start_monitoring_collection(col)
+
+                with concurrent.futures.ThreadPoolExecutor(max_workers=writers) as executor:
+                    list(executor.map(write_data_objects, range(writers)))
+
+                total = writers * data_objects_per_writer
+                self.assert_quotas(col, total, total)
+
+        finally:
+            with self.rule_engine_plugin_enabled():
+                self.logical_quotas_stop_monitoring_collection(col)
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_concurrent_writes_without_compare_and_swap_leave_a_single_avu_per_total(self):
+        col = self.admin1.session_collection
+        writers = 8
+        data_objects_per_writer = 5
+
+        # Each writer adds a different number of bytes, so totals written from stale values differ.
+        def write_data_objects(writer):
+            for i in range(data_objects_per_writer):
+                self.admin1.assert_icommand(['istream', 'write', os.path.join(col, 'w{0}_{1}'.format(writer, i))], input='x' * (writer + 1))
+
+        try:
+            with self.rule_engine_plugin_enabled():
+                self.logical_quotas_start_monitoring_collection(col)
+
+                with concurrent.futures.ThreadPoolExecutor(max_workers=writers) as executor:
+                    list(executor.map(write_data_objects, range(writers)))
+
+                self.assert_single_avu_per_total(col)
+                self.assert_quotas(col, writers * data_objects_per_writer, sum(w + 1 for w in range(writers)) * data_objects_per_writer)
+
+        finally:
+            with self.rule_engine_plugin_enabled():
+                self.logical_quotas_stop_monitoring_collection(col)
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_counter_shards_are_summed_by_readers_and_folded_into_totals_by_compaction(self):
+        col = self.admin1.session_collection
+        writers = 4
+        data_objects_per_writer = 5
+        shard_prefix = self.total_number_of_data_objects_attribute() + '::shard_'
+
+        def write_data_objects(writer):
+            for i in range(data_objects_per_writer):
+                self.admin1.assert_icommand(['istream', 'write', os.path.join(col, 'w{0}_{1}'.format(writer, i))], input='x')
+
+        try:
+            with self.rule_engine_plugin_enabled(options={'compare_and_swap_retries': 100, 'counter_shards': 4}):
+                self.logical_quotas_start_monitoring_collection(col)
+
+                with concurrent.futures.ThreadPoolExecutor(max_workers=writers) as executor:
+                    list(executor.map(write_data_objects, range(writers)))
+
+                # The changes were applied to the shards. The status reports their sum.
+                self.admin1.assert_icommand(['imeta', 'ls', '-C', col], 'STDOUT', [shard_prefix])
+
+                total = writers * data_objects_per_writer
+                op = json.dumps({'operation': 'logical_quotas_get_collection_status', 'collection': col})
+                expected_output = ['"{0}":"{1}"'.format(self.total_number_of_data_objects_attribute(), total),
+                                   '"{0}":"{1}"'.format(self.total_size_in_bytes_attribute(), total)]
+                self.admin1.assert_icommand(['irule', '-r', 'irods_rule_engine_plugin-logical_quotas-instance', op, 'null', 'ruleExecOut'],
+                                            'STDOUT', expected_output)
+
+                # Limits are enforced against the sum.
+                self.logical_quotas_set_maximum_number_of_data_objects(col, str(total))
+                quota_violation_msg = ['Logical Quotas Policy Violation: Adding object exceeds maximum number of objects limit']
+                self.admin1.assert_icommand(['itouch', os.path.join(col, 'over')], 'STDOUT', quota_violation_msg)
+                self.logical_quotas_unset_maximum_number_of_data_objects(col)
+
+                # Compaction folds the shards into the totals and removes them.
+                self.logical_quotas_compact_counters(col)
+                self.admin1.assert_icommand_fail(['imeta', 'ls', '-C', col], 'STDOUT', [shard_prefix])
+                self.assert_quotas(col, total, total)
+
+                # Stopping monitoring removes the shards along with the totals.
+                self.admin1.assert_icommand(['istream', 'write', os.path.join(col, 'after')], input='x')
+                self.logical_quotas_stop_monitoring_collection(col)
+                self.admin1.assert_icommand_fail(['imeta', 'ls', '-C', col], 'STDOUT', [shard_prefix])
+
+        finally:
+            with self.rule_engine_plugin_enabled():
+                self.logical_quotas_stop_monitoring_collection(col)
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_headroom_leases_enforce_limits_and_are_returned_when_agents_exit(self):
+        col = self.admin1.session_collection
+        lease_attribute = self.logical_quotas_namespace() + '::headroom_lease'
+
+        try:
+            options = {'compare_and_swap_retries': 100, 'headroom_lease_data_objects': 5, 'headroom_lease_size_in_bytes': 100}
+            with self.rule_engine_plugin_enabled(options=options):
+                self.logical_quotas_start_monitoring_collection(col)
+                self.logical_quotas_set_maximum_number_of_data_objects(col, '3')
+                self.logical_quotas_set_maximum_size_in_bytes(col, '30')
+
+                # Each agent leases more headroom than it uses and returns the rest when it exits.
+                for i in range(3):
+                    self.put_new_data_object(os.path.join(col, 'foo{0}'.format(i)), size=10)
+                    self.assert_quotas(col, i + 1, (i + 1) * 10)
+                    self.admin1.assert_icommand_fail(['imeta', 'ls', '-C', col], 'STDOUT', [lease_attribute])
+
+                # No headroom is left, so nothing can be leased. The failed attempt leaves no record behind.
+                self.put_new_data_object_exceeds_quota(os.path.join(col, 'foo3'))
+                self.assert_quotas(col, 3, 30)
+                self.admin1.assert_icommand_fail(['imeta', 'ls', '-C', col], 'STDOUT', [lease_attribute])
+
+                # Removals free headroom which can be leased again.
+                self.admin1.assert_icommand(['irm', '-f', os.path.join(col, 'foo0')])
+                self.put_new_data_object(os.path.join(col, 'foo3'), size=10)
+                self.assert_quotas(col, 3, 30)
+
+        finally:
+            with self.rule_engine_plugin_enabled():
+                self.logical_quotas_stop_monitoring_collection(col)
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_concurrent_puts_do_not_exceed_limits_together_when_reserving_in_flight_changes(self):
+        col = self.admin1.session_collection
+        writers = 16
+        max_number_of_data_objects = 4
+
+        def put_data_object(writer):
+            filename = os.path.join(self.admin1.local_session_dir, 'foo{0}'.format(writer))
+            lib.make_file(filename, 10, 'arbitrary')
+            self.admin1.run_icommand(['iput', filename, os.path.join(col, 'foo{0}'.format(writer))])
+            os.remove(filename)
+
+        try:
+            with self.rule_engine_plugin_enabled(options={'reserve_in_flight_changes': True}):
+                self.logical_quotas_start_monitoring_collection(col)
+                self.logical_quotas_set_maximum_number_of_data_objects(col, str(max_number_of_data_objects))
+
+                with concurrent.futures.ThreadPoolExecutor(max_workers=writers) as executor:
+                    list(executor.map(put_data_object, range(writers)))
+
+                # Every put which was admitted is accounted for, and together they stay within the limit.
+                out, _, _ = self.admin1.run_icommand(['ils', col])
+                data_objects = len([line for line in out.splitlines() if line.strip().startswith('foo')])
+                self.assertLessEqual(data_objects, max_number_of_data_objects)
+                self.assert_quotas(col, data_objects, data_objects * 10)
+
+        finally:
+            with self.rule_engine_plugin_enabled():
+                self.logical_quotas_stop_monitoring_collection(col)
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_write_behind_writes_pending_changes_at_the_limits_and_when_the_agent_exits(self):
+        col = self.admin1.session_collection
+        journal_directory = tempfile.mkdtemp()
+
+        def data_object_count():
+            return self.get_logical_quotas_attribute_values(col)[self.total_number_of_data_objects_attribute()]
+
+        # Each put adds 10 bytes. The second value tells whether the limits cause the change to be
+        # written while the agent is still running.
+        cases = [
+            ({'write_behind_maximum_pending_updates': 100}, False),
+            ({'write_behind_maximum_pending_updates': 1}, True),
+            ({'write_behind_maximum_pending_updates': 100, 'write_behind_maximum_pending_bytes': 10}, True)
+        ]
+
+        try:
+            with self.rule_engine_plugin_enabled():
+                self.logical_quotas_start_monitoring_collection(col)
+
+            for i, (limits, written_before_exit) in enumerate(cases):
+                # The journal only serves to tell when the agent has recorded the change.
+                options = {'write_behind_flush_interval_in_seconds': 3600, 'journal_directory': journal_directory}
+                options.update(limits)
+
+                with self.rule_engine_plugin_enabled(options=options):
+                    with self.put_data_object_in_background(os.path.join(col, 'foo{0}'.format(i)), 10, 15) as put:
+                        if written_before_exit:
+                            self.wait_until(lambda: data_object_count() == i + 1)
+                        else:
+                            self.wait_until(lambda: len(os.listdir(journal_directory)) > 0)
+                            self.assertEqual(data_object_count(), i)
+
+                        self.assertFalse(put.done(), msg=limits)
+
+                    # The agent writes whatever it still holds when it exits.
+                    self.assertEqual(put.result()[2], 0)
+                    self.assert_quotas(col, i + 1, (i + 1) * 10)
+                    self.assertEqual(os.listdir(journal_directory), [])
+
+        finally:
+            shutil.rmtree(journal_directory, ignore_errors=True)
+            with self.rule_engine_plugin_enabled():
+                self.logical_quotas_stop_monitoring_collection(col)
+            self.admin1.run_icommand(['irm', '-f'] + [os.path.join(col, 'foo{0}'.format(i)) for i in range(len(cases))])
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_replaying_the_journal_restores_the_changes_held_by_an_agent_which_died(self):
+        col = self.admin1.session_collection
+        journal_directory = tempfile.mkdtemp()
+        options = {
+            'write_behind_maximum_pending_updates': 100,
+            'write_behind_flush_interval_in_seconds': 3600,
+            'journal_directory': journal_directory
+        }
+
+        try:
+            with self.rule_engine_plugin_enabled(options=options):
+                self.logical_quotas_start_monitoring_collection(col)
+
+                with self.put_data_object_in_background(os.path.join(col, 'foo'), 10, 60):
+                    self.wait_until(lambda: len(os.listdir(journal_directory)) > 0)
+
+                    # Journals are named "<prefix><pid>.<timestamp>.journal".
+                    pid = int(os.listdir(journal_directory)[0].split('.')[1])
+                    os.kill(pid, signal.SIGKILL)
+
+                # The change held in memory was lost with the agent, but not its journal.
+                self.wait_until(lambda: not os.path.exists('/proc/{0}'.format(pid)))
+                self.assert_quotas(col, 0, 0)
+                self.assertEqual(len(os.listdir(journal_directory)), 1)
+
+                self.logical_quotas_replay_journal()
+                self.assert_quotas(col, 1, 10)
+                self.assertEqual(os.listdir(journal_directory), [])
+
+        finally:
+            shutil.rmtree(journal_directory, ignore_errors=True)
+            with self.rule_engine_plugin_enabled():
+                self.logical_quotas_stop_monitoring_collection(col)
+            self.admin1.run_icommand(['irm', '-f', os.path.join(col, 'foo')])
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_parallel_transfer_is_accounted_for_once(self):
+        col = self.admin1.session_collection
+        size = 40 * 1024 * 1024
+        filename = os.path.join(self.admin1.local_session_dir, 'parallel_transfer.bin')
+        lib.make_file(filename, size, 'arbitrary')
+
+        try:
+            with self.rule_engine_plugin_enabled():
+                self.logical_quotas_start_monitoring_collection(col)
+
+                # Every transfer thread closes the replica, but only the last close finalizes it.
+                self.admin1.assert_icommand(['iput', '-N', '4', filename, os.path.join(col, 'foo')])
+                self.assert_quotas(col, 1, size)
+
+                self.admin1.assert_icommand(['iput', '-f', '-N', '4', filename, os.path.join(col, 'foo')])
+                self.assert_quotas(col, 1, size)
+
+        finally:
+            os.remove(filename)
+            with self.rule_engine_plugin_enabled():
+                self.logical_quotas_stop_monitoring_collection(col)
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_incremental_recalculation_recounts_modified_data_objects_and_falls_back_on_drift(self):
+        col = self.admin1.session_collection
+        child = os.path.join(col, 'child')
+        self.admin1.assert_icommand(['imkdir', child])
+        self.admin1.assert_icommand(['istream', 'write', os.path.join(child, 'foo')], input='0123456789')
+
+        try:
+            with self.rule_engine_plugin_enabled():
+                self.logical_quotas_start_monitoring_collection(col)
+
+                # The first incremental recalculation counts everything and records the watermark.
+                self.logical_quotas_recalculate_totals(col, mode='incremental')
+                self.assert_quotas(col, 1, 10)
+                self.admin1.assert_icommand(['imeta', 'ls', '-C', col], 'STDOUT', ['recalculation_watermark'])
+
+                # Changes tracked by the plugin keep the totals in step with the recounted chunks.
+                self.admin1.assert_icommand(['istream', 'write', os.path.join(child, 'bar')], input='01234')
+                self.logical_quotas_recalculate_totals(col, mode='incremental')
+                self.assert_quotas(col, 2, 15)
+
+                # Duplicate AVUs of a total are replaced along with the total.
+                self.add_duplicate_total_avus(col)
+                self.logical_quotas_recalculate_totals(col, mode='incremental')
+                self.assert_single_avu_per_total(col)
+                self.assert_quotas(col, 2, 15)
+
+            # A removal made while the plugin is disabled leaves no modification time behind. The totals
+            # are still corrected once they no longer match the recounted chunks.
+            self.admin1.assert_icommand(['irm', '-f', os.path.join(child, 'bar')])
+            self.admin1.assert_icommand(['istream', 'write', os.path.join(col, 'baz')], input='0')
+
+            with self.rule_engine_plugin_enabled():
+                self.logical_quotas_recalculate_totals(col, mode='incremental')
+                self.assert_quotas(col, 2, 11)
+
+                json_string = json.dumps({'operation': 'logical_quotas_recalculate_totals', 'collection': col, 'mode': 'partial'})
+                self.admin1.assert_icommand_fail(['irule', '-r', 'irods_rule_engine_plugin-logical_quotas-instance', json_string, 'null', 'null'],
+                                                 'STDOUT', ['Invalid recalculation mode'])
+
+        finally:
+            with self.rule_engine_plugin_enabled():
+                self.logical_quotas_stop_monitoring_collection(col)
+            self.admin1.run_icommand(['irm', '-rf', child, os.path.join(col, 'baz')])
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_subtree_queries_do_not_match_sibling_collections_sharing_a_prefix(self):
+        col = os.path.join(self.admin1.session_collection, 'a')
+        sibling = os.path.join(self.admin1.session_collection, 'ab')
+        dst = os.path.join(self.admin1.session_collection, 'dst')
+
+        for c in [col, sibling, dst]:
+            self.admin1.assert_icommand(['imkdir', c])
+
+        self.admin1.assert_icommand(['istream', 'write', os.path.join(col, 'foo')], input='0123456789')
+        self.admin1.assert_icommand(['istream', 'write', os.path.join(sibling, 'bar')], input='01234')
+
+        try:
+            with self.rule_engine_plugin_enabled():
+                self.logical_quotas_start_monitoring_collection(col)
+                self.logical_quotas_start_monitoring_collection(dst)
+                self.logical_quotas_recalculate_totals(col)
+                self.assert_quotas(col, 1, 10)
+
+                # Moving the collection counts its subtree only. The collection must not be monitored,
+                # otherwise its stored totals are used instead.
+                self.logical_quotas_stop_monitoring_collection(col)
+                self.admin1.assert_icommand(['imv', col, dst])
+                self.assert_quotas(dst, 1, 10)
+
+        finally:
+            with self.rule_engine_plugin_enabled():
+                self.logical_quotas_stop_monitoring_collection(dst)
+            self.admin1.run_icommand(['irm', '-rf', col, sibling, dst])
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_moving_a_monitored_collection_uses_its_stored_totals(self):
+        col = os.path.join(self.admin1.session_collection, 'col')
+        dst = os.path.join(self.admin1.session_collection, 'dst')
+
+        for c in [col, dst]:
+            self.admin1.assert_icommand(['imkdir', c])
+
+        self.admin1.assert_icommand(['istream', 'write', os.path.join(col, 'foo')], input='0123456789')
+
+        try:
+            with self.rule_engine_plugin_enabled():
+                self.logical_quotas_start_monitoring_collection(col)
+                self.logical_quotas_start_monitoring_collection(dst)
+                self.assert_quotas(col, 1, 10)
+
+                # Make the stored totals differ from the contents of the collection so that the
+                # values used by the move can be told apart.
+                self.admin1.assert_icommand(['imeta', 'set', '-C', col, self.total_number_of_data_objects_attribute(), '7'])
+                self.admin1.assert_icommand(['imeta', 'set', '-C', col, self.total_size_in_bytes_attribute(), '700'])
+
+                # Moving the monitored collection uses its stored totals.
+                self.admin1.assert_icommand(['imv', col, dst])
+                col = os.path.join(dst, 'col')
+                self.assert_quotas(dst, 7, 700)
+
+                # Without the totals, moving the collection back out counts its data objects.
+                self.logical_quotas_stop_monitoring_collection(col)
+                self.admin1.assert_icommand(['imv', col, self.admin1.session_collection])
+                col = os.path.join(self.admin1.session_collection, 'col')
+                self.assert_quotas(dst, 6, 690)
+
+        finally:
+            with self.rule_engine_plugin_enabled():
+                self.logical_quotas_stop_monitoring_collection(dst)
+            self.admin1.run_icommand(['irm', '-rf', col, dst])
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_logical_quotas_recalculate_all_updates_nested_monitored_collections(self):
+        col = self.admin1.session_collection
+        child = os.path.join(col, 'child')
+        grandchild = os.path.join(child, 'grandchild')
+        self.admin1.assert_icommand(['imkdir', '-p', grandchild])
+
+        try:
+            with self.rule_engine_plugin_enabled():
+                self.logical_quotas_start_monitoring_collection(col)
+                self.logical_quotas_start_monitoring_collection(grandchild)
+                self.assert_quotas(col, 0, 0)
+                self.assert_quotas(grandchild, 0, 0)
+
+            # Add data objects while the plugin is disabled so that the totals are out of date.
+            self.admin1.assert_icommand(['istream', 'write', os.path.join(col, 'foo')], input='0123456789')
+            self.admin1.assert_icommand(['istream', 'write', os.path.join(child, 'bar')], input='01234')
+            self.admin1.assert_icommand(['istream', 'write', os.path.join(grandchild, 'baz')], input='012')
+
+            with self.rule_engine_plugin_enabled():
+                self.assert_quotas(col, 0, 0)
+                self.assert_quotas(grandchild, 0, 0)
+
+                # Duplicate AVUs of a total are replaced along with the total.
+                self.add_duplicate_total_avus(grandchild)
+
+                self.logical_quotas_recalculate_all()
+                self.assert_quotas(col, 3, 18)
+                self.assert_quotas(grandchild, 1, 3)
+                self.assert_single_avu_per_total(grandchild)
+
+            self.admin1.assert_icommand(['irm', '-f', os.path.join(grandchild, 'baz')])
+
+            # Without the grouped specific query, each monitored collection is recalculated separately.
+            self.admin1.assert_icommand(['iadmin', 'rsq', 'logical_quotas_count_and_sum_data_objects_by_collection'])
+
+            try:
+                with self.rule_engine_plugin_enabled():
+                    # Only the monitored collections under the collection passed are recalculated.
+                    self.logical_quotas_recalculate_all(child)
+                    self.assert_quotas(col, 3, 18)
+                    self.assert_quotas(grandchild, 0, 0)
+
+            finally:
+                self.admin1.assert_icommand(['iadmin', 'asq', self.count_and_sum_data_objects_by_collection_query(),
+                                            'logical_quotas_count_and_sum_data_objects_by_collection'])
+
+        finally:
+            with self.rule_engine_plugin_enabled():
+                self.logical_quotas_stop_monitoring_collection(grandchild)
+                self.logical_quotas_stop_monitoring_collection(col)
+            self.admin1.run_icommand(['irm', '-rf', child, os.path.join(col, 'foo')])
+
     #
     # Utility Functions
     #
 
+    def count_and_sum_data_objects_query(self):
+        return str('select count(distinct t.data_id), sum(t.data_size) from (' +
+                   'select distinct d.data_id, ' +
+                       'case when d.data_is_dirty in (\'1\', \'4\') then d.data_size end as data_size ' +
+                   'from R_DATA_MAIN d inner join R_COLL_MAIN c on d.coll_id = c.coll_id ' +
+                   'where c.coll_name like ?) as t')
+
+    def count_and_sum_data_objects_in_subtree_query(self):
+        return str('select count(distinct t.data_id), sum(t.data_size) from (' +
+                   'select distinct d.data_id, ' +
+                       'case when d.data_is_dirty in (\'1\', \'4\') then d.data_size end as data_size ' +
+                   'from R_DATA_MAIN d inner join R_COLL_MAIN c on d.coll_id = c.coll_id ' +
+                   'where c.coll_name = ? or (c.coll_name collate "C" >= ? and c.coll_name collate "C" < ?)) as t')
+
+    def count_and_sum_data_objects_by_collection_query(self):
+        return str('select c.coll_name, count(distinct t.data_id), sum(t.data_size) from (' +
+                   'select distinct d.coll_id, d.data_id, ' +
+                       'case when d.data_is_dirty in (\'1\', \'4\') then d.data_size end as data_size ' +
+                   'from R_DATA_MAIN d) as t ' +
+                   'inner join R_COLL_MAIN c on t.coll_id = c.coll_id ' +
+                   'where c.coll_name like ? group by c.coll_name')
+
     def put_new_data_object(self, logical_path, size=0):
         filename = os.path.join(self.admin1.local_session_dir, os.path.basename(logical_path))
         lib.make_file(filename, size, 'arbitrary')
         self.admin1.assert_icommand(['iput', filename, logical_path])
         os.remove(filename)
 
+    @contextlib.contextmanager
+    def put_data_object_in_background(self, logical_path, size, pause_in_seconds):
+        # The native rule language runs after the plugin, so the agent sleeps once the plugin has
+        # tracked the put. The agent exits once the put returns.
+        rule = textwrap.dedent('''
+            pep_api_data_obj_put_post(*INSTANCE_NAME, *COMM, *DATAOBJINP, *BUFFER, *PORTAL_OPR_OUT) {{
+                msiSleep("{0}", "0");
+            }}
+        '''.format(pause_in_seconds))
+
+        filename = os.path.join(self.admin1.local_session_dir, os.path.basename(logical_path))
+        lib.make_file(filename, size, 'arbitrary')
+
+        try:
+            with temporary_core_file() as core:
+                core.add_rule(rule)
+
+                with concurrent.futures.ThreadPoolExecutor(max_workers=1) as executor:
+                    yield executor.submit(self.admin1.run_icommand, ['iput', filename, logical_path])
+
+        finally:
+            os.remove(filename)
+
+    def wait_until(self, predicate, timeout_in_seconds=30):
+        deadline = time.time() + timeout_in_seconds
+        while not predicate():
+            self.assertLess(time.time(), deadline, msg='Timed out waiting for condition.')
+            time.sleep(0.5)
+
     def put_new_data_object_exceeds_quota(self, logical_path, size=0):
         filename = os.path.basename(logical_path)
         lib.make_file(filename, size, 'arbitrary')
@@ -1002,13 +1728,23 @@ class Test_Rule_Engine_Plugin_Logical_Quotas(session.make_sessions_mixin(admins,
         for f in files:
             lib.make_file(os.path.join(dir_name, f), file_size, 'arbitrary')
 
+    def add_duplicate_total_avus(self, coll):
+        self.admin1.assert_icommand(['imeta', 'add', '-C', coll, self.total_number_of_data_objects_attribute(), '7'])
+        self.admin1.assert_icommand(['imeta', 'add', '-C', coll, self.total_size_in_bytes_attribute(), '70'])
+
+    def assert_single_avu_per_total(self, coll):
+        out, _, _ = self.admin1.run_icommand(['imeta', 'ls', '-C', coll])
+        attributes = [line.split(':', 1)[1].strip() for line in out.splitlines() if line.startswith('attribute:')]
+        self.assertEqual(attributes.count(self.total_number_of_data_objects_attribute()), 1)
+        self.assertEqual(attributes.count(self.total_size_in_bytes_attribute()), 1)
+
     def assert_quotas(self, coll, expected_number_of_objects, expected_size_in_bytes):
         values = self.get_logical_quotas_attribute_values(coll)
         self.assertEqual(values[self.total_number_of_data_objects_attribute()], expected_number_of_objects)
         self.assertEqual(values[self.total_size_in_bytes_attribute()],          expected_size_in_bytes)
 
     @contextlib.contextmanager
-    def rule_engine_plugin_enabled(self, namespace=None):
+    def rule_engine_plugin_enabled(self, namespace=None, options=None):
         config = IrodsConfig()
         with lib.file_backed_up(config.server_config_path):
             config.server_config['log_level']['rule_engine'] = 'trace'
@@ -1025,6 +1761,8 @@ class Test_Rule_Engine_Plugin_Logical_Quotas(session.make_sessions_mixin(admins,
                     }
                 }
             })
+            if options:
+                config.server_config['plugin_configuration']['rule_engines'][0]['plugin_specific_configuration'].update(options)
             lib.update_json_file_from_dict(config.server_config_path, config.server_config)
 
             try:
@@ -1157,9 +1895,26 @@ class Test_Rule_Engine_Plugin_Logical_Quotas(session.make_sessions_mixin(admins,
             'collection': collection
         }))
 
-    def logical_quotas_recalculate_totals(self, collection):
+    def logical_quotas_recalculate_all(self, collection=None):
+        args = {'operation': 'logical_quotas_recalculate_all'}
+        if collection is not None:
+            args['collection'] = collection
+        self.exec_logical_quotas_operation(json.dumps(args))
+
+    def logical_quotas_recalculate_totals(self, collection, mode=None):
+        args = {'operation': 'logical_quotas_recalculate_totals', 'collection': collection}
+        if mode is not None:
+            args['mode'] = mode
+        self.exec_logical_quotas_operation(json.dumps(args))
+
+    def logical_quotas_replay_journal(self):
+        self.exec_logical_quotas_operation(json.dumps({
+            'operation': 'logical_quotas_replay_journal'
+        }))
+
+    def logical_quotas_compact_counters(self, collection):
         self.exec_logical_quotas_operation(json.dumps({
-            'operation': 'logical_quotas_recalculate_totals',
+            'operation': 'logical_quotas_compact_counters',
             'collection': collection
         }))
 
@@ -3,7 +3,9 @@
 
 #include <fmt/format.h>
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 
 namespace irods
 {
@@ -19,6 +21,9 @@ namespace irods
 			, maximum_size_in_bytes_{fmt::format("{}::{}", _namespace, _maximum_size_in_bytes)}
 			, total_number_of_data_objects_{fmt::format("{}::{}", _namespace, _total_number_of_data_objects)}
 			, total_size_in_bytes_{fmt::format("{}::{}", _namespace, _total_size_in_bytes)}
+			, recalculation_checkpoint_{fmt::format("{}::recalculation_checkpoint", _namespace)}
+			, recalculation_watermark_{fmt::format("{}::recalculation_watermark", _namespace)}
+			, headroom_lease_{fmt::format("{}::headroom_lease", _namespace)}
 		{
 		}
 
@@ -29,11 +34,53 @@ namespace irods
 		const std::string& total_size_in_bytes() const            { return total_size_in_bytes_; }
 		// clang-format on
 
+		// Names the AVUs which record the chunks already counted by an unfinished recalculation.
+		// The name is not configurable.
+		const std::string& recalculation_checkpoint() const { return recalculation_checkpoint_; }
+
+		// Names the AVUs which record the state of the last incremental recalculation. The name is
+		// not configurable.
+		const std::string& recalculation_watermark() const { return recalculation_watermark_; }
+
+		// Names the AVUs which identify the agents holding a headroom lease on a collection. The
+		// name is not configurable.
+		const std::string& headroom_lease() const { return headroom_lease_; }
+
+		// Names the AVU holding shard "_index" of "_total" (one of the totals above). The value of a
+		// total is the value of its own AVU plus the values of its shards.
+		auto counter_shard(const std::string& _total, std::int64_t _index) const -> std::string
+		{
+			return fmt::format("{}::shard_{}", _total, _index);
+		}
+
+		// Returns the GenQuery pattern matching the names of the shards of "_total".
+		auto counter_shard_pattern(const std::string& _total) const -> std::string
+		{
+			return fmt::format("{}::shard_%", _total);
+		}
+
+		// Returns the total "_attr_name" is a shard of, or nullptr if it is not a shard.
+		auto total_of_counter_shard(std::string_view _attr_name) const -> const std::string*
+		{
+			for (const auto* total : {&total_number_of_data_objects_, &total_size_in_bytes_}) {
+				if (_attr_name.size() > total->size() + 8 && _attr_name.starts_with(*total) &&
+				    _attr_name.substr(total->size()).starts_with("::shard_"))
+				{
+					return total;
+				}
+			}
+
+			return nullptr;
+		}
+
 	  private:
 		std::string maximum_number_of_data_objects_;
 		std::string maximum_size_in_bytes_;
 		std::string total_number_of_data_objects_;
 		std::string total_size_in_bytes_;
+		std::string recalculation_checkpoint_;
+		std::string recalculation_watermark_;
+		std::string headroom_lease_;
 	}; // class attributes
 } // namespace irods
 
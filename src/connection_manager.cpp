@@ -0,0 +1,102 @@
+#include "connection_manager.hpp"
+
+#include <irods/client_connection.hpp>
+#include <irods/irods_logger.hpp>
+#include <irods/rodsErrorTable.h>
+
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <memory>
+
+namespace
+{
+	namespace log = irods::experimental::log;
+
+	// Agents are forked from a parent process. A child must never use or disconnect a connection
+	// it inherited, because the socket is shared with the parent. The owner is tracked so that an
+	// inherited connection can be abandoned instead.
+	struct connection_holder
+	{
+		std::unique_ptr<irods::experimental::client_connection> conn;
+		pid_t owner_pid = -1;
+
+		~connection_holder()
+		{
+			if (getpid() != owner_pid) {
+				static_cast<void>(conn.release());
+			}
+		}
+	}; // struct connection_holder
+
+	connection_holder holder;
+
+	auto is_network_error(int _error_code) noexcept -> bool
+	{
+		switch (_error_code) {
+			case SYS_HEADER_READ_LEN_ERR:
+			case SYS_HEADER_WRITE_LEN_ERR:
+			case SYS_SOCK_READ_TIMEDOUT:
+			case SYS_SOCK_READ_ERR:
+			case SYS_SOCK_CONNECT_ERR:
+			case SYS_SOCK_OPEN_ERR:
+				return true;
+
+			default:
+				return false;
+		}
+	}
+} // anonymous namespace
+
+namespace irods::connection_manager
+{
+	auto get() -> RcComm&
+	{
+		if (holder.conn && getpid() != holder.owner_pid) {
+			// Intentionally leaked. See the comment on "connection_holder".
+			static_cast<void>(holder.conn.release());
+		}
+
+		if (!holder.conn) {
+			holder.conn = std::make_unique<irods::experimental::client_connection>();
+			holder.owner_pid = getpid();
+		}
+
+		return static_cast<RcComm&>(*holder.conn);
+	}
+
+	auto make_connection() -> std::shared_ptr<RcComm>
+	{
+		auto conn = std::make_shared<irods::experimental::client_connection>();
+		auto& comm = static_cast<RcComm&>(*conn);
+		return {std::move(conn), &comm};
+	}
+
+	auto release() noexcept -> void
+	{
+		if (!holder.conn) {
+			return;
+		}
+
+		if (getpid() != holder.owner_pid) {
+			static_cast<void>(holder.conn.release());
+			return;
+		}
+
+		try {
+			holder.conn.reset();
+		}
+		catch (...) {
+			log::rule_engine::warn("Logical Quotas Policy: Failed to disconnect agent connection.");
+		}
+	}
+
+	auto release_if_broken(int _error_code) noexcept -> void
+	{
+		// Error codes may carry an errno in their last three digits.
+		if (is_network_error(_error_code) || is_network_error(_error_code / 1000 * 1000)) {
+			log::rule_engine::debug("Logical Quotas Policy: Releasing agent connection [error_code={}].", _error_code);
+			release();
+		}
+	}
+} // namespace irods::connection_manager
@@ -0,0 +1,27 @@
+#ifndef IRODS_LOGICAL_QUOTAS_CONNECTION_MANAGER_HPP
+#define IRODS_LOGICAL_QUOTAS_CONNECTION_MANAGER_HPP
+
+#include <irods/rcConnect.h>
+
+#include <memory>
+
+namespace irods::connection_manager
+{
+	// Returns the privileged connection owned by the agent. The connection is created on first use
+	// and is reused by every PEP and operation handled by the agent until it is released.
+	auto get() -> RcComm&;
+
+	// Returns a new privileged connection which is not shared with the rest of the agent. Used by
+	// operations which spread their work over several connections. The connection is closed when
+	// the last copy of the pointer is destroyed.
+	auto make_connection() -> std::shared_ptr<RcComm>;
+
+	// Disconnects the connection owned by the agent, if any. The next call to get() creates a new
+	// connection.
+	auto release() noexcept -> void;
+
+	// Releases the connection if "_error_code" indicates the connection can no longer be used.
+	auto release_if_broken(int _error_code) noexcept -> void;
+} // namespace irods::connection_manager
+
+#endif // IRODS_LOGICAL_QUOTAS_CONNECTION_MANAGER_HPP
@@ -1,9 +1,11 @@
 #include "handler.hpp"
 
+#include "connection_manager.hpp"
 #include "logical_quotas_error.hpp"
+#include "plugin_statistics.hpp"
 #include "utilities.hpp"
 
-#include <irods/client_connection.hpp>
+#include <irods/atomic_apply_metadata_operations.h>
 #include <irods/escape_utilities.hpp>
 #include <irods/execCmd.h>
 #include <irods/filesystem.hpp>
@@ -18,9 +20,11 @@
 #include <irods/msParam.h>
 #include <irods/objDesc.hpp>
 #include <irods/query_builder.hpp>
+#include <irods/rcMisc.h>
 #include <irods/replica.hpp>
 #include <irods/rodsDef.h>
 #include <irods/rodsErrorTable.h>
+#include <irods/rodsKeyWdDef.h>
 #include <irods/scoped_client_identity.hpp>
 #include <irods/scoped_permission.hpp>
 
@@ -30,13 +34,29 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <map>
+#include <memory>
 #include <string>
 #include <string_view>
+#include <unordered_set>
 #include <vector>
 #include <tuple>
 #include <functional>
 #include <stdexcept>
+#include <system_error>
 #include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <optional>
+#include <utility>
+#include <chrono>
+#include <random>
 
 namespace
 {
@@ -45,7 +65,8 @@ namespace
 	namespace log                = irods::experimental::log;
 
 	using size_type              = irods::handler::size_type;
-	using quotas_info_type       = std::unordered_map<std::string, size_type>;
+	using event                  = irods::plugin_statistics::event;
+	using quotas_info_type       = irods::quotas_info_type;
 	using file_position_map_type = std::unordered_map<std::string, irods::handler::file_position_type>;
 	// clang-format on
 
@@ -53,6 +74,27 @@ namespace
 	// Classes
 	//
 
+	// Holds the logical path, collection ID and quota information of a monitored collection.
+	struct monitored_collection
+	{
+		fs::path path;
+		std::int64_t id = 0;
+		quotas_info_type info;
+	}; // struct monitored_collection
+
+	using monitored_collection_list = std::vector<monitored_collection>;
+
+	// Holds the logical paths of data objects which do not exist yet, but are about to be created by
+	// an open. The close of such a data object increments the data object count.
+	std::unordered_set<std::string> data_objects_pending_creation;
+
+	// Journals left behind by dead agents are replayed the first time an agent journals a change.
+	bool orphaned_journals_replayed = false;
+
+	// The number of times a change to the totals is retried on conflict when compare_and_swap_retries
+	// is not set. Every conflict means that another agent changed the totals first.
+	constexpr std::int64_t default_compare_and_swap_retries = 100;
+
 	class parent_path
 	{
 	  public:
@@ -85,10 +127,147 @@ namespace
 		const fs::path& p_;
 	}; // class parent_path
 
+	// Holds the totals computed for each monitored collection while recalculating many collections
+	// at once. The collections are arranged by path so that the data objects of any collection can
+	// be added to every monitored collection above it in a single walk.
+	class monitored_collection_trie
+	{
+	  public:
+		struct totals
+		{
+			size_type data_objects = 0;
+			size_type size_in_bytes = 0;
+		}; // struct totals
+
+		auto insert(const std::string& _path) -> void
+		{
+			auto* n = &root_;
+
+			for_each_component(_path, [&n](std::string_view _name) {
+				auto iter = n->children.find(_name);
+
+				if (iter == std::end(n->children)) {
+					iter = n->children.emplace(std::string{_name}, std::make_unique<node>()).first;
+				}
+
+				n = iter->second.get();
+				return true;
+			});
+
+			n->values = &totals_[_path];
+		}
+
+		// Adds the values to the totals of "_path" and of every monitored collection above it.
+		auto add(std::string_view _path, size_type _data_objects, size_type _size_in_bytes) -> void
+		{
+			const auto add_to = [_data_objects, _size_in_bytes](const node& _n) {
+				if (_n.values) {
+					_n.values->data_objects += _data_objects;
+					_n.values->size_in_bytes += _size_in_bytes;
+				}
+			};
+
+			const auto* n = &root_;
+			add_to(*n);
+
+			for_each_component(_path, [&n, &add_to](std::string_view _name) {
+				const auto iter = n->children.find(_name);
+
+				if (iter == std::end(n->children)) {
+					return false;
+				}
+
+				n = iter->second.get();
+				add_to(*n);
+
+				return true;
+			});
+		}
+
+		// Replaces the totals of the monitored collection "_path" only.
+		auto set(const std::string& _path, size_type _data_objects, size_type _size_in_bytes) -> void
+		{
+			totals_.at(_path) = {_data_objects, _size_in_bytes};
+		}
+
+		auto totals_by_path() const noexcept -> const std::unordered_map<std::string, totals>&
+		{
+			return totals_;
+		}
+
+	  private:
+		struct node
+		{
+			std::map<std::string, std::unique_ptr<node>, std::less<>> children;
+			totals* values = nullptr;
+		}; // struct node
+
+		// Invokes "_func" on each component of "_path" until it returns false.
+		template <typename Function>
+		static auto for_each_component(std::string_view _path, Function _func) -> void
+		{
+			while (!_path.empty()) {
+				const auto start = _path.find_first_not_of('/');
+
+				if (start == std::string_view::npos) {
+					return;
+				}
+
+				_path.remove_prefix(start);
+				const auto name = _path.substr(0, _path.find('/'));
+				_path.remove_prefix(name.size());
+
+				if (!_func(name)) {
+					return;
+				}
+			}
+		}
+
+		node root_;
+
+		// Elements of an unordered_map never move, so nodes can point into this map.
+		std::unordered_map<std::string, totals> totals_;
+	}; // class monitored_collection_trie
+
+	// A part of the subtree of a collection which is counted on its own. See make_recalculation_chunks().
+	struct recalculation_chunk
+	{
+		// The names of the first and last child collection covered. Both are empty for the chunk
+		// holding the data objects of the collection itself. Used to match the AVUs recorded for a
+		// chunk to the chunk.
+		std::string first;
+		std::string last;
+
+		// The collections covered. The subtree of each collection is covered unless "recursive" is
+		// false, in which case only the data objects held by the collection itself are.
+		std::vector<std::string> collections;
+		bool recursive = true;
+
+		bool counted = false;
+		size_type data_objects = 0;
+		size_type size_in_bytes = 0;
+
+		auto to_json() const -> nlohmann::json
+		{
+			return {{"first", first}, {"last", last}, {"data_objects", data_objects}, {"size_in_bytes", size_in_bytes}};
+		}
+
+		// Returns true if "_json" was produced by to_json() for this chunk.
+		auto matches(const nlohmann::json& _json) const -> bool
+		{
+			return _json.is_object() && _json.value("first", "") == first && _json.value("last", "") == last;
+		}
+	}; // struct recalculation_chunk
+
 	//
 	// Function Prototypes
 	//
 
+	// Returns the collection ID and metadata of the collection "_p". The ID is zero if the collection
+	// has no metadata.
+	auto get_monitored_collection(RcComm& _conn, const irods::attributes& _attrs, const fs::path& _p)
+		-> monitored_collection;
+
 	auto get_monitored_collection_info(RcComm& _conn, const irods::attributes& _attrs, const fs::path& _p)
 		-> quotas_info_type;
 
@@ -100,20 +279,375 @@ namespace
 	                                              const quotas_info_type& _tracking_info,
 	                                              size_type _delta) -> void;
 
-	auto is_monitored_collection(RcComm& _conn, const irods::attributes& _attrs, const fs::path& _p) -> bool;
+	// Returns true if "_info" holds either total. Only such collections are considered monitored.
+	auto holds_totals(const irods::attributes& _attrs, const quotas_info_type& _info) -> bool;
+
+	// Adds an AVU read from the catalog to "_info". AVUs not owned by the plugin are ignored. Once
+	// every AVU of a collection has been added, add_counter_shards_to_totals() must be invoked.
+	auto add_quota_attribute(const irods::attributes& _attrs,
+	                         quotas_info_type& _info,
+	                         const std::string& _attr_name,
+	                         const std::string& _value) -> void;
+
+	// Adds the value of each counter shard in "_info" to the total it belongs to, so readers always
+	// see the sum.
+	auto add_counter_shards_to_totals(const irods::attributes& _attrs, quotas_info_type& _info) -> void;
+
+	// Returns a GenQuery condition for META_COLL_ATTR_NAME matching every AVU owned by the plugin,
+	// including the counter shards.
+	auto make_quota_attribute_condition(const irods::attributes& _attrs) -> std::string;
+
+	// Returns the value of the AVU of "_attr_name" itself, i.e. the value in "_info" minus the
+	// values of its counter shards.
+	auto get_stored_value(const irods::attributes& _attrs, const quotas_info_type& _info, const std::string& _attr_name)
+		-> size_type;
 
-	auto get_monitored_parent_collection(RcComm& _conn, const irods::attributes& _attrs, fs::path _p)
+	// Returns the quota information of every monitored collection at or under "_root", keyed by path.
+	// Uses a single query regardless of the number of collections.
+	auto get_quota_information_for_subtree(RcComm& _conn, const irods::attributes& _attrs, const fs::path& _root)
+		-> std::map<std::string, quotas_info_type>;
+
+	// Returns the status of a monitored collection as reported by logical_quotas_get_collection_status.
+	// Limits and totals which are not set are reported as empty strings.
+	auto make_collection_status(const irods::attributes& _attrs, const quotas_info_type& _info) -> nlohmann::json;
+
+	auto get_monitored_parent_collection(RcComm& _conn, const irods::instance_configuration& _config, fs::path _p)
 		-> std::optional<fs::path>;
 
-	auto compute_data_object_count_and_size(RcComm& _conn, fs::path _p) -> std::tuple<size_type, size_type>;
+	// Returns false if neither "_p" nor any of its parent collections is monitored. Only the agent's
+	// cache and the shared table of monitored collections are consulted, so no connection is needed.
+	// Returns true if they cannot rule it out, in which case the catalog must be consulted.
+	auto may_be_monitored(const irods::instance_configuration& _config, fs::path _p) -> bool;
 
+	// Returns every monitored collection along the path "_p", including "_p" itself. The list is
+	// ordered from the nearest collection to the root collection. All quota information is fetched
+	// in a single query, regardless of the depth of "_p".
+	//
+	// Quota information is served from the agent's cache when possible. Only collections which are
+	// not cached are fetched from the catalog.
+	auto get_monitored_collections(RcComm& _conn, const irods::instance_configuration& _config, fs::path _p)
+		-> monitored_collection_list;
+
+	// Returns every monitored collection in the zone, along with its quota information, keyed by path.
+	auto get_quota_information_for_all_monitored_collections(RcComm& _conn, const irods::attributes& _attrs)
+		-> std::unordered_map<std::string, monitored_collection>;
+
+	// Returns every monitored collection in the zone. Used to populate the table of monitored
+	// collections shared by all agents.
+	auto get_all_monitored_collections(RcComm& _conn, const irods::attributes& _attrs)
+		-> std::vector<irods::monitored_collection_index::entry>;
+
+	// Drops information about "_path" from the agent's cache and forces the shared table of
+	// monitored collections to be reloaded.
+	auto invalidate_cached_information(const irods::instance_configuration& _config, const std::string& _path) -> void;
+
+	// Like invalidate_cached_information(), but also covers every collection under "_path". The
+	// shared table is only reloaded if it holds "_path" or a collection under it.
+	auto invalidate_cached_information_for_tree(const irods::instance_configuration& _config, const std::string& _path)
+		-> void;
+
+	// Like invalidate_cached_information_for_tree(), but keeps the quota information of the collections
+	// under "_path". Used when they are renamed, which changes their paths but not their collection IDs.
+	auto invalidate_cached_paths_for_tree(const irods::instance_configuration& _config, const std::string& _path)
+		-> void;
+
+	// Returns the totals stored on "_p" if it is a monitored collection whose totals can be trusted
+	// to describe its contents, and std::nullopt otherwise. The totals are read from the catalog,
+	// never from the agent's cache, and cost a single query regardless of the size of "_p".
+	auto get_trusted_data_object_count_and_size(RcComm& _conn,
+	                                            const irods::instance_configuration& _config,
+	                                            const fs::path& _p) -> std::optional<std::tuple<size_type, size_type>>;
+
+	// Returns the number of data objects and bytes at or under "_p". Used by the PEPs which move,
+	// copy or remove whole collections. The stored totals are used if "_p" is a monitored collection.
+	// Otherwise, the subtree is scanned, using the subtree specific query if it is available.
+	auto compute_data_object_count_and_size(RcComm& _conn, const irods::instance_configuration& _config, fs::path _p)
+		-> std::tuple<size_type, size_type>;
+
+	// Returns a GenQuery for "_gql". Every GenQuery issued by the plugin is created here, so that it
+	// is counted by the plugin statistics.
+	auto make_query(RcComm& _conn, const std::string& _gql) -> irods::query<RcComm>;
+
+	// Runs the specific query "_query_name" with the arguments passed and invokes "_func" with each
+	// row. Every specific query issued by the plugin is run here, so that it is counted by the plugin
+	// statistics.
+	auto for_each_specific_query_row(RcComm& _conn,
+	                                 const std::string& _query_name,
+	                                 const std::vector<std::string>& _args,
+	                                 const std::function<void(const std::vector<std::string>&)>& _func) -> void;
+
+	// Runs the specific query "_query_name" with the arguments passed and returns the last row.
+	auto execute_specific_query(RcComm& _conn, const std::string& _query_name, std::vector<std::string> _args)
+		-> std::vector<std::string>;
+
+	// Runs the specific query "_query_name" over every data object under "_p" and returns the
+	// first row.
+	auto execute_recursive_specific_query(RcComm& _conn, const std::string& _query_name, const fs::path& _p)
+		-> std::vector<std::string>;
+
+	// Returns the number of data objects and the number of bytes in the collections whose name
+	// matches the SQL LIKE pattern "_pattern", as counted by the specific queries required by the
+	// plugin. Both values are fetched with a single scan if the combined specific query is available.
+	auto count_data_objects_and_sum_sizes(RcComm& _conn, const std::string& _pattern)
+		-> std::tuple<size_type, size_type>;
+
+	// Returns the number of data objects and bytes held by "_p" and, if "_recursive" is true, by
+	// every collection under it. The subtree is selected with range predicates on the collection
+	// name, which can use an index on it and never match sibling collections sharing a prefix.
+	// Returns std::nullopt if the subtree specific query is not available.
+	auto try_count_data_objects_and_sum_sizes_in_subtree(RcComm& _conn, const fs::path& _p, bool _recursive)
+		-> std::optional<std::tuple<size_type, size_type>>;
+
+	// Like try_count_data_objects_and_sum_sizes_in_subtree(), but falls back to the LIKE based
+	// specific queries. "_p" and the collections under it are matched separately, so that sibling
+	// collections sharing a prefix are not matched.
+	auto count_data_objects_and_sum_sizes_in_subtree(RcComm& _conn, const fs::path& _p, bool _recursive)
+		-> std::tuple<size_type, size_type>;
+
+	// Like count_data_objects_and_sum_sizes(), but covers every collection at or under "_p".
+	auto count_data_objects_and_sum_sizes_recursive(RcComm& _conn, const fs::path& _p)
+		-> std::tuple<size_type, size_type>;
+
+	// Counts the data objects and bytes under "_p" for one of the recalculation operations. Uses
+	// count_data_objects_and_sum_sizes_in_chunks() if "recalculation_threads" is set.
+	auto recount_data_objects_and_sizes(RcComm& _conn, const irods::instance_configuration& _config, const fs::path& _p)
+		-> std::tuple<size_type, size_type>;
+
+	// Splits the subtree of "_p" into at most "_max_chunks" chunks plus one. Each chunk covers the
+	// subtrees of consecutive child collections of "_p". The data objects held by "_p" itself form
+	// the first chunk. The chunks are the same each time as long as the child collections of "_p"
+	// do not change.
+	auto make_recalculation_chunks(RcComm& _conn, const fs::path& _p, std::size_t _max_chunks)
+		-> std::vector<recalculation_chunk>;
+
+	// Returns the chunk covering "_collection", which must be "_p" or a collection under it, or
+	// nullptr if no chunk covers it.
+	auto find_recalculation_chunk(std::vector<recalculation_chunk>& _chunks,
+	                              const fs::path& _p,
+	                              std::string_view _collection) -> recalculation_chunk*;
+
+	// Counts the chunks which are not counted yet, concurrently using up to "recalculation_threads"
+	// connections (at least one). "_on_counted" is invoked by the thread which counted the chunk,
+	// with the connection used by that thread.
+	auto count_recalculation_chunks(const irods::instance_configuration& _config,
+	                                const fs::path& _p,
+	                                std::vector<recalculation_chunk>& _chunks,
+	                                const std::function<void(RcComm&, const recalculation_chunk&)>& _on_counted)
+		-> void;
+
+	// Counts the data objects and bytes under "_p" in chunks, so that no single query scans the
+	// whole subtree. See make_recalculation_chunks() and count_recalculation_chunks().
+	//
+	// Every completed chunk is recorded on "_p" as a checkpoint AVU. If the recalculation is
+	// interrupted, the next one skips the chunks already counted, provided the child collections
+	// of "_p" have not changed. The checkpoints are removed once all chunks are counted.
+	auto count_data_objects_and_sum_sizes_in_chunks(RcComm& _conn,
+	                                                const irods::instance_configuration& _config,
+	                                                const fs::path& _p) -> std::tuple<size_type, size_type>;
+
+	// Counts the data objects and bytes under "_p", recounting only the chunks which hold data
+	// objects modified since the previous incremental recalculation. The counts of the other chunks
+	// are taken from the watermark AVUs written by the previous incremental recalculation.
+	//
+	// The watermark records the time the previous recalculation started, the counts of each chunk
+	// and a checksum of both. If the watermark is missing, damaged or no longer matches the chunks,
+	// every chunk is recounted. The same happens if the result differs from the totals in "_info",
+	// because the changes tracked by the plugin should have kept them equal. Changes which are not
+	// visible through modification times, such as removals made while the plugin was disabled,
+	// are only found by a full recalculation.
+	//
+	// The new watermark is written before returning.
+	auto count_data_objects_and_sum_sizes_incrementally(RcComm& _conn,
+	                                                    const irods::instance_configuration& _config,
+	                                                    const fs::path& _p,
+	                                                    const quotas_info_type& _info)
+		-> std::tuple<size_type, size_type>;
+
+	// Returns the FNV-1a hash of "_data".
+	auto fnv1a_hash(std::string_view _data) noexcept -> std::uint64_t;
+
+	// Replaces both totals of "_collection" with the values passed and returns true if anything was
+	// written. The totals are read from the catalog right before they are replaced, and every AVU
+	// holding a total is removed, so that duplicate AVUs left behind by earlier writes are repaired.
+	// The totals are created if they do not exist, unless "_only_if_monitored" is true, in which case
+	// nothing is written to a collection holding neither total.
+	auto set_data_object_count_and_size(RcComm& _conn,
+	                                    const irods::instance_configuration& _config,
+	                                    const fs::path& _collection,
+	                                    size_type _data_objects,
+	                                    size_type _size_in_bytes,
+	                                    bool _only_if_monitored = false) -> bool;
+
+	// Recalculates the totals of every monitored collection at or under "_root" and returns the
+	// number of monitored collections and the number of collections whose totals changed.
+	//
+	// The number of data objects and bytes in each collection are fetched with a single grouped
+	// query and added to every monitored collection above it. If the grouped specific query is not
+	// available, each monitored collection is recalculated on its own.
+	auto recalculate_all_totals(RcComm& _conn, const irods::instance_configuration& _config, const fs::path& _root)
+		-> std::tuple<std::size_t, std::size_t>;
+
+	// Applies the metadata operations to "_collection" within a single database transaction.
+	auto apply_metadata_operations(RcComm& _conn, const fs::path& _collection, const nlohmann::json& _operations)
+		-> void;
+
+	// Adds the deltas to the totals of "_collection". If write-behind is enabled, the change is held
+	// in memory until write_pending_quota_updates() is invoked.
 	auto update_data_object_count_and_size(RcComm& _conn,
-	                                       const irods::attributes& _attrs,
-	                                       const fs::path& _collection,
-	                                       const quotas_info_type& _info,
+	                                       const irods::instance_configuration& _config,
+	                                       const monitored_collection& _collection,
 	                                       size_type _data_objects_delta,
 	                                       size_type _size_in_bytes_delta) -> void;
 
+	// Writes all changes held in memory to the catalog. If a write fails, the unwritten changes are
+	// kept and the exception is rethrown.
+	auto write_pending_quota_updates(RcComm& _conn, const irods::instance_configuration& _config) -> void;
+
+	// Applies the changes recorded in journals left behind by agents which are no longer running.
+	// Returns the number of journals replayed.
+	auto replay_orphaned_journals(RcComm& _conn, const irods::instance_configuration& _config) -> int;
+
+	// Adds the deltas to the totals of "_collection" in the catalog. Conflicts with other agents are
+	// retried up to compare_and_swap_retries times, or default_compare_and_swap_retries times if it
+	// is not set.
+	auto write_data_object_count_and_size(RcComm& _conn,
+	                                      const irods::instance_configuration& _config,
+	                                      const monitored_collection& _collection,
+	                                      size_type _data_objects_delta,
+	                                      size_type _size_in_bytes_delta) -> void;
+
+	// Sleeps for a random duration which doubles with every attempt (capped at 128ms). Invoked before
+	// retrying a conflicting change to the totals so that agents contending for the same collection
+	// do not retry in lockstep.
+	auto back_off_before_retry(std::int64_t _attempt) -> void;
+
+	// Adds the deltas to the totals of "_collection". Each total is only replaced if it still holds
+	// the value it was read with. If another agent changed it first, the totals are read again from
+	// the catalog and the change is retried, up to "_retries" times.
+	auto compare_and_swap_data_object_count_and_size(RcComm& _conn,
+	                                                 const irods::instance_configuration& _config,
+	                                                 const monitored_collection& _collection,
+	                                                 size_type _data_objects_delta,
+	                                                 size_type _size_in_bytes_delta,
+	                                                 std::int64_t _retries) -> void;
+
+	// Replaces the value of "_attr_name" on "_collection" with "_desired" if it is "_expected".
+	// Returns false if "_collection" does not hold "_expected".
+	auto compare_and_swap_total(RcComm& _conn,
+	                            const fs::path& _collection,
+	                            const std::string& _attr_name,
+	                            size_type _expected,
+	                            size_type _desired) -> bool;
+
+	// Executes a metadata operation (e.g. "add", "rm" or "mod") against "_collection" as an
+	// administrator and returns the error code. "_new_value" is only used by "mod".
+	auto modify_collection_metadata(RcComm& _conn,
+	                                const char* _operation,
+	                                const fs::path& _collection,
+	                                const std::string& _attr_name,
+	                                const std::string& _value,
+	                                const std::string& _new_value = {}) -> int;
+
+	// Sets "_attr_name" on "_collection" to "_value" as an administrator, replacing every value it
+	// held. Throws on failure.
+	auto set_collection_metadata(RcComm& _conn,
+	                             const fs::path& _collection,
+	                             const std::string& _attr_name,
+	                             const std::string& _value) -> void;
+
+	// Removes the AVU "_attr_name" with the value "_value" from "_collection" as an administrator.
+	// Throws on failure.
+	auto remove_collection_metadata(RcComm& _conn,
+	                                const fs::path& _collection,
+	                                const std::string& _attr_name,
+	                                const std::string& _value) -> void;
+
+	// Removes every counter shard of "_total" found in "_info" from "_collection".
+	auto remove_counter_shards(RcComm& _conn,
+	                           const irods::attributes& _attrs,
+	                           const fs::path& _collection,
+	                           const quotas_info_type& _info,
+	                           const std::string& _total) -> void;
+
+	// Admits a change to "_collection" against the headroom leased by the agent. If the lease cannot
+	// admit the change, more headroom is leased from the catalog. Throws if the collection does not
+	// have enough headroom left. Without leasing, the change is checked against the totals.
+	auto throw_if_headroom_cannot_be_leased(RcComm& _conn,
+	                                        const irods::instance_configuration& _config,
+	                                        const monitored_collection& _collection,
+	                                        size_type _data_objects_delta,
+	                                        size_type _size_in_bytes_delta) -> void;
+
+	// Adds headroom to the total "_total" of "_collection" so that the agent holds at least "_delta"
+	// of it, and returns the amount added. Throws if less than that is left under "_maximum".
+	auto lease_headroom(RcComm& _conn,
+	                    const irods::instance_configuration& _config,
+	                    const fs::path& _collection,
+	                    const std::string& _maximum,
+	                    const std::string& _total,
+	                    size_type _delta,
+	                    size_type _unused,
+	                    size_type _lease_size) -> size_type;
+
+	// Takes the unused headroom leased by the agent back out of the totals. Leases which cannot be
+	// returned are logged and kept.
+	auto return_headroom_leases(RcComm& _conn, const irods::instance_configuration& _config) -> void;
+
+	// Takes the unused headroom of "_lease" back out of the totals of "_collection" and removes the
+	// record of the lease. On failure, "_lease" holds the headroom which was not returned.
+	auto return_headroom_lease(RcComm& _conn,
+	                           const irods::instance_configuration& _config,
+	                           const std::string& _collection,
+	                           irods::headroom_leases::lease& _lease) -> void;
+
+	// Removes the records of the agents holding a headroom lease on "_collection". Used when the
+	// totals are replaced, which drops the headroom held by the leases. The agents then forget
+	// their lease instead of returning it.
+	auto discard_headroom_leases(RcComm& _conn,
+	                             const irods::instance_configuration& _config,
+	                             const fs::path& _collection) -> void;
+
+	// Identifies the agent in the records of headroom leases.
+	auto get_headroom_lease_holder() -> const std::string&;
+
+	// Admits a change adding "_data_objects_delta" and "_size_in_bytes_delta" to every monitored
+	// collection above "_logical_path". Unless headroom is leased, what the change adds is reserved
+	// in the shared ledger, if enabled, and checked against the totals plus the reservations of
+	// other agents. Reservations left over from a previous change are released first. Throws if
+	// any collection cannot admit the change, in which case nothing is reserved.
+	auto admit_change(RcComm& _conn,
+	                  const irods::instance_configuration& _config,
+	                  const fs::path& _logical_path,
+	                  size_type _data_objects_delta,
+	                  size_type _size_in_bytes_delta) -> void;
+
+	// Releases the reservations held by the agent, once the change they were made for is part of
+	// the totals or has failed.
+	auto release_reservations(const irods::instance_configuration& _config) noexcept -> void;
+
+	// Returns the size of the data object before it was opened for writing. The catalog is consulted
+	// first because the replica being written may not hold the size of the data object. Replicas
+	// created by the open have no prior size.
+	auto get_size_of_data_object_before_write(RcComm& _conn, const l1desc_t& _l1desc) -> size_type;
+
+	// Returns the size of the data object, or zero if the data object has no good replica.
+	auto get_size_of_data_object_or_zero(RcComm& _conn, const fs::path& _p) -> size_type;
+
+	// Applies the changes made by writing to a data object to every monitored parent collection.
+	auto update_totals_on_close(RcComm& _conn,
+	                            const irods::instance_configuration& _config,
+	                            const fs::path& _p,
+	                            size_type _data_objects_delta,
+	                            size_type _size_in_bytes_before_write) -> void;
+
+	// Recalculates the totals of every monitored parent collection. Used instead of
+	// update_totals_on_close() when the plugin is configured to do so.
+	auto recalculate_totals_on_close(const std::string& _instance_name,
+	                                 const irods::instance_configuration_map& _instance_configs,
+	                                 const fs::path& _p,
+	                                 MsParamArray* _ms_param_array,
+	                                 irods::callback& _effect_handler) -> void;
+
 	auto unset_metadata_impl(const std::string& _instance_name,
 	                         std::list<boost::any>& _rule_arguments,
 	                         irods::callback& _effect_handler,
@@ -124,10 +658,17 @@ namespace
 	template <typename T>
 	auto get_pointer(std::list<boost::any>& _rule_arguments, int _index = 2) -> T*;
 
-	// Executes a function on each parent collection monitored by the plugin.
+	// Returns "_output" to the client as a JSON string. See irods::handler::write_output().
+	auto write_json_output(const nlohmann::json& _output,
+	                       std::list<boost::any>& _rule_arguments,
+	                       MsParamArray* _ms_param_array) -> irods::error;
+
+	// Executes a function on each parent collection monitored by the plugin. The function receives
+	// the monitored_collection, which carries the collection ID along with the path and quota
+	// information. Collections are visited from the nearest parent to the root collection.
 	template <typename Function>
 	auto for_each_monitored_collection(RcComm& _conn,
-	                                   const irods::attributes& _attrs,
+	                                   const irods::instance_configuration& _config,
 	                                   fs::path _logical_path,
 	                                   Function _func) -> void;
 
@@ -154,24 +695,30 @@ namespace
 	// Function Implementations
 	//
 
-	auto get_monitored_collection_info(RcComm& _conn, const irods::attributes& _attrs, const fs::path& _p)
-		-> quotas_info_type
+	auto get_monitored_collection(RcComm& _conn, const irods::attributes& _attrs, const fs::path& _p)
+		-> monitored_collection
 	{
-		quotas_info_type info;
+		monitored_collection collection{_p};
+		auto& info = collection.info;
 
-		const auto gql = fmt::format("select META_COLL_ATTR_NAME, META_COLL_ATTR_VALUE where COLL_NAME = '{}'",
-		                             irods::single_quotes_to_hex(_p.c_str()));
+		const auto gql =
+			fmt::format("select COLL_ID, META_COLL_ATTR_NAME, META_COLL_ATTR_VALUE where COLL_NAME = '{}'",
+		                irods::single_quotes_to_hex(_p.c_str()));
 
-		for (auto&& row : irods::query{&_conn, gql}) {
-			// clang-format off
-			if      (_attrs.maximum_number_of_data_objects() == row[0]) { info[_attrs.maximum_number_of_data_objects()] = std::stoll(row[1]); }
-			else if (_attrs.maximum_size_in_bytes() == row[0])          { info[_attrs.maximum_size_in_bytes()] = std::stoll(row[1]); }
-			else if (_attrs.total_number_of_data_objects() == row[0])   { info[_attrs.total_number_of_data_objects()] = std::stoll(row[1]); }
-			else if (_attrs.total_size_in_bytes() == row[0])            { info[_attrs.total_size_in_bytes()] = std::stoll(row[1]); }
-			// clang-format on
+		for (auto&& row : make_query(_conn, gql)) {
+			collection.id = std::stoll(row[0]);
+			add_quota_attribute(_attrs, info, row[1], row[2]);
 		}
 
-		return info;
+		add_counter_shards_to_totals(_attrs, info);
+
+		return collection;
+	}
+
+	auto get_monitored_collection_info(RcComm& _conn, const irods::attributes& _attrs, const fs::path& _p)
+		-> quotas_info_type
+	{
+		return get_monitored_collection(_conn, _attrs, _p).info;
 	}
 
 	auto throw_if_maximum_number_of_data_objects_violation(const irods::attributes& _attrs,
@@ -184,6 +731,7 @@ namespace
 			const auto total = get_attribute_value<size_type>(_tracking_info, _attrs.total_number_of_data_objects());
 
 			if (total + _delta > iter->second) {
+				irods::plugin_statistics::record(event::quota_violation);
 				throw irods::logical_quotas_error{
 					"Logical Quotas Policy Violation: Adding object exceeds maximum number of objects limit",
 					SYS_NOT_ALLOWED};
@@ -201,6 +749,7 @@ namespace
 			const auto total = get_attribute_value<size_type>(_tracking_info, _attrs.total_size_in_bytes());
 
 			if (total + _delta > iter->second) {
+				irods::plugin_statistics::record(event::quota_violation);
 				throw irods::logical_quotas_error{
 					"Logical Quotas Policy Violation: Adding object exceeds maximum data size in bytes limit",
 					SYS_NOT_ALLOWED};
@@ -208,76 +757,1943 @@ namespace
 		}
 	}
 
-	auto is_monitored_collection(RcComm& _conn, const irods::attributes& _attrs, const fs::path& _p) -> bool
+	auto holds_totals(const irods::attributes& _attrs, const quotas_info_type& _info) -> bool
 	{
-		const auto gql =
-			fmt::format("select META_COLL_ATTR_NAME where COLL_NAME = '{}' and META_COLL_ATTR_NAME = '{}' || = '{}'",
-		                irods::single_quotes_to_hex(_p.c_str()),
-		                _attrs.total_number_of_data_objects(),
-		                _attrs.total_size_in_bytes());
+		return _info.count(_attrs.total_number_of_data_objects()) > 0 || _info.count(_attrs.total_size_in_bytes()) > 0;
+	}
+
+	auto add_quota_attribute(const irods::attributes& _attrs,
+	                         quotas_info_type& _info,
+	                         const std::string& _attr_name,
+	                         const std::string& _value) -> void
+	{
+		// A total held by more than one AVU is never summed. Its value is that of one of the AVUs, so
+		// that it can be replaced by a conditional modification and repaired by a recalculation.
+		if (_attrs.total_of_counter_shard(_attr_name) || _attrs.total_number_of_data_objects() == _attr_name ||
+		    _attrs.total_size_in_bytes() == _attr_name || _attrs.maximum_number_of_data_objects() == _attr_name ||
+		    _attrs.maximum_size_in_bytes() == _attr_name)
+		{
+			_info[_attr_name] = std::stoll(_value);
+		}
+	}
 
-		for (auto&& row : irods::query{&_conn, gql}) {
-			return true;
+	auto add_counter_shards_to_totals(const irods::attributes& _attrs, quotas_info_type& _info) -> void
+	{
+		std::vector<std::pair<const std::string*, size_type>> shard_values;
+
+		for (auto&& [attr_name, value] : _info) {
+			if (const auto* total = _attrs.total_of_counter_shard(attr_name); total) {
+				shard_values.emplace_back(total, value);
+			}
 		}
 
-		return false;
+		for (auto&& [total, value] : shard_values) {
+			_info[*total] += value;
+		}
+	}
+
+	auto make_quota_attribute_condition(const irods::attributes& _attrs) -> std::string
+	{
+		return fmt::format("in ('{}', '{}', '{}', '{}') || like '{}' || like '{}'",
+		                   _attrs.maximum_number_of_data_objects(),
+		                   _attrs.maximum_size_in_bytes(),
+		                   _attrs.total_number_of_data_objects(),
+		                   _attrs.total_size_in_bytes(),
+		                   _attrs.counter_shard_pattern(_attrs.total_number_of_data_objects()),
+		                   _attrs.counter_shard_pattern(_attrs.total_size_in_bytes()));
+	}
+
+	auto get_stored_value(const irods::attributes& _attrs, const quotas_info_type& _info, const std::string& _attr_name)
+		-> size_type
+	{
+		auto value = get_attribute_value<size_type>(_info, _attr_name);
+
+		for (auto&& [attr_name, shard_value] : _info) {
+			if (const auto* total = _attrs.total_of_counter_shard(attr_name); total && *total == _attr_name) {
+				value -= shard_value;
+			}
+		}
+
+		return value;
+	}
+
+	auto get_quota_information_for_subtree(RcComm& _conn, const irods::attributes& _attrs, const fs::path& _root)
+		-> std::map<std::string, quotas_info_type>
+	{
+		const auto root = irods::single_quotes_to_hex(_root.string());
+		const auto pattern = (_root.string() == "/") ? std::string{"/%"} : root + "/%";
+
+		const auto gql = fmt::format("select COLL_NAME, META_COLL_ATTR_NAME, META_COLL_ATTR_VALUE "
+		                             "where COLL_NAME = '{}' || like '{}' and META_COLL_ATTR_NAME {}",
+		                             root,
+		                             pattern,
+		                             make_quota_attribute_condition(_attrs));
+
+		std::map<std::string, quotas_info_type> info_by_path;
+
+		for (auto&& row : make_query(_conn, gql)) {
+			add_quota_attribute(_attrs, info_by_path[row[0]], row[1], row[2]);
+		}
+
+		for (auto&& [path, info] : info_by_path) {
+			add_counter_shards_to_totals(_attrs, info);
+		}
+
+		// The pattern treats "_" and "%" in "_root" as wildcards, so collections outside of the
+		// subtree may have been matched.
+		parent_path parent{_root};
+
+		for (auto iter = std::begin(info_by_path); iter != std::end(info_by_path);) {
+			if (!holds_totals(_attrs, iter->second) || (iter->first != _root.string() && !parent.of(iter->first))) {
+				iter = info_by_path.erase(iter);
+			}
+			else {
+				++iter;
+			}
+		}
+
+		return info_by_path;
+	}
+
+	auto make_collection_status(const irods::attributes& _attrs, const quotas_info_type& _info) -> nlohmann::json
+	{
+		auto status = nlohmann::json::object();
+
+		for (const auto* attr_name : {&_attrs.maximum_number_of_data_objects(),
+		                              &_attrs.maximum_size_in_bytes(),
+		                              &_attrs.total_number_of_data_objects(),
+		                              &_attrs.total_size_in_bytes()})
+		{
+			const auto iter = _info.find(*attr_name);
+			status[*attr_name] = (iter != std::end(_info)) ? std::to_string(iter->second) : std::string{};
+		}
+
+		return status;
 	}
 
-	auto get_monitored_parent_collection(RcComm& _conn, const irods::attributes& _attrs, fs::path _p)
+	auto get_monitored_parent_collection(RcComm& _conn, const irods::instance_configuration& _config, fs::path _p)
 		-> std::optional<fs::path>
 	{
+		if (auto collections = get_monitored_collections(_conn, _config, std::move(_p)); !collections.empty()) {
+			return std::move(collections.front().path);
+		}
+
+		return std::nullopt;
+	}
+
+	auto may_be_monitored(const irods::instance_configuration& _config, fs::path _p) -> bool
+	{
+		auto& cache = _config.cache();
+		std::vector<std::string> uncached;
+
+		for (; !_p.empty(); _p = _p.parent_path()) {
+			if (const auto value = cache.find(_p.string()); !value) {
+				uncached.push_back(_p.string());
+			}
+			else if (*value) {
+				return true;
+			}
+
+			if ("/" == _p) {
+				break;
+			}
+		}
+
+		if (uncached.empty()) {
+			return false;
+		}
+
+		if (const auto* index = _config.index(); index && index->usable()) {
+			if (const auto result = index->lookup(uncached); result) {
+				return std::any_of(
+					std::begin(*result), std::end(*result), [](const auto& _match) { return _match.has_value(); });
+			}
+		}
+
+		return true;
+	}
+
+	auto get_monitored_collections(RcComm& _conn, const irods::instance_configuration& _config, fs::path _p)
+		-> monitored_collection_list
+	{
+		const auto& attrs = _config.attributes();
+		auto& cache = _config.cache();
+
+		std::vector<fs::path> ancestors;
+		std::unordered_map<std::string, irods::monitored_collection_cache::value_type> cached;
+		std::vector<std::string> uncached;
+
 		for (; !_p.empty(); _p = _p.parent_path()) {
-			if (is_monitored_collection(_conn, _attrs, _p)) {
-				return _p;
+			ancestors.push_back(_p);
+
+			if (auto value = cache.find(_p.string()); value) {
+				cached.insert_or_assign(_p.string(), std::move(*value));
 			}
-			else if ("/" == _p) {
+			else {
+				uncached.push_back(_p.string());
+			}
+
+			if ("/" == _p) {
 				break;
 			}
 		}
 
-		return std::nullopt;
+		// Maps the uncached ancestors which are monitored to their collection ID.
+		std::unordered_map<std::string, std::int64_t> ids_by_path;
+
+		// The shared table tells us which of the uncached ancestors are monitored, along with their
+		// collection IDs. Only those need to be fetched from the catalog, by ID. If the quota
+		// information of a collection is cached under its ID (e.g. the collection was renamed),
+		// nothing needs to be fetched.
+		if (auto* index = _config.index(); index && !uncached.empty()) {
+			if (!index->usable()) {
+				index->try_reload([&_conn, &attrs] { return get_all_monitored_collections(_conn, attrs); });
+			}
+
+			if (const auto result = index->lookup(uncached); result) {
+				for (std::size_t i = 0; i < uncached.size(); ++i) {
+					if (!(*result)[i]) {
+						cached.insert_or_assign(uncached[i], std::nullopt);
+						cache.insert(uncached[i], std::nullopt);
+					}
+					else if (const auto id = (*result)[i]->collection_id; const auto* info = cache.find(id)) {
+						irods::monitored_collection_cache::collection c{id, *info};
+						cache.insert(uncached[i], c);
+						cached.insert_or_assign(uncached[i], std::move(c));
+					}
+					else {
+						ids_by_path.insert_or_assign(uncached[i], id);
+					}
+				}
+
+				uncached.clear();
+			}
+		}
+
+		std::unordered_map<std::string, monitored_collection> collections_by_path;
+
+		if (!ids_by_path.empty()) {
+			std::unordered_map<std::int64_t, const std::string*> paths_by_id;
+			std::string coll_ids;
+
+			for (auto&& [p, id] : ids_by_path) {
+				if (!coll_ids.empty()) {
+					coll_ids += ", ";
+				}
+
+				coll_ids += fmt::format("'{}'", id);
+				paths_by_id.insert_or_assign(id, &p);
+			}
+
+			const auto gql = fmt::format("select COLL_ID, META_COLL_ATTR_NAME, META_COLL_ATTR_VALUE "
+			                             "where COLL_ID in ({}) and META_COLL_ATTR_NAME {}",
+			                             coll_ids,
+			                             make_quota_attribute_condition(attrs));
+
+			for (auto&& row : make_query(_conn, gql)) {
+				const auto id = std::stoll(row[0]);
+
+				if (const auto iter = paths_by_id.find(id); iter != std::end(paths_by_id)) {
+					auto& c = collections_by_path[*iter->second];
+					c.id = id;
+					add_quota_attribute(attrs, c.info, row[1], row[2]);
+				}
+			}
+		}
+
+		// Without the shared table, the uncached ancestors are resolved by name.
+		if (!uncached.empty()) {
+			std::string coll_names;
+
+			for (auto&& p : uncached) {
+				if (!coll_names.empty()) {
+					coll_names += ", ";
+				}
+
+				coll_names += fmt::format("'{}'", irods::single_quotes_to_hex(p));
+			}
+
+			const auto gql = fmt::format("select COLL_NAME, COLL_ID, META_COLL_ATTR_NAME, META_COLL_ATTR_VALUE "
+			                             "where COLL_NAME in ({}) and META_COLL_ATTR_NAME {}",
+			                             coll_names,
+			                             make_quota_attribute_condition(attrs));
+
+			for (auto&& row : make_query(_conn, gql)) {
+				auto& c = collections_by_path[row[0]];
+				c.id = std::stoll(row[1]);
+				add_quota_attribute(attrs, c.info, row[2], row[3]);
+			}
+		}
+
+		for (auto&& [path, c] : collections_by_path) {
+			add_counter_shards_to_totals(attrs, c.info);
+		}
+
+		monitored_collection_list collections;
+
+		for (auto&& p : ancestors) {
+			if (const auto iter = cached.find(p.string()); iter != std::end(cached)) {
+				if (iter->second) {
+					collections.push_back({p, iter->second->id, std::move(iter->second->info)});
+				}
+
+				continue;
+			}
+
+			// Only collections holding tracking information are considered monitored.
+			const auto iter = collections_by_path.find(p.string());
+
+			if (iter == std::end(collections_by_path) || !holds_totals(attrs, iter->second.info)) {
+				cache.insert(p.string(), std::nullopt);
+				continue;
+			}
+
+			auto& c = iter->second;
+			cache.insert(p.string(), irods::monitored_collection_cache::collection{c.id, c.info});
+			collections.push_back({p, c.id, std::move(c.info)});
+		}
+
+		// Changes which have not been written to the catalog yet must be taken into account when
+		// enforcing quotas.
+		if (const auto& pending_updates = _config.pending_updates(); !pending_updates.empty()) {
+			for (auto&& collection : collections) {
+				const auto delta = pending_updates.find(collection.path.string());
+
+				if (const auto iter = collection.info.find(attrs.total_number_of_data_objects());
+				    iter != std::end(collection.info)) {
+					iter->second += delta.data_objects;
+				}
+
+				if (const auto iter = collection.info.find(attrs.total_size_in_bytes());
+				    iter != std::end(collection.info)) {
+					iter->second += delta.size_in_bytes;
+				}
+			}
+		}
+
+		// Headroom leased by the agent is part of the totals, but has not been used yet.
+		if (const auto& leases = _config.headroom_leases(); !leases.empty()) {
+			for (auto&& collection : collections) {
+				const auto lease = leases.find(collection.path.string());
+
+				if (const auto iter = collection.info.find(attrs.total_number_of_data_objects());
+				    iter != std::end(collection.info)) {
+					iter->second -= lease.data_objects;
+				}
+
+				if (const auto iter = collection.info.find(attrs.total_size_in_bytes());
+				    iter != std::end(collection.info)) {
+					iter->second -= lease.size_in_bytes;
+				}
+			}
+		}
+
+		return collections;
+	}
+
+	auto get_quota_information_for_all_monitored_collections(RcComm& _conn, const irods::attributes& _attrs)
+		-> std::unordered_map<std::string, monitored_collection>
+	{
+		const auto gql = fmt::format("select COLL_NAME, COLL_ID, META_COLL_ATTR_NAME, META_COLL_ATTR_VALUE "
+		                             "where META_COLL_ATTR_NAME {}",
+		                             make_quota_attribute_condition(_attrs));
+
+		std::unordered_map<std::string, monitored_collection> collections_by_path;
+
+		for (auto&& row : make_query(_conn, gql)) {
+			auto& c = collections_by_path[row[0]];
+
+			if (c.path.empty()) {
+				c.path = row[0];
+				c.id = std::stoll(row[1]);
+			}
+
+			add_quota_attribute(_attrs, c.info, row[2], row[3]);
+		}
+
+		for (auto&& [path, c] : collections_by_path) {
+			add_counter_shards_to_totals(_attrs, c.info);
+		}
+
+		// Only collections having a total are monitored.
+		for (auto iter = std::begin(collections_by_path); iter != std::end(collections_by_path);) {
+			if (!holds_totals(_attrs, iter->second.info)) {
+				iter = collections_by_path.erase(iter);
+			}
+			else {
+				++iter;
+			}
+		}
+
+		return collections_by_path;
+	}
+
+	auto get_all_monitored_collections(RcComm& _conn, const irods::attributes& _attrs)
+		-> std::vector<irods::monitored_collection_index::entry>
+	{
+		std::vector<irods::monitored_collection_index::entry> entries;
+
+		for (auto&& [path, collection] : get_quota_information_for_all_monitored_collections(_conn, _attrs)) {
+			const auto& info = collection.info;
+			irods::monitored_collection_index::entry e{path, {collection.id, {}}};
+
+			if (const auto iter = info.find(_attrs.maximum_number_of_data_objects()); iter != std::end(info)) {
+				e.value.limits.maximum_number_of_data_objects = iter->second;
+			}
+
+			if (const auto iter = info.find(_attrs.maximum_size_in_bytes()); iter != std::end(info)) {
+				e.value.limits.maximum_size_in_bytes = iter->second;
+			}
+
+			entries.push_back(std::move(e));
+		}
+
+		return entries;
+	}
+
+	auto invalidate_cached_information(const irods::instance_configuration& _config, const std::string& _path) -> void
+	{
+		_config.cache().erase(_path);
+
+		if (auto* index = _config.index(); index) {
+			index->invalidate();
+		}
+	}
+
+	auto invalidate_cached_information_for_tree(const irods::instance_configuration& _config, const std::string& _path)
+		-> void
+	{
+		_config.cache().erase_tree(_path);
+
+		if (auto* index = _config.index(); index && index->contains_tree(_path)) {
+			index->invalidate();
+		}
+	}
+
+	auto invalidate_cached_paths_for_tree(const irods::instance_configuration& _config, const std::string& _path)
+		-> void
+	{
+		_config.cache().erase_paths_in_tree(_path);
+
+		if (auto* index = _config.index(); index && index->contains_tree(_path)) {
+			index->invalidate();
+		}
+	}
+
+	auto get_trusted_data_object_count_and_size(RcComm& _conn,
+	                                            const irods::instance_configuration& _config,
+	                                            const fs::path& _p) -> std::optional<std::tuple<size_type, size_type>>
+	{
+		// With write-behind enabled, other agents may hold changes to the totals which have not been
+		// written to the catalog yet. Moving the stored totals elsewhere would make that drift permanent.
+		if (_config.pending_updates().enabled()) {
+			return std::nullopt;
+		}
+
+		// Likewise, the totals include headroom which agents have leased but not used yet. Moving them
+		// elsewhere would carry that headroom along as if it were data.
+		if (_config.headroom_leases().enabled()) {
+			return std::nullopt;
+		}
+
+		// The shared table answers whether "_p" is monitored without touching the catalog.
+		if (const auto* index = _config.index(); index && index->usable()) {
+			if (const auto result = index->lookup({_p.string()}); result && !result->front()) {
+				return std::nullopt;
+			}
+		}
+
+		const auto& attrs = _config.attributes();
+		const auto info = get_monitored_collection_info(_conn, attrs, _p);
+
+		const auto objects = info.find(attrs.total_number_of_data_objects());
+		const auto bytes = info.find(attrs.total_size_in_bytes());
+
+		// Both totals must be present. Negative totals are the result of drift and are not trusted.
+		if (objects == std::end(info) || bytes == std::end(info) || objects->second < 0 || bytes->second < 0) {
+			return std::nullopt;
+		}
+
+		return std::make_tuple(objects->second, bytes->second);
+	}
+
+	auto compute_data_object_count_and_size(RcComm& _conn, const irods::instance_configuration& _config, fs::path _p)
+		-> std::tuple<size_type, size_type>
+	{
+		if (auto totals = get_trusted_data_object_count_and_size(_conn, _config, _p); totals) {
+			return *totals;
+		}
+
+		if (auto result = try_count_data_objects_and_sum_sizes_in_subtree(_conn, _p, true); result) {
+			return *result;
+		}
+
+		size_type objects = 0;
+		size_type bytes = 0;
+
+		const auto gql = fmt::format("select count(DATA_NAME), sum(DATA_SIZE) where COLL_NAME = '{0}' || like '{0}/%'",
+		                             irods::single_quotes_to_hex(_p.c_str()));
+
+		for (auto&& row : make_query(_conn, gql)) {
+			objects = !row[0].empty() ? std::stoll(row[0]) : 0;
+			bytes = !row[1].empty() ? std::stoll(row[1]) : 0;
+		}
+
+		return {objects, bytes};
+	}
+
+	auto update_data_object_count_and_size(RcComm& _conn,
+	                                       const irods::instance_configuration& _config,
+	                                       const monitored_collection& _collection,
+	                                       size_type _data_objects_delta,
+	                                       size_type _size_in_bytes_delta) -> void
+	{
+		// Changes admitted against a headroom lease are already part of the totals.
+		if (auto& leases = _config.headroom_leases(); !leases.empty()) {
+			const auto used = leases.consume(_collection.path.string(), _data_objects_delta, _size_in_bytes_delta);
+			_data_objects_delta -= used.data_objects;
+			_size_in_bytes_delta -= used.size_in_bytes;
+		}
+
+		auto& pending_updates = _config.pending_updates();
+
+		if (!pending_updates.enabled()) {
+			write_data_object_count_and_size(_conn, _config, _collection, _data_objects_delta, _size_in_bytes_delta);
+			return;
+		}
+
+		if (0 == _data_objects_delta && 0 == _size_in_bytes_delta) {
+			return;
+		}
+
+		const auto path = _collection.path.string();
+
+		// The change must be recorded in the journal before it is held in memory. If the journal
+		// is full, everything held in memory is written to the catalog, which empties the journal.
+		if (auto* journal = _config.journal(); journal) {
+			if (!orphaned_journals_replayed) {
+				orphaned_journals_replayed = true;
+
+				// A failure to replay must not fail the operation being tracked. The journals can be
+				// replayed later via logical_quotas_replay_journal.
+				try {
+					replay_orphaned_journals(_conn, _config);
+				}
+				catch (const std::exception& e) {
+					log::rule_engine::error(
+						fmt::format("Logical Quotas Policy: Failed to replay orphaned journals [{}]", e.what()));
+				}
+			}
+
+			if (!journal->append(path, _data_objects_delta, _size_in_bytes_delta)) {
+				write_pending_quota_updates(_conn, _config);
+
+				if (!journal->append(path, _data_objects_delta, _size_in_bytes_delta)) {
+					write_data_object_count_and_size(_conn,
+					                                 _config,
+					                                 get_monitored_collection(_conn, _config.attributes(), path),
+					                                 _data_objects_delta,
+					                                 _size_in_bytes_delta);
+					return;
+				}
+			}
+		}
+
+		pending_updates.add(path, _data_objects_delta, _size_in_bytes_delta);
+
+		if (pending_updates.should_flush()) {
+			write_pending_quota_updates(_conn, _config);
+		}
+	}
+
+	auto write_pending_quota_updates(RcComm& _conn, const irods::instance_configuration& _config) -> void
+	{
+		auto& pending_updates = _config.pending_updates();
+
+		if (pending_updates.empty()) {
+			return;
+		}
+
+		const auto& attrs = _config.attributes();
+		auto* journal = _config.journal();
+		auto updates = pending_updates.take();
+
+		try {
+			for (auto iter = std::begin(updates); iter != std::end(updates); iter = updates.erase(iter)) {
+				const auto& [path, delta] = *iter;
+
+				// The totals are read from the catalog rather than the cache because the values are
+				// needed to replace the existing metadata.
+				const auto collection = get_monitored_collection(_conn, attrs, path);
+				write_data_object_count_and_size(_conn, _config, collection, delta.data_objects, delta.size_in_bytes);
+
+				// Marked right away so that a replay never applies the change again, even if this agent
+				// dies before the remaining collections are written.
+				if (journal) {
+					journal->mark_applied(path);
+				}
+			}
+		}
+		catch (...) {
+			// Keep the unwritten changes so that they are written on the next attempt. Their records
+			// are still in the journal.
+			for (auto&& [path, delta] : updates) {
+				pending_updates.add(path, delta.data_objects, delta.size_in_bytes);
+			}
+
+			throw;
+		}
+
+		if (journal) {
+			journal->reset();
+		}
+	}
+
+	auto replay_orphaned_journals(RcComm& _conn, const irods::instance_configuration& _config) -> int
+	{
+		auto* journal = _config.journal();
+
+		if (!journal) {
+			return 0;
+		}
+
+		const auto& attrs = _config.attributes();
+
+		return journal->replay([&](const std::string& _path, std::int64_t _data_objects, std::int64_t _size_in_bytes) {
+			log::rule_engine::info(fmt::format("Logical Quotas Policy: Replaying journaled changes for [{}] "
+			                                   "[data_objects={}, size_in_bytes={}]",
+			                                   _path,
+			                                   _data_objects,
+			                                   _size_in_bytes));
+
+			const auto collection = get_monitored_collection(_conn, attrs, _path);
+			write_data_object_count_and_size(_conn, _config, collection, _data_objects, _size_in_bytes);
+		});
+	}
+
+	auto write_data_object_count_and_size(RcComm& _conn,
+	                                      const irods::instance_configuration& _config,
+	                                      const monitored_collection& _collection,
+	                                      size_type _data_objects_delta,
+	                                      size_type _size_in_bytes_delta) -> void
+	{
+		// The totals are never replaced unconditionally. The values in "_collection" may come from the
+		// agent's cache or have been changed by another agent since they were read. Removing such a
+		// value would do nothing, and adding the new one would leave a second AVU for the total.
+		const auto retries = _config.options().compare_and_swap_retries > 0
+		                         ? _config.options().compare_and_swap_retries
+		                         : default_compare_and_swap_retries;
+
+		compare_and_swap_data_object_count_and_size(
+			_conn, _config, _collection, _data_objects_delta, _size_in_bytes_delta, retries);
+	}
+
+	auto back_off_before_retry(std::int64_t _attempt) -> void
+	{
+		thread_local std::mt19937 rng{std::random_device{}()};
+
+		const auto max_delay = std::int64_t{1} << std::clamp<std::int64_t>(_attempt, 0, 7);
+		std::this_thread::sleep_for(
+			std::chrono::milliseconds{std::uniform_int_distribution<std::int64_t>{1, max_delay}(rng)});
+	}
+
+	auto compare_and_swap_data_object_count_and_size(RcComm& _conn,
+	                                                 const irods::instance_configuration& _config,
+	                                                 const monitored_collection& _collection,
+	                                                 size_type _data_objects_delta,
+	                                                 size_type _size_in_bytes_delta,
+	                                                 std::int64_t _retries) -> void
+	{
+		const auto& attrs = _config.attributes();
+		const auto shards = _config.options().counter_shards;
+
+		// The totals which still need to be changed. Each total is swapped on its own, so a conflict
+		// on one does not undo the change to the other.
+		std::vector<std::pair<const std::string*, size_type>> deltas;
+
+		if (0 != _data_objects_delta) {
+			deltas.emplace_back(&attrs.total_number_of_data_objects(), _data_objects_delta);
+		}
+
+		if (0 != _size_in_bytes_delta) {
+			deltas.emplace_back(&attrs.total_size_in_bytes(), _size_in_bytes_delta);
+		}
+
+		auto info = _collection.info;
+
+		for (std::int64_t attempt = 0;; ++attempt) {
+			for (auto iter = std::begin(deltas); iter != std::end(deltas);) {
+				const auto& [attr_name, delta] = *iter;
+
+				// Totals which are not set are left alone.
+				const auto value = info.find(*attr_name);
+
+				if (value == std::end(info)) {
+					iter = deltas.erase(iter);
+					continue;
+				}
+
+				const auto total = value->second;
+
+				// With counter shards, the change is applied to the shard selected by the process ID.
+				// Every retry moves on to the next shard so that a busy shard does not hold the agent up.
+				auto target = *attr_name;
+				size_type expected{};
+
+				if (shards > 0) {
+					target = attrs.counter_shard(*attr_name, (getpid() + attempt) % shards);
+
+					if (const auto shard = info.find(target); shard != std::end(info)) {
+						expected = shard->second;
+					}
+					else {
+						// New shards hold zero so that agents creating the same shard at once create
+						// the same AVU. The catalog rejects all but the first of them.
+						const auto ec = modify_collection_metadata(_conn, "add", _collection.path, target, "0");
+
+						if (ec < 0 && CATALOG_ALREADY_HAS_ITEM_BY_THAT_NAME != ec) {
+							THROW(ec,
+							      fmt::format("Logical Quotas Policy: Failed to add [{}] to collection [{}]",
+							                  target,
+							                  _collection.path.string()));
+						}
+
+						info[target] = 0;
+					}
+				}
+				else {
+					expected = get_stored_value(attrs, info, *attr_name);
+				}
+
+				if (compare_and_swap_total(_conn, _collection.path, target, expected, expected + delta)) {
+					if (shards > 0) {
+						_config.cache().update(_collection.id, target, expected + delta);
+					}
+
+					_config.cache().update(_collection.id, *attr_name, total + delta);
+					iter = deltas.erase(iter);
+				}
+				else {
+					++iter;
+				}
+			}
+
+			if (deltas.empty()) {
+				return;
+			}
+
+			if (attempt == _retries) {
+				THROW(SYS_INTERNAL_ERR,
+				      fmt::format("Logical Quotas Policy: Failed to update totals for collection [{}] after [{}] "
+				                  "attempts. The totals were changed concurrently.",
+				                  _collection.path.string(),
+				                  attempt + 1));
+			}
+
+			back_off_before_retry(attempt);
+
+			// The values in the cache may be what caused the conflict.
+			info = get_monitored_collection_info(_conn, attrs, _collection.path);
+		}
+	}
+
+	auto compare_and_swap_total(RcComm& _conn,
+	                            const fs::path& _collection,
+	                            const std::string& _attr_name,
+	                            size_type _expected,
+	                            size_type _desired) -> bool
+	{
+		// A "mod" removes the existing AVU and adds the new one within a single database transaction.
+		// The transaction fails if the existing AVU is not found, which makes it a compare-and-swap.
+		const auto ec = modify_collection_metadata(
+			_conn, "mod", _collection, _attr_name, std::to_string(_expected), fmt::format("v:{}", _desired));
+
+		if (CAT_SUCCESS_BUT_WITH_NO_INFO == ec) {
+			return false;
+		}
+
+		if (ec < 0) {
+			THROW(ec,
+			      fmt::format("Logical Quotas Policy: Failed to update [{}] for collection [{}]",
+			                  _attr_name,
+			                  _collection.string()));
+		}
+
+		return true;
+	}
+
+	auto modify_collection_metadata(RcComm& _conn,
+	                                const char* _operation,
+	                                const fs::path& _collection,
+	                                const std::string& _attr_name,
+	                                const std::string& _value,
+	                                const std::string& _new_value) -> int
+	{
+		char empty[] = "";
+
+		modAVUMetadataInp_t input{};
+		input.arg0 = const_cast<char*>(_operation);
+		input.arg1 = const_cast<char*>("-C");
+		input.arg2 = const_cast<char*>(_collection.c_str());
+		input.arg3 = const_cast<char*>(_attr_name.c_str());
+		input.arg4 = const_cast<char*>(_value.c_str());
+		input.arg5 = const_cast<char*>(_new_value.c_str());
+		input.arg6 = empty;
+		input.arg7 = empty;
+		input.arg8 = empty;
+		input.arg9 = empty;
+		addKeyVal(&input.condInput, ADMIN_KW, "");
+
+		irods::plugin_statistics::record(event::metadata_write);
+		const auto ec = rcModAVUMetadata(&_conn, &input);
+		clearKeyVal(&input.condInput);
+
+		return ec;
+	}
+
+	auto set_collection_metadata(RcComm& _conn,
+	                             const fs::path& _collection,
+	                             const std::string& _attr_name,
+	                             const std::string& _value) -> void
+	{
+		if (const auto ec = modify_collection_metadata(_conn, "set", _collection, _attr_name, _value); ec < 0) {
+			THROW(ec,
+			      fmt::format("Logical Quotas Policy: Failed to set metadata [{}] on collection [{}]",
+			                  _attr_name,
+			                  _collection.string()));
+		}
+	}
+
+	auto remove_collection_metadata(RcComm& _conn,
+	                                const fs::path& _collection,
+	                                const std::string& _attr_name,
+	                                const std::string& _value) -> void
+	{
+		if (const auto ec = modify_collection_metadata(_conn, "rm", _collection, _attr_name, _value); ec < 0) {
+			THROW(ec,
+			      fmt::format("Logical Quotas Policy: Failed to remove metadata [{}] from collection [{}]",
+			                  _attr_name,
+			                  _collection.string()));
+		}
+	}
+
+	auto remove_counter_shards(RcComm& _conn,
+	                           const irods::attributes& _attrs,
+	                           const fs::path& _collection,
+	                           const quotas_info_type& _info,
+	                           const std::string& _total) -> void
+	{
+		for (auto&& [attr_name, value] : _info) {
+			if (const auto* total = _attrs.total_of_counter_shard(attr_name); !total || *total != _total) {
+				continue;
+			}
+
+			// A shard may hold more than one value, so every value is removed.
+			if (const auto ec = modify_collection_metadata(_conn, "rmw", _collection, attr_name, "%");
+			    ec < 0 && CAT_SUCCESS_BUT_WITH_NO_INFO != ec) {
+				THROW(ec,
+				      fmt::format("Logical Quotas Policy: Failed to remove [{}] from collection [{}]",
+				                  attr_name,
+				                  _collection.string()));
+			}
+		}
+	}
+
+	auto throw_if_headroom_cannot_be_leased(RcComm& _conn,
+	                                        const irods::instance_configuration& _config,
+	                                        const monitored_collection& _collection,
+	                                        size_type _data_objects_delta,
+	                                        size_type _size_in_bytes_delta) -> void
+	{
+		const auto& attrs = _config.attributes();
+		const auto& info = _collection.info;
+		auto& leases = _config.headroom_leases();
+
+		if (!leases.enabled()) {
+			throw_if_maximum_number_of_data_objects_violation(attrs, info, _data_objects_delta);
+			throw_if_maximum_size_in_bytes_violation(attrs, info, _size_in_bytes_delta);
+			return;
+		}
+
+		const auto path = _collection.path.string();
+
+		// Only quantities which have a limit need headroom.
+		const auto needs_headroom = [&](const std::string& _maximum, size_type _delta, size_type _unused) {
+			return _delta > _unused && info.count(_maximum) > 0;
+		};
+
+		const auto needs_data_objects = [&] {
+			return needs_headroom(
+				attrs.maximum_number_of_data_objects(), _data_objects_delta, leases.find(path).data_objects);
+		};
+
+		const auto needs_bytes = [&] {
+			return needs_headroom(attrs.maximum_size_in_bytes(), _size_in_bytes_delta, leases.find(path).size_in_bytes);
+		};
+
+		if (!needs_data_objects() && !needs_bytes()) {
+			return;
+		}
+
+		// The record tells recalculations that the totals hold headroom leased by this agent. If it
+		// is missing although the agent holds a lease, the totals were replaced since and no longer
+		// hold the headroom, so the lease is forgotten.
+		const auto& holder = get_headroom_lease_holder();
+		const auto ec = modify_collection_metadata(_conn, "add", _collection.path, attrs.headroom_lease(), holder);
+
+		if (CATALOG_ALREADY_HAS_ITEM_BY_THAT_NAME != ec) {
+			if (ec < 0) {
+				THROW(ec,
+				      fmt::format("Logical Quotas Policy: Failed to record headroom lease on collection [{}]", path));
+			}
+
+			leases.discard(path);
+		}
+
+		const auto& lease_size = _config.options().headroom_lease;
+
+		try {
+			if (needs_data_objects()) {
+				leases.add(path,
+				           lease_headroom(_conn,
+				                          _config,
+				                          path,
+				                          attrs.maximum_number_of_data_objects(),
+				                          attrs.total_number_of_data_objects(),
+				                          _data_objects_delta,
+				                          leases.find(path).data_objects,
+				                          lease_size.data_objects),
+				           0);
+			}
+
+			if (needs_bytes()) {
+				leases.add(path,
+				           0,
+				           lease_headroom(_conn,
+				                          _config,
+				                          path,
+				                          attrs.maximum_size_in_bytes(),
+				                          attrs.total_size_in_bytes(),
+				                          _size_in_bytes_delta,
+				                          leases.find(path).size_in_bytes,
+				                          lease_size.size_in_bytes));
+			}
+		}
+		catch (...) {
+			// Without a lease, the record would make recalculations treat the totals as holding
+			// headroom which was never added to them.
+			if (!leases.contains(path)) {
+				modify_collection_metadata(_conn, "rm", _collection.path, attrs.headroom_lease(), holder);
+			}
+
+			throw;
+		}
+
+		// The cached totals do not hold the headroom leased.
+		_config.cache().erase(path);
+	}
+
+	auto lease_headroom(RcComm& _conn,
+	                    const irods::instance_configuration& _config,
+	                    const fs::path& _collection,
+	                    const std::string& _maximum,
+	                    const std::string& _total,
+	                    size_type _delta,
+	                    size_type _unused,
+	                    size_type _lease_size) -> size_type
+	{
+		const auto& attrs = _config.attributes();
+		const auto retries = _config.options().compare_and_swap_retries;
+
+		for (std::int64_t attempt = 0;; ++attempt) {
+			auto info = get_monitored_collection_info(_conn, attrs, _collection);
+
+			// The limit or the total may have been removed since the collection was read.
+			if (info.count(_maximum) == 0 || info.count(_total) == 0) {
+				return 0;
+			}
+
+			// Lease at least what the change needs, but no more than the headroom left. The totals
+			// already hold the unused headroom of the agent.
+			const auto needed = _delta - _unused;
+			const auto headroom = info[_maximum] - info[_total];
+			const auto amount = std::min(std::max(_lease_size, needed), headroom);
+
+			if (amount < needed) {
+				info[_total] -= _unused;
+
+				if (attrs.maximum_number_of_data_objects() == _maximum) {
+					throw_if_maximum_number_of_data_objects_violation(attrs, info, _delta);
+				}
+				else {
+					throw_if_maximum_size_in_bytes_violation(attrs, info, _delta);
+				}
+			}
+
+			if (const auto value = get_stored_value(attrs, info, _total);
+			    compare_and_swap_total(_conn, _collection, _total, value, value + amount))
+			{
+				return amount;
+			}
+
+			if (attempt == retries) {
+				THROW(SYS_INTERNAL_ERR,
+				      fmt::format("Logical Quotas Policy: Failed to lease headroom from collection [{}] after [{}] "
+				                  "attempts. The totals were changed concurrently.",
+				                  _collection.string(),
+				                  attempt + 1));
+			}
+
+			back_off_before_retry(attempt);
+		}
+	}
+
+	auto return_headroom_leases(RcComm& _conn, const irods::instance_configuration& _config) -> void
+	{
+		auto& leases = _config.headroom_leases();
+		irods::headroom_leases::lease_map_type failed;
+
+		// Each lease is returned on its own, so a failure only keeps the lease it happened to.
+		for (auto&& [path, lease] : leases.take()) {
+			try {
+				return_headroom_lease(_conn, _config, path, lease);
+			}
+			catch (const std::exception& e) {
+				log::rule_engine::error(fmt::format(
+					"Logical Quotas Policy: Failed to return headroom lease to collection [{}] [{}]", path, e.what()));
+				failed.insert_or_assign(path, lease);
+			}
+		}
+
+		for (auto&& [path, lease] : failed) {
+			leases.add(path, lease.data_objects, lease.size_in_bytes);
+		}
+	}
+
+	auto return_headroom_lease(RcComm& _conn,
+	                           const irods::instance_configuration& _config,
+	                           const std::string& _collection,
+	                           irods::headroom_leases::lease& _lease) -> void
+	{
+		const auto& attrs = _config.attributes();
+		const auto retries = _config.options().compare_and_swap_retries;
+
+		const auto& holder = get_headroom_lease_holder();
+
+		// Removing the record claims the headroom. Without the record, the totals were replaced and
+		// no longer hold the headroom.
+		const auto ec = modify_collection_metadata(_conn, "rm", _collection, attrs.headroom_lease(), holder);
+
+		if (CAT_SUCCESS_BUT_WITH_NO_INFO == ec) {
+			_lease = {};
+			return;
+		}
+
+		if (ec < 0) {
+			THROW(ec,
+			      fmt::format("Logical Quotas Policy: Failed to remove headroom lease from collection [{}]",
+			                  _collection));
+		}
+
+		_config.cache().erase(_collection);
+
+		for (auto&& [total, unused] : {std::pair{&attrs.total_number_of_data_objects(), &_lease.data_objects},
+		                               std::pair{&attrs.total_size_in_bytes(), &_lease.size_in_bytes}})
+		{
+			for (std::int64_t attempt = 0; *unused > 0; ++attempt) {
+				const auto info = get_monitored_collection_info(_conn, attrs, _collection);
+
+				if (info.count(*total) == 0) {
+					break;
+				}
+
+				if (const auto value = get_stored_value(attrs, info, *total);
+				    compare_and_swap_total(_conn, _collection, *total, value, value - *unused))
+				{
+					*unused = 0;
+					break;
+				}
+
+				if (attempt == retries) {
+					// The headroom which could not be returned is still part of the totals, so the
+					// record is restored for recalculations to find.
+					modify_collection_metadata(_conn, "add", _collection, attrs.headroom_lease(), holder);
+
+					THROW(SYS_INTERNAL_ERR,
+					      fmt::format("Logical Quotas Policy: Failed to return headroom to collection [{}] after "
+					                  "[{}] attempts. The totals were changed concurrently.",
+					                  _collection,
+					                  attempt + 1));
+				}
+
+				back_off_before_retry(attempt);
+			}
+		}
+
+		_lease = {};
+	}
+
+	auto discard_headroom_leases(RcComm& _conn,
+	                             const irods::instance_configuration& _config,
+	                             const fs::path& _collection) -> void
+	{
+		if (!_config.headroom_leases().enabled()) {
+			return;
+		}
+
+		const auto& attr_name = _config.attributes().headroom_lease();
+		const auto ec = modify_collection_metadata(_conn, "rmw", _collection, attr_name, "%");
+
+		if (ec < 0 && CAT_SUCCESS_BUT_WITH_NO_INFO != ec) {
+			THROW(ec,
+			      fmt::format("Logical Quotas Policy: Failed to discard headroom leases of collection [{}]",
+			                  _collection.string()));
+		}
+	}
+
+	auto get_headroom_lease_holder() -> const std::string&
+	{
+		static const auto holder = [] {
+			char hostname[HOST_NAME_MAX + 1]{};
+			gethostname(hostname, sizeof(hostname) - 1);
+			return fmt::format("{}:{}", hostname, getpid());
+		}();
+
+		return holder;
+	}
+
+	auto set_data_object_count_and_size(RcComm& _conn,
+	                                    const irods::instance_configuration& _config,
+	                                    const fs::path& _collection,
+	                                    size_type _data_objects,
+	                                    size_type _size_in_bytes,
+	                                    bool _only_if_monitored) -> bool
+	{
+		const auto& attrs = _config.attributes();
+
+		const auto gql = fmt::format("select META_COLL_ATTR_NAME, META_COLL_ATTR_VALUE "
+		                             "where COLL_NAME = '{}' and META_COLL_ATTR_NAME {}",
+		                             irods::single_quotes_to_hex(_collection.c_str()),
+		                             make_quota_attribute_condition(attrs));
+
+		bool written = false;
+
+		// A PEP which changes a total between the read and the write leaves a second AVU behind,
+		// because the value it replaced is not removed. Such duplicates are removed by reading the
+		// totals again after the write. A total held by a single AVU is not touched again, so that
+		// changes made after the write are kept.
+		for (std::int64_t attempt = 0;; ++attempt) {
+			// The values of the AVUs of each total, as stored, and the sum of its counter shards.
+			std::unordered_map<std::string, std::vector<std::string>> values;
+			quotas_info_type shards;
+
+			for (auto&& row : make_query(_conn, gql)) {
+				if (const auto* total = attrs.total_of_counter_shard(row[0]); total) {
+					shards[*total] += std::stoll(row[1]);
+				}
+				else if (attrs.total_number_of_data_objects() == row[0] || attrs.total_size_in_bytes() == row[0]) {
+					values[row[0]].push_back(row[1]);
+				}
+			}
+
+			if (_only_if_monitored && values.empty() && shards.empty()) {
+				return false;
+			}
+
+			auto operations = nlohmann::json::array();
+
+			const auto add_operations = [&](const std::string& _attr_name, size_type _value) {
+				const auto& stored_values = values[_attr_name];
+
+				// The counter shards are left in place, so the AVU of the total absorbs the difference.
+				const auto value = _value - shards[_attr_name];
+
+				if (stored_values.size() == 1 && (attempt > 0 || std::stoll(stored_values.front()) == value)) {
+					return;
+				}
+
+				if (stored_values.empty() && attempt > 0) {
+					return;
+				}
+
+				for (auto&& v : stored_values) {
+					operations.push_back({{"operation", "remove"}, {"attribute", _attr_name}, {"value", v}});
+				}
+
+				operations.push_back(
+					{{"operation", "add"}, {"attribute", _attr_name}, {"value", std::to_string(value)}});
+			};
+
+			add_operations(attrs.total_number_of_data_objects(), _data_objects);
+			add_operations(attrs.total_size_in_bytes(), _size_in_bytes);
+
+			if (operations.empty()) {
+				break;
+			}
+
+			if (attempt == default_compare_and_swap_retries) {
+				THROW(SYS_INTERNAL_ERR,
+				      fmt::format("Logical Quotas Policy: Failed to replace totals for collection [{}] after [{}] "
+				                  "attempts. The totals were changed concurrently.",
+				                  _collection.string(),
+				                  attempt));
+			}
+
+			apply_metadata_operations(_conn, _collection, operations);
+			written = true;
+		}
+
+		// The recalculated totals hold no leased headroom, so every lease recorded on the collection is
+		// void, including those of agents which died without returning theirs. The records are removed
+		// after the totals are written. An agent leasing in between then forgets headroom which stays
+		// in the totals until the next recalculation, instead of holding headroom the totals lack.
+		discard_headroom_leases(_conn, _config, _collection);
+
+		return written;
+	}
+
+	auto recalculate_all_totals(RcComm& _conn, const irods::instance_configuration& _config, const fs::path& _root)
+		-> std::tuple<std::size_t, std::size_t>
+	{
+		auto collections_by_path = get_quota_information_for_all_monitored_collections(_conn, _config.attributes());
+
+		{
+			parent_path root{_root};
+
+			for (auto iter = std::begin(collections_by_path); iter != std::end(collections_by_path);) {
+				if (_root == fs::path{iter->first} || root.of(iter->first)) {
+					++iter;
+				}
+				else {
+					iter = collections_by_path.erase(iter);
+				}
+			}
+		}
+
+		monitored_collection_trie trie;
+
+		for (auto&& [path, collection] : collections_by_path) {
+			trie.insert(path);
+		}
+
+		try {
+			// One row per collection holding data objects. The rows are rolled up to every
+			// monitored collection above the collection they describe.
+			const std::vector args{(_root == "/") ? std::string{"/%"} : _root.string() + '%'};
+
+			for_each_specific_query_row(_conn,
+			                            "logical_quotas_count_and_sum_data_objects_by_collection",
+			                            args,
+			                            [&trie](const std::vector<std::string>& _row) {
+				                            trie.add(_row[0],
+				                                     std::stoll(_row[1]),
+				                                     _row[2].empty() ? 0 : std::stoll(_row[2]));
+			                            });
+		}
+		catch (const irods::exception& e) {
+			if (e.code() != CAT_UNKNOWN_SPECIFIC_QUERY) {
+				throw;
+			}
+
+			log::rule_engine::info("Logical Quotas Policy: Specific query "
+			                       "[logical_quotas_count_and_sum_data_objects_by_collection] is not available. "
+			                       "Recalculating each monitored collection separately.");
+
+			for (auto&& [path, collection] : collections_by_path) {
+				const auto [objects, bytes] = count_data_objects_and_sum_sizes_recursive(_conn, path);
+				trie.set(path, objects, bytes);
+			}
+		}
+
+		std::size_t updated = 0;
+		std::size_t written = 0;
+
+		// The grouped scan can take a long time on large zones, so the quota information read before it
+		// is not used for the writes. Each collection's totals are read again right before they are
+		// replaced, and collections which stopped being monitored in the meantime are skipped.
+		for (auto&& [path, totals] : trie.totals_by_path()) {
+			if (set_data_object_count_and_size(_conn, _config, path, totals.data_objects, totals.size_in_bytes, true)) {
+				++updated;
+			}
+
+			// Large zones take a while. Let administrators know the operation is progressing.
+			if (++written % 1000 == 0) {
+				log::rule_engine::info("Logical Quotas Policy: Recalculated totals of [{}] of [{}] monitored "
+				                       "collections.",
+				                       written,
+				                       collections_by_path.size());
+			}
+		}
+
+		return {collections_by_path.size(), updated};
+	}
+
+	auto apply_metadata_operations(RcComm& _conn, const fs::path& _collection, const nlohmann::json& _operations)
+		-> void
+	{
+		const auto input = nlohmann::json{{"admin_mode", true},
+		                                  {"entity_name", _collection.string()},
+		                                  {"entity_type", "collection"},
+		                                  {"operations", _operations}}
+		                       .dump();
+
+		char* output{};
+
+		irods::plugin_statistics::record(event::metadata_write);
+		if (const auto ec = rc_atomic_apply_metadata_operations(&_conn, input.c_str(), &output); ec < 0) {
+			auto msg = fmt::format("Logical Quotas Policy: Failed to update totals for collection [{}]", _collection.string());
+
+			if (output) {
+				msg += fmt::format(" [{}]", output);
+				std::free(output);
+			}
+
+			THROW(ec, msg);
+		}
+
+		std::free(output);
+	}
+
+	auto make_query(RcComm& _conn, const std::string& _gql) -> irods::query<RcComm>
+	{
+		irods::plugin_statistics::record(event::gen_query);
+		return irods::query<RcComm>{&_conn, _gql};
+	}
+
+	auto for_each_specific_query_row(RcComm& _conn,
+	                                 const std::string& _query_name,
+	                                 const std::vector<std::string>& _args,
+	                                 const std::function<void(const std::vector<std::string>&)>& _func) -> void
+	{
+		// The query refers to the arguments until it is exhausted, so it never leaves this function.
+		auto args = _args;
+
+		irods::plugin_statistics::record(event::specific_query);
+		auto query = irods::experimental::query_builder{}
+#if IRODS_VERSION_INTEGER < 5000090
+		                 .type(irods::experimental::query_type::specific)
+#else
+		                 .type(irods::query_type::specific)
+#endif
+		                 .bind_arguments(args)
+		                 .build<RcComm>(_conn, _query_name);
+
+		for (auto&& row : query) {
+			_func(row);
+		}
+	}
+
+	auto execute_specific_query(RcComm& _conn, const std::string& _query_name, std::vector<std::string> _args)
+		-> std::vector<std::string>
+	{
+		std::vector<std::string> result;
+
+		for_each_specific_query_row(
+			_conn, _query_name, _args, [&result](const std::vector<std::string>& _row) { result = _row; });
+
+		return result;
+	}
+
+	auto execute_recursive_specific_query(RcComm& _conn, const std::string& _query_name, const fs::path& _p)
+		-> std::vector<std::string>
+	{
+		return execute_specific_query(_conn, _query_name, {_p.string() + '%'});
+	}
+
+	auto count_data_objects_and_sum_sizes(RcComm& _conn, const std::string& _pattern)
+		-> std::tuple<size_type, size_type>
+	{
+		const auto to_size_type = [](const std::vector<std::string>& _row, std::size_t _index) -> size_type {
+			return (_row.size() > _index && !_row[_index].empty()) ? std::stoll(_row[_index]) : 0;
+		};
+
+		// Zones which have not registered the combined specific query fall back to the two original
+		// specific queries. Once the combined query is known to be missing, it is not tried again by
+		// this agent. Chunked recalculations call this from several threads.
+		static std::atomic<bool> combined_query_is_available{true};
+
+		if (combined_query_is_available.load(std::memory_order_relaxed)) {
+			try {
+				const auto row =
+					execute_specific_query(_conn, "logical_quotas_count_and_sum_data_objects_recursive", {_pattern});
+				return {to_size_type(row, 0), to_size_type(row, 1)};
+			}
+			catch (const irods::exception& e) {
+				if (e.code() != CAT_UNKNOWN_SPECIFIC_QUERY) {
+					throw;
+				}
+
+				combined_query_is_available.store(false, std::memory_order_relaxed);
+			}
+		}
+
+		const auto objects = execute_specific_query(_conn, "logical_quotas_count_data_objects_recursive", {_pattern});
+		const auto bytes = execute_specific_query(_conn, "logical_quotas_sum_data_object_sizes_recursive", {_pattern});
+
+		return {to_size_type(objects, 0), to_size_type(bytes, 0)};
+	}
+
+	auto try_count_data_objects_and_sum_sizes_in_subtree(RcComm& _conn, const fs::path& _p, bool _recursive)
+		-> std::optional<std::tuple<size_type, size_type>>
+	{
+		// Like the combined specific query, the subtree specific query is optional. Once it is known
+		// to be missing, it is not tried again by this agent.
+		static std::atomic<bool> subtree_query_is_available{true};
+
+		if (!subtree_query_is_available.load(std::memory_order_relaxed)) {
+			return std::nullopt;
+		}
+
+		// "/" sorts immediately before "0", so every collection under "_p" sorts within
+		// ["_p/", "_p0"). An empty range selects "_p" alone.
+		const auto& p = _p.string();
+		auto args = _recursive ? std::vector{p, p + '/', p + '0'} : std::vector{p, p, p};
+
+		try {
+			const auto row =
+				execute_specific_query(_conn, "logical_quotas_count_and_sum_data_objects_in_subtree", std::move(args));
+
+			const auto to_size_type = [&row](std::size_t _index) -> size_type {
+				return (row.size() > _index && !row[_index].empty()) ? std::stoll(row[_index]) : 0;
+			};
+
+			return std::tuple{to_size_type(0), to_size_type(1)};
+		}
+		catch (const irods::exception& e) {
+			if (e.code() != CAT_UNKNOWN_SPECIFIC_QUERY) {
+				throw;
+			}
+
+			subtree_query_is_available.store(false, std::memory_order_relaxed);
+		}
+
+		return std::nullopt;
+	}
+
+	auto count_data_objects_and_sum_sizes_in_subtree(RcComm& _conn, const fs::path& _p, bool _recursive)
+		-> std::tuple<size_type, size_type>
+	{
+		if (auto result = try_count_data_objects_and_sum_sizes_in_subtree(_conn, _p, _recursive); result) {
+			return *result;
+		}
+
+		auto [objects, bytes] = count_data_objects_and_sum_sizes(_conn, _p.string());
+
+		if (_recursive) {
+			const auto [o, b] = count_data_objects_and_sum_sizes(_conn, _p.string() + "/%");
+			objects += o;
+			bytes += b;
+		}
+
+		return {objects, bytes};
+	}
+
+	auto count_data_objects_and_sum_sizes_recursive(RcComm& _conn, const fs::path& _p)
+		-> std::tuple<size_type, size_type>
+	{
+		if (auto result = try_count_data_objects_and_sum_sizes_in_subtree(_conn, _p, true); result) {
+			return *result;
+		}
+
+		return count_data_objects_and_sum_sizes(_conn, _p.string() + '%');
+	}
+
+	auto recount_data_objects_and_sizes(RcComm& _conn, const irods::instance_configuration& _config, const fs::path& _p)
+		-> std::tuple<size_type, size_type>
+	{
+		if (_config.options().recalculation_threads > 0) {
+			return count_data_objects_and_sum_sizes_in_chunks(_conn, _config, _p);
+		}
+
+		return count_data_objects_and_sum_sizes_recursive(_conn, _p);
+	}
+
+	auto make_recalculation_chunks(RcComm& _conn, const fs::path& _p, std::size_t _max_chunks)
+		-> std::vector<recalculation_chunk>
+	{
+		std::vector<std::string> children;
+
+		const auto gql =
+			fmt::format("select COLL_NAME where COLL_PARENT_NAME = '{}'", irods::single_quotes_to_hex(_p.c_str()));
+
+		for (auto&& row : make_query(_conn, gql)) {
+			children.push_back(row[0]);
+		}
+
+		std::sort(std::begin(children), std::end(children));
+
+		std::vector<recalculation_chunk> chunks{{"", "", {_p.string()}, false}};
+
+		const auto max_chunks = std::max<std::size_t>(1, _max_chunks);
+		const auto children_per_chunk = std::max<std::size_t>(1, (children.size() + max_chunks - 1) / max_chunks);
+
+		for (std::size_t i = 0; i < children.size(); i += children_per_chunk) {
+			const auto last = std::min(children.size(), i + children_per_chunk);
+			chunks.push_back({fs::path{children[i]}.object_name().string(),
+			                  fs::path{children[last - 1]}.object_name().string(),
+			                  std::vector<std::string>(std::next(std::begin(children), i),
+			                                           std::next(std::begin(children), last))});
+		}
+
+		return chunks;
+	}
+
+	auto find_recalculation_chunk(std::vector<recalculation_chunk>& _chunks,
+	                              const fs::path& _p,
+	                              std::string_view _collection) -> recalculation_chunk*
+	{
+		const auto& parent = _p.string();
+
+		if (_collection.size() < parent.size() || _collection.substr(0, parent.size()) != parent) {
+			return nullptr;
+		}
+
+		auto rest = _collection.substr(parent.size());
+
+		if (rest.empty()) {
+			return &_chunks.front();
+		}
+
+		if (rest.front() == '/') {
+			rest.remove_prefix(1);
+		}
+
+		const auto child = rest.substr(0, rest.find('/'));
+
+		const auto iter = std::find_if(std::next(std::begin(_chunks)), std::end(_chunks), [child](const auto& _c) {
+			return _c.first <= child && child <= _c.last;
+		});
+
+		return (iter != std::end(_chunks)) ? &*iter : nullptr;
+	}
+
+	auto count_recalculation_chunks(const irods::instance_configuration& _config,
+	                                const fs::path& _p,
+	                                std::vector<recalculation_chunk>& _chunks,
+	                                const std::function<void(RcComm&, const recalculation_chunk&)>& _on_counted)
+		-> void
+	{
+		const auto threads =
+			static_cast<std::size_t>(std::max<std::int64_t>(1, _config.options().recalculation_threads));
+		const auto already_counted =
+			std::count_if(std::begin(_chunks), std::end(_chunks), [](const auto& _c) { return _c.counted; });
+
+		std::mutex mutex;
+		auto completed = static_cast<std::size_t>(already_counted);
+		std::atomic<std::size_t> next_chunk{0};
+		std::atomic<bool> failed{false};
+		std::exception_ptr error;
+
+		const irods::plugin_statistics::attribution attribution;
+
+		const auto count_chunks = [&] {
+			irods::plugin_statistics::attribution::scope scope{attribution};
+
+			try {
+				const auto conn = irods::connection_manager::make_connection();
+
+				for (auto i = next_chunk++; i < _chunks.size() && !failed.load(); i = next_chunk++) {
+					auto& chunk = _chunks[i];
+
+					if (chunk.counted) {
+						continue;
+					}
+
+					size_type objects = 0;
+					size_type bytes = 0;
+
+					for (auto&& collection : chunk.collections) {
+						const auto [o, b] =
+							count_data_objects_and_sum_sizes_in_subtree(*conn, collection, chunk.recursive);
+						objects += o;
+						bytes += b;
+					}
+
+					chunk.data_objects = objects;
+					chunk.size_in_bytes = bytes;
+					chunk.counted = true;
+
+					_on_counted(*conn, chunk);
+
+					std::lock_guard lock{mutex};
+
+					// Report progress roughly every ten percent.
+					const auto previous_decile = completed * 10 / _chunks.size();
+
+					if (++completed * 10 / _chunks.size() != previous_decile) {
+						log::rule_engine::info("Logical Quotas Policy: Counted [{}] of [{}] chunk(s) of [{}].",
+						                       completed,
+						                       _chunks.size(),
+						                       _p.c_str());
+					}
+				}
+			}
+			catch (...) {
+				failed.store(true);
+
+				std::lock_guard lock{mutex};
+
+				if (!error) {
+					error = std::current_exception();
+				}
+			}
+		};
+
+		{
+			std::vector<std::jthread> workers;
+
+			for (std::size_t i = 0; i < std::min(threads, _chunks.size() - already_counted); ++i) {
+				workers.emplace_back(count_chunks);
+			}
+		}
+
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+
+	auto count_data_objects_and_sum_sizes_in_chunks(RcComm& _conn,
+	                                                const irods::instance_configuration& _config,
+	                                                const fs::path& _p) -> std::tuple<size_type, size_type>
+	{
+		const auto& attrs = _config.attributes();
+		const auto threads = static_cast<std::size_t>(_config.options().recalculation_threads);
+
+		// A few chunks per connection keeps every connection busy when the subtrees differ in size.
+		auto chunks = make_recalculation_chunks(_conn, _p, threads * 4);
+
+		// The checkpoints which must be removed once every chunk is counted.
+		std::vector<std::string> checkpoints;
+		std::size_t resumed = 0;
+
+		const auto gql = fmt::format("select META_COLL_ATTR_VALUE "
+		                             "where COLL_NAME = '{}' and META_COLL_ATTR_NAME = '{}'",
+		                             irods::single_quotes_to_hex(_p.c_str()),
+		                             attrs.recalculation_checkpoint());
+
+		for (auto&& row : make_query(_conn, gql)) {
+			checkpoints.push_back(row[0]);
+
+			const auto checkpoint = nlohmann::json::parse(row[0], nullptr, false);
+
+			if (checkpoint.is_discarded() || checkpoint.value("chunks", std::size_t{0}) != chunks.size()) {
+				continue;
+			}
+
+			const auto iter = std::find_if(std::begin(chunks), std::end(chunks), [&checkpoint](const auto& _c) {
+				return !_c.counted && _c.matches(checkpoint);
+			});
+
+			if (iter != std::end(chunks)) {
+				iter->counted = true;
+				iter->data_objects = checkpoint.value("data_objects", size_type{0});
+				iter->size_in_bytes = checkpoint.value("size_in_bytes", size_type{0});
+				++resumed;
+			}
+		}
+
+		log::rule_engine::info("Logical Quotas Policy: Recalculating totals of [{}] in [{}] chunk(s) using [{}] "
+		                       "connection(s). [{}] chunk(s) were counted by a previous recalculation.",
+		                       _p.c_str(),
+		                       chunks.size(),
+		                       threads,
+		                       resumed);
+
+		std::mutex mutex;
+
+		// The checkpoints written so far are kept if counting fails so that the next recalculation
+		// can resume.
+		count_recalculation_chunks(_config, _p, chunks, [&](RcComm& _chunk_conn, const recalculation_chunk& _chunk) {
+			auto checkpoint = _chunk.to_json();
+			checkpoint["chunks"] = chunks.size();
+
+			auto value = checkpoint.dump();
+
+			apply_metadata_operations(
+				_chunk_conn,
+				_p,
+				nlohmann::json::array(
+					{{{"operation", "add"}, {"attribute", attrs.recalculation_checkpoint()}, {"value", value}}}));
+
+			std::lock_guard lock{mutex};
+			checkpoints.push_back(std::move(value));
+		});
+
+		if (!checkpoints.empty()) {
+			auto operations = nlohmann::json::array();
+
+			for (auto&& checkpoint : checkpoints) {
+				operations.push_back(
+					{{"operation", "remove"}, {"attribute", attrs.recalculation_checkpoint()}, {"value", checkpoint}});
+			}
+
+			apply_metadata_operations(_conn, _p, operations);
+		}
+
+		size_type data_objects = 0;
+		size_type size_in_bytes = 0;
+
+		for (auto&& c : chunks) {
+			data_objects += c.data_objects;
+			size_in_bytes += c.size_in_bytes;
+		}
+
+		return {data_objects, size_in_bytes};
+	}
+
+	auto count_data_objects_and_sum_sizes_incrementally(RcComm& _conn,
+	                                                    const irods::instance_configuration& _config,
+	                                                    const fs::path& _p,
+	                                                    const quotas_info_type& _info)
+		-> std::tuple<size_type, size_type>
+	{
+		const auto& attrs = _config.attributes();
+		const auto threads =
+			static_cast<std::size_t>(std::max<std::int64_t>(1, _config.options().recalculation_threads));
+
+		// Data objects modified while counting are recounted by the next recalculation.
+		const auto started_at = static_cast<std::int64_t>(std::time(nullptr));
+
+		auto chunks = make_recalculation_chunks(_conn, _p, threads * 4);
+
+		// Rebuilds the checksum of a watermark from its fields and the counts of each chunk.
+		const auto checksum_of = [&chunks](std::int64_t _modify_time, size_type _objects, size_type _bytes) {
+			auto data = fmt::format("{}:{}:{}:{}", _modify_time, chunks.size(), _objects, _bytes);
+
+			for (auto&& c : chunks) {
+				data += c.to_json().dump();
+			}
+
+			return fmt::format("{:016x}", fnv1a_hash(data));
+		};
+
+		std::vector<std::string> old_watermark;
+		nlohmann::json header;
+		std::vector<nlohmann::json> entries;
+
+		const auto watermark_gql = fmt::format("select META_COLL_ATTR_VALUE "
+		                                       "where COLL_NAME = '{}' and META_COLL_ATTR_NAME = '{}'",
+		                                       irods::single_quotes_to_hex(_p.c_str()),
+		                                       attrs.recalculation_watermark());
+
+		for (auto&& row : make_query(_conn, watermark_gql)) {
+			old_watermark.push_back(row[0]);
+
+			if (auto value = nlohmann::json::parse(row[0], nullptr, false); value.is_object()) {
+				if (value.contains("modify_time")) {
+					header = std::move(value);
+				}
+				else {
+					entries.push_back(std::move(value));
+				}
+			}
+		}
+
+		bool watermark_is_valid = false;
+
+		try {
+			if (header.is_object() && header.at("chunks").get<std::size_t>() == chunks.size() &&
+			    entries.size() == chunks.size())
+			{
+				// Assume every chunk is unchanged so that the checksum can be verified.
+				for (auto&& c : chunks) {
+					const auto iter = std::find_if(
+						std::begin(entries), std::end(entries), [&c](const auto& _e) { return c.matches(_e); });
+
+					if (iter == std::end(entries)) {
+						break;
+					}
+
+					c.counted = true;
+					c.data_objects = iter->at("data_objects").get<size_type>();
+					c.size_in_bytes = iter->at("size_in_bytes").get<size_type>();
+				}
+
+				const auto modify_time = header.at("modify_time").get<std::int64_t>();
+
+				watermark_is_valid =
+					std::all_of(std::begin(chunks), std::end(chunks), [](const auto& _c) { return _c.counted; }) &&
+					header.at("checksum").get<std::string>() == checksum_of(modify_time,
+				                                                            header.at("data_objects").get<size_type>(),
+				                                                            header.at("size_in_bytes").get<size_type>());
+
+				if (watermark_is_valid) {
+					// Only the chunks holding data objects modified since the watermark are recounted.
+					const auto gql = fmt::format("select COLL_NAME where COLL_NAME = '{0}' || like '{0}/%' "
+					                             "and DATA_MODIFY_TIME >= '{1:011}'",
+					                             irods::single_quotes_to_hex(_p.c_str()),
+					                             modify_time);
+
+					for (auto&& row : make_query(_conn, gql)) {
+						if (auto* c = find_recalculation_chunk(chunks, _p, row[0]); c) {
+							c->counted = false;
+						}
+					}
+				}
+			}
+		}
+		catch (const nlohmann::json::exception&) {
+			watermark_is_valid = false;
+		}
+
+		if (!watermark_is_valid) {
+			for (auto&& c : chunks) {
+				c.counted = false;
+			}
+		}
+
+		// Remember which chunks were not recounted in case drift is detected.
+		std::vector<bool> reused;
+		std::transform(
+			std::begin(chunks), std::end(chunks), std::back_inserter(reused), [](const auto& _c) { return _c.counted; });
+
+		const auto no_op = [](RcComm&, const recalculation_chunk&) {};
+
+		count_recalculation_chunks(_config, _p, chunks, no_op);
+
+		const auto sum = [&chunks] {
+			std::tuple<size_type, size_type> totals{0, 0};
+
+			for (auto&& c : chunks) {
+				std::get<0>(totals) += c.data_objects;
+				std::get<1>(totals) += c.size_in_bytes;
+			}
+
+			return totals;
+		};
+
+		auto [data_objects, size_in_bytes] = sum();
+		auto recounted = std::count(std::begin(reused), std::end(reused), false);
+
+		const auto stored_total = [&_info](const std::string& _attr_name) -> std::optional<size_type> {
+			if (const auto iter = _info.find(_attr_name); iter != std::end(_info)) {
+				return iter->second;
+			}
+
+			return std::nullopt;
+		};
+
+		if (watermark_is_valid && (stored_total(attrs.total_number_of_data_objects()) != data_objects ||
+		                           stored_total(attrs.total_size_in_bytes()) != size_in_bytes))
+		{
+			log::rule_engine::info("Logical Quotas Policy: Drift detected in totals of [{}]. Recounting every chunk.",
+			                       _p.c_str());
+
+			for (std::size_t i = 0; i < chunks.size(); ++i) {
+				if (reused[i]) {
+					chunks[i].counted = false;
+				}
+			}
+
+			count_recalculation_chunks(_config, _p, chunks, no_op);
+			std::tie(data_objects, size_in_bytes) = sum();
+			recounted = static_cast<decltype(recounted)>(chunks.size());
+		}
+
+		log::rule_engine::info("Logical Quotas Policy: Recounted [{}] of [{}] chunk(s) of [{}].",
+		                       recounted,
+		                       chunks.size(),
+		                       _p.c_str());
+
+		// Replace the watermark in a single request so that it is never seen half written.
+		auto operations = nlohmann::json::array();
+
+		for (auto&& value : old_watermark) {
+			operations.push_back(
+				{{"operation", "remove"}, {"attribute", attrs.recalculation_watermark()}, {"value", value}});
+		}
+
+		const auto add_watermark = [&](const nlohmann::json& _value) {
+			operations.push_back(
+				{{"operation", "add"}, {"attribute", attrs.recalculation_watermark()}, {"value", _value.dump()}});
+		};
+
+		add_watermark({{"modify_time", started_at},
+		               {"chunks", chunks.size()},
+		               {"data_objects", data_objects},
+		               {"size_in_bytes", size_in_bytes},
+		               {"checksum", checksum_of(started_at, data_objects, size_in_bytes)}});
+
+		for (auto&& c : chunks) {
+			add_watermark(c.to_json());
+		}
+
+		apply_metadata_operations(_conn, _p, operations);
+
+		return {data_objects, size_in_bytes};
+	}
+
+	auto fnv1a_hash(std::string_view _data) noexcept -> std::uint64_t
+	{
+		std::uint64_t hash = 14695981039346656037ULL;
+
+		for (const auto c : _data) {
+			hash ^= static_cast<unsigned char>(c);
+			hash *= 1099511628211ULL;
+		}
+
+		return hash;
+	}
+
+	auto get_size_of_data_object_before_write(RcComm& _conn, const l1desc_t& _l1desc) -> size_type
+	{
+		try {
+			return fs::client::data_object_size(_conn, _l1desc.dataObjInfo->objPath);
+		}
+		catch (const fs::filesystem_error&) {
+			// The data object has no good replica. This happens when the only replica is the one
+			// being written.
+		}
+
+		if (CREATE_TYPE == _l1desc.openType) {
+			return 0;
+		}
+
+		return _l1desc.dataObjInfo->dataSize;
 	}
 
-	auto compute_data_object_count_and_size(RcComm& _conn, fs::path _p) -> std::tuple<size_type, size_type>
+	auto get_size_of_data_object_or_zero(RcComm& _conn, const fs::path& _p) -> size_type
 	{
-		size_type objects = 0;
-		size_type bytes = 0;
-
-		const auto gql = fmt::format("select count(DATA_NAME), sum(DATA_SIZE) where COLL_NAME = '{0}' || like '{0}/%'",
-		                             irods::single_quotes_to_hex(_p.c_str()));
-
-		for (auto&& row : irods::query{&_conn, gql}) {
-			objects = !row[0].empty() ? std::stoll(row[0]) : 0;
-			bytes = !row[1].empty() ? std::stoll(row[1]) : 0;
+		try {
+			return fs::client::data_object_size(_conn, _p);
+		}
+		catch (const fs::filesystem_error&) {
+			return 0;
 		}
-
-		return {objects, bytes};
 	}
 
-	auto update_data_object_count_and_size(RcComm& _conn,
-	                                       const irods::attributes& _attrs,
-	                                       const fs::path& _collection,
-	                                       const quotas_info_type& _info,
-	                                       size_type _data_objects_delta,
-	                                       size_type _size_in_bytes_delta) -> void
+	auto update_totals_on_close(RcComm& _conn,
+	                            const irods::instance_configuration& _config,
+	                            const fs::path& _p,
+	                            size_type _data_objects_delta,
+	                            size_type _size_in_bytes_before_write) -> void
 	{
-		if (0 != _data_objects_delta) {
-			const auto& objects_attr = _attrs.total_number_of_data_objects();
+		const auto size_in_bytes_delta = get_size_of_data_object_or_zero(_conn, _p) - _size_in_bytes_before_write;
 
-			if (const auto iter = _info.find(objects_attr); std::end(_info) != iter) {
-				const auto new_object_count = std::to_string(iter->second + _data_objects_delta);
-				fs::client::set_metadata(fs::admin, _conn, _collection, {objects_attr, new_object_count});
-			}
-		}
+		for_each_monitored_collection(_conn, _config, _p, [&](const auto& _collection) {
+			update_data_object_count_and_size(_conn, _config, _collection, _data_objects_delta, size_in_bytes_delta);
+		});
+	}
 
-		if (0 != _size_in_bytes_delta) {
-			const auto& size_attr = _attrs.total_size_in_bytes();
+	auto recalculate_totals_on_close(const std::string& _instance_name,
+	                                 const irods::instance_configuration_map& _instance_configs,
+	                                 const fs::path& _p,
+	                                 MsParamArray* _ms_param_array,
+	                                 irods::callback& _effect_handler) -> void
+	{
+		const auto& config = get_instance_config(_instance_configs, _instance_name);
+		auto& conn = irods::connection_manager::get();
+
+		for_each_monitored_collection(conn, config, _p, [&](const auto& _collection) {
+			std::string p = _collection.path.string();
+			std::list<boost::any> args{&p};
+			const auto err = irods::handler::logical_quotas_recalculate_totals(
+				_instance_name, _instance_configs, args, _ms_param_array, _effect_handler);
 
-			if (const auto iter = _info.find(size_attr); std::end(_info) != iter) {
-				const auto new_size_in_bytes = std::to_string(iter->second + _size_in_bytes_delta);
-				fs::client::set_metadata(fs::admin, _conn, _collection, {size_attr, new_size_in_bytes});
+			if (!err.ok()) {
+				THROW(err.code(), err.result());
 			}
-		}
+		});
 	}
 
 	auto unset_metadata_impl(const std::string& _instance_name,
@@ -291,17 +2707,33 @@ namespace
 			auto args_iter = std::begin(_rule_arguments);
 			const auto& path = *boost::any_cast<std::string*>(*args_iter);
 
-			const auto& attrs = get_instance_config(_instance_configs, _instance_name).attributes();
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
+			const auto& attrs = config.attributes();
+
+			auto& conn = irods::connection_manager::get();
+
+			// Write any changes held in memory so that they cannot be applied to the metadata after
+			// it is removed.
+			write_pending_quota_updates(conn, config);
 
-			irods::experimental::client_connection conn;
 			const auto info = get_monitored_collection_info(conn, attrs, path);
 
 			for (auto&& attribute_name : _func(attrs)) {
 				if (const auto iter = info.find(*attribute_name); iter != std::end(info)) {
-					const auto value = get_attribute_value<size_type>(info, *attribute_name);
-					fs::client::remove_metadata(fs::admin, conn, path, {*attribute_name, std::to_string(value)});
+					const auto value = get_stored_value(attrs, info, *attribute_name);
+					remove_collection_metadata(conn, path, *attribute_name, std::to_string(value));
+					remove_counter_shards(conn, attrs, path, info, *attribute_name);
+
+					// The leased headroom was part of the total that was just removed.
+					if (*attribute_name == attrs.total_number_of_data_objects() ||
+					    *attribute_name == attrs.total_size_in_bytes())
+					{
+						discard_headroom_leases(conn, config, path);
+					}
 				}
 			}
+
+			invalidate_cached_information(config, path);
 		}
 		catch (const irods::exception& e) {
 			return log_irods_exception(e, _effect_handler);
@@ -319,17 +2751,72 @@ namespace
 		return boost::any_cast<T*>(*std::next(std::begin(_rule_arguments), _index));
 	}
 
+	auto write_json_output(const nlohmann::json& _output,
+	                       std::list<boost::any>& _rule_arguments,
+	                       MsParamArray* _ms_param_array) -> irods::error
+	{
+		return irods::handler::write_output(_output.dump(), _rule_arguments, _ms_param_array);
+	}
+
 	template <typename Function>
 	auto for_each_monitored_collection(RcComm& _conn,
-	                                   const irods::attributes& _attrs,
+	                                   const irods::instance_configuration& _config,
 	                                   fs::path _logical_path,
 	                                   Function _func) -> void
 	{
-		for (auto collection = get_monitored_parent_collection(_conn, _attrs, _logical_path.parent_path()); collection;
-		     collection = get_monitored_parent_collection(_conn, _attrs, collection->parent_path()))
-		{
-			auto info = get_monitored_collection_info(_conn, _attrs, *collection);
-			_func(*collection, info);
+		for (auto&& collection : get_monitored_collections(_conn, _config, _logical_path.parent_path())) {
+			_func(collection);
+		}
+	}
+
+	auto admit_change(RcComm& _conn,
+	                  const irods::instance_configuration& _config,
+	                  const fs::path& _logical_path,
+	                  size_type _data_objects_delta,
+	                  size_type _size_in_bytes_delta) -> void
+	{
+		const auto& attrs = _config.attributes();
+		auto* reservations = _config.reservations();
+
+		// Leased headroom is already part of the totals, so it needs no reservation.
+		if (_config.headroom_leases().enabled()) {
+			reservations = nullptr;
+		}
+
+		release_reservations(_config);
+
+		const auto admit = [&](const auto& _collection) {
+			if (reservations) {
+				const irods::reservation_ledger::amounts amounts{_data_objects_delta, _size_in_bytes_delta};
+
+				const auto reserved = reservations->try_reserve(_collection.id, amounts, [&](const auto& _reserved) {
+					throw_if_maximum_number_of_data_objects_violation(
+						attrs, _collection.info, _data_objects_delta + _reserved.data_objects);
+					throw_if_maximum_size_in_bytes_violation(
+						attrs, _collection.info, _size_in_bytes_delta + _reserved.size_in_bytes);
+				});
+
+				if (reserved) {
+					return;
+				}
+			}
+
+			throw_if_headroom_cannot_be_leased(_conn, _config, _collection, _data_objects_delta, _size_in_bytes_delta);
+		};
+
+		try {
+			for_each_monitored_collection(_conn, _config, _logical_path, admit);
+		}
+		catch (...) {
+			release_reservations(_config);
+			throw;
+		}
+	}
+
+	auto release_reservations(const irods::instance_configuration& _config) noexcept -> void
+	{
+		if (auto* reservations = _config.reservations(); reservations) {
+			reservations->release();
 		}
 	}
 
@@ -383,7 +2870,7 @@ namespace
 	{
 		const auto gql = fmt::format("select USER_TYPE where USER_NAME = '{}'", _entity_name);
 
-		for (auto&& row : irods::query{&_conn, gql}) {
+		for (auto&& row : make_query(_conn, gql)) {
 			return "rodsgroup" == row[0];
 		}
 
@@ -400,6 +2887,7 @@ namespace
 
 	auto log_irods_exception(const irods::exception& e, irods::callback& _effect_handler) -> irods::error
 	{
+		irods::connection_manager::release_if_broken(e.code());
 		log::rule_engine::error(e.what());
 		addRErrorMsg(&get_rei(_effect_handler).rsComm->rError, e.code(), e.client_display_what());
 		return e;
@@ -407,60 +2895,92 @@ namespace
 
 	auto log_exception(const std::exception& e, irods::callback& _effect_handler) -> irods::error
 	{
+		// Filesystem errors carry the iRODS error code.
+		if (const auto* se = dynamic_cast<const std::system_error*>(&e); se) {
+			irods::connection_manager::release_if_broken(se->code().value());
+		}
+
 		log::rule_engine::error(e.what());
 		addRErrorMsg(&get_rei(_effect_handler).rsComm->rError, RE_RUNTIME_ERROR, e.what());
 		return ERROR(RE_RUNTIME_ERROR, e.what());
 	}
+} // anonymous namespace
 
-	auto get_quota_value_for_collection(RcComm& _conn, const std::string& _coll_path, const std::string& _quota_name)
-		-> std::tuple<std::string, irods::error>
+namespace irods::handler
+{
+	auto write_output(std::string _output, std::list<boost::any>& _rule_arguments, MsParamArray* _ms_param_array)
+		-> irods::error
 	{
-		auto ret_error = SUCCESS();
-
-		std::string value_out;
+		// "_ms_param_array" points to a valid object depending on how the rule is invoked. If the implementation
+		// is invoked via exec_rule, then this parameter will be null. If invoked via exec_rule_text or
+		// exec_rule_expression, this parameter will point to a valid object. The exec_rule_text/expression
+		// functions reply on this parameter to return information back to the client.
+		if (_ms_param_array) {
+			auto* msp = getMsParamByLabel(_ms_param_array, "ruleExecOut");
+
+			if (msp) {
+				// Free any resources previously associated with the parameter.
+				if (msp->type) {
+					std::free(msp->type);
+				}
+				if (msp->inOutStruct) {
+					std::free(msp->inOutStruct);
+				}
+			}
 
-		// Initialize query conditions and column for selection.
-		GenQueryInp input{};
-		GenQueryOut* output{};
-		addInxIval(&input.selectInp, COL_META_COLL_ATTR_VALUE, 0);
-		addInxVal(&input.sqlCondInp, COL_COLL_NAME, fmt::format("= '{}'", _coll_path).c_str());
-		addInxVal(&input.sqlCondInp, COL_META_COLL_ATTR_NAME, fmt::format("= '{}'", _quota_name).c_str());
+			auto* out = static_cast<ExecCmdOut*>(std::malloc(sizeof(ExecCmdOut)));
+			std::memset(out, 0, sizeof(ExecCmdOut));
 
-		input.maxRows = MAX_SQL_ROWS;
+			// Copy the string into the output object.
+			const auto buffer_size = _output.size() + 1;
+			out->stdoutBuf.len = buffer_size;
+			out->stdoutBuf.buf = std::malloc(sizeof(char) * buffer_size);
+			std::memcpy(out->stdoutBuf.buf, _output.data(), buffer_size);
 
-		while (true) {
-			if (const int ec = rcGenQuery(&_conn, &input, &output); ec < 0) {
-				if (ec != CAT_NO_ROWS_FOUND) {
-					ret_error = ERROR(ec, "rcGenQuery failed.");
-				}
-				break;
+			if (msp) {
+				// Set the correct type information.
+				msp->type = strdup(ExecCmdOut_MS_T);
+				msp->inOutStruct = out;
 			}
-
-			for (int row = 0; row < output->rowCnt; ++row) {
-				for (int attr = 0; attr < output->attriCnt; ++attr) {
-					const SqlResult* sql_result = &output->sqlResult[attr];
-					const char* value = sql_result->value + (row * sql_result->len);
-					value_out = value;
-				}
+			else {
+				addMsParamToArray(_ms_param_array, "ruleExecOut", ExecCmdOut_MS_T, out, nullptr, 0);
 			}
+		}
+		// If "_ms_param_array" is not set, then the rule must have been invoked via exec_rule or as part of a
+		// batch. The caller must provide a second variable so that the results can be returned.
+		else if (_rule_arguments.size() == 2) {
+			*boost::any_cast<std::string*>(*std::next(std::begin(_rule_arguments))) = std::move(_output);
+		}
+		else {
+			return ERROR(RE_UNABLE_TO_WRITE_VAR, "Logical Quotas Policy: Missing output variable.");
+		}
 
-			if (output->continueInx <= 0) {
-				break;
-			}
-			input.continueInx = output->continueInx;
+		return SUCCESS();
+	}
 
-			clearGenQueryOut(output);
+	auto flush_pending_quota_updates(const irods::instance_configuration& _config) noexcept -> void
+	{
+		try {
+			if (!_config.pending_updates().empty()) {
+				write_pending_quota_updates(irods::connection_manager::get(), _config);
+			}
+		}
+		catch (const std::exception& e) {
+			log::rule_engine::error(
+				fmt::format("Logical Quotas Policy: Failed to write pending quota updates to catalog [{}]", e.what()));
 		}
 
-		clearGenQueryInp(&input);
-		freeGenQueryOut(&output);
-
-		return std::make_tuple(value_out, ret_error);
+		try {
+			if (!_config.headroom_leases().empty()) {
+				return_headroom_leases(irods::connection_manager::get(), _config);
+			}
+		}
+		catch (const std::exception& e) {
+			log::rule_engine::error(
+				fmt::format("Logical Quotas Policy: Failed to return headroom leases to catalog [{}]", e.what()));
+		}
 	}
-} // anonymous namespace
 
-namespace irods::handler
-{
 	auto logical_quotas_get_collection_status(const std::string& _instance_name,
 	                                          const instance_configuration_map& _instance_configs,
 	                                          std::list<boost::any>& _rule_arguments,
@@ -472,9 +2992,9 @@ namespace irods::handler
 			auto args_iter = std::begin(_rule_arguments);
 			const auto& path = *boost::any_cast<std::string*>(*args_iter);
 
-			irods::experimental::client_connection conn;
+			const auto info = get_monitored_collection_info(irods::connection_manager::get(), attrs, path);
 
-			if (!is_monitored_collection(conn, attrs, path)) {
+			if (!holds_totals(attrs, info)) {
 				auto msg = fmt::format("Logical Quotas Policy: [{}] is not a monitored collection.", path);
 				log::rule_engine::error(msg);
 				constexpr auto ec = SYS_INVALID_INPUT_PARAM;
@@ -482,71 +3002,117 @@ namespace irods::handler
 				return ERROR(ec, std::move(msg));
 			}
 
-			auto quota_status = nlohmann::json::object(); // Holds the current quota values.
+			const auto quota_status = make_collection_status(attrs, info);
 
-			// Fetch the current quota values for the collection.
-			for (const auto& quota_name : {attrs.maximum_number_of_data_objects(),
-			                               attrs.maximum_size_in_bytes(),
-			                               attrs.total_number_of_data_objects(),
-			                               attrs.total_size_in_bytes()})
-			{
-				auto [result, err] = get_quota_value_for_collection(static_cast<RcComm&>(conn), path, quota_name);
-				if (!err.ok()) {
-					return err;
-				}
-				quota_status[quota_name] = std::move(result);
-			}
-
-			// "_ms_param_array" points to a valid object depending on how the rule is invoked. If the implementation
-			// is invoked via exec_rule, then this parameter will be null. If invoked via exec_rule_text or
-			// exec_rule_expression, this parameter will point to a valid object. The exec_rule_text/expression
-			// functions reply on this parameter to return information back to the client.
-			if (_ms_param_array) {
-				if (auto* msp = getMsParamByLabel(_ms_param_array, "ruleExecOut"); msp) {
-					// Free any resources previously associated with the parameter.
-					if (msp->type) {
-						std::free(msp->type);
-					}
-					if (msp->inOutStruct) {
-						std::free(msp->inOutStruct);
-					}
+			if (auto err = write_json_output(quota_status, _rule_arguments, _ms_param_array); !err.ok()) {
+				return err;
+			}
+		}
+		catch (const irods::exception& e) {
+			return log_irods_exception(e, _effect_handler);
+		}
+		catch (const std::exception& e) {
+			return log_exception(e, _effect_handler);
+		}
+
+		return SUCCESS();
+	}
+
+	auto logical_quotas_get_status_of_collections(const std::string& _instance_name,
+	                                              const instance_configuration_map& _instance_configs,
+	                                              std::list<boost::any>& _rule_arguments,
+	                                              MsParamArray* _ms_param_array,
+	                                              irods::callback& _effect_handler) -> irods::error
+	{
+		const auto invalid_input = [&_effect_handler](std::string _msg) {
+			log::rule_engine::error(_msg);
+			constexpr auto ec = SYS_INVALID_INPUT_PARAM;
+			addRErrorMsg(&get_rei(_effect_handler).rsComm->rError, ec, _msg.c_str());
+			return ERROR(ec, std::move(_msg));
+		};
+
+		try {
+			const auto& attrs = get_instance_config(_instance_configs, _instance_name).attributes();
+			const auto& arg = *boost::any_cast<std::string*>(*std::begin(_rule_arguments));
+
+			if (arg.empty()) {
+				return invalid_input("Logical Quotas Policy: Missing collection or list of collections.");
+			}
 
-					// Set the correct type information and allocate enough memory for that type.
-					msp->type = strdup(ExecCmdOut_MS_T);
-					msp->inOutStruct = std::malloc(sizeof(ExecCmdOut));
+			// The argument is either the root of a subtree or a JSON array of collections.
+			std::vector<std::string> paths;
+			const auto list_mode = (arg.front() == '[');
 
-					auto* out = static_cast<ExecCmdOut*>(msp->inOutStruct);
-					std::memset(out, 0, sizeof(ExecCmdOut));
+			if (list_mode) {
+				const auto json_paths = nlohmann::json::parse(arg);
 
-					// Copy the JSON string into the output object.
-					const auto json_string = quota_status.dump();
-					const auto buffer_size = json_string.size() + 1;
-					out->stdoutBuf.len = buffer_size;
-					out->stdoutBuf.buf = std::malloc(sizeof(char) * buffer_size);
-					std::memcpy(out->stdoutBuf.buf, json_string.data(), buffer_size);
+				for (const auto& p : json_paths) {
+					if (!p.is_string() || p.get_ref<const std::string&>().empty() ||
+					    p.get_ref<const std::string&>().front() != '/')
+					{
+						return invalid_input(
+							fmt::format("Logical Quotas Policy: Invalid collection in list [{}].", p.dump()));
+					}
+
+					paths.push_back(p.get<std::string>());
 				}
-				else {
-					auto* out = static_cast<ExecCmdOut*>(std::malloc(sizeof(ExecCmdOut)));
-					std::memset(out, 0, sizeof(ExecCmdOut));
+			}
+			else if (arg.front() != '/') {
+				return invalid_input(fmt::format("Logical Quotas Policy: Invalid collection [{}].", arg));
+			}
+			else {
+				paths.push_back(arg);
+			}
+
+			std::string output;
 
-					// Copy the JSON string into the output object.
-					const auto json_string = quota_status.dump();
-					const auto buffer_size = json_string.size() + 1;
-					out->stdoutBuf.len = buffer_size;
-					out->stdoutBuf.buf = std::malloc(sizeof(char) * buffer_size);
-					std::memcpy(out->stdoutBuf.buf, json_string.data(), buffer_size);
+			if (paths.empty()) {
+				return write_output(std::move(output), _rule_arguments, _ms_param_array);
+			}
+
+			// Every collection is covered by a single query on the subtree rooted at their longest
+			// common ancestor.
+			auto root = fs::path{paths.front()};
 
-					addMsParamToArray(_ms_param_array, "ruleExecOut", ExecCmdOut_MS_T, out, nullptr, 0);
+			for (const auto& p : paths) {
+				while (root.string() != "/" && p != root.string() && !parent_path{root}.of(p)) {
+					root = root.parent_path();
 				}
 			}
-			// If "_ms_param_array" is not set, then the rule must have been invoked via exec_rule. The client must
-			// provide a second variable so that the results can be returned.
-			else if (_rule_arguments.size() == 2) {
-				*boost::any_cast<std::string*>(*std::next(args_iter)) = quota_status.dump();
+
+			const auto info_by_path = get_quota_information_for_subtree(irods::connection_manager::get(), attrs, root);
+
+			// Each collection is reported on a line of its own (i.e. newline-delimited JSON), in the
+			// order given by the client or, for a subtree, ordered by path.
+			//
+			// The lines are buffered rather than written as they are produced because the client
+			// receives the output as a single value (ruleExecOut or the output variable) once the
+			// operation returns. Nothing reaches the client earlier, so writing line by line would only
+			// grow that value in place. The quota information of all of the collections is held in
+			// memory for the single query anyway.
+			const auto append_line = [&output](const std::string& _path, nlohmann::json _status) {
+				_status["collection"] = _path;
+				output += _status.dump();
+				output += '\n';
+			};
+
+			if (list_mode) {
+				for (const auto& p : paths) {
+					if (const auto iter = info_by_path.find(p); iter != std::end(info_by_path)) {
+						append_line(p, make_collection_status(attrs, iter->second));
+					}
+					else {
+						append_line(p, {{"error", fmt::format("[{}] is not a monitored collection.", p)}});
+					}
+				}
 			}
 			else {
-				return ERROR(RE_UNABLE_TO_WRITE_VAR, "Logical Quotas Policy: Missing output variable for status.");
+				for (const auto& [p, info] : info_by_path) {
+					append_line(p, make_collection_status(attrs, info));
+				}
 			}
+
+			return write_output(std::move(output), _rule_arguments, _ms_param_array);
 		}
 		catch (const irods::exception& e) {
 			return log_irods_exception(e, _effect_handler);
@@ -554,8 +3120,33 @@ namespace irods::handler
 		catch (const std::exception& e) {
 			return log_exception(e, _effect_handler);
 		}
+	}
 
-		return SUCCESS();
+	auto logical_quotas_get_statistics(const std::string& _instance_name,
+	                                   const instance_configuration_map& _instance_configs,
+	                                   std::list<boost::any>& _rule_arguments,
+	                                   MsParamArray* _ms_param_array,
+	                                   irods::callback& _effect_handler) -> irods::error
+	{
+		try {
+			const auto* statistics = get_instance_config(_instance_configs, _instance_name).statistics();
+
+			if (!statistics) {
+				auto msg = std::string{"Logical Quotas Policy: Statistics are not available."};
+				log::rule_engine::error(msg);
+				constexpr auto ec = SYS_INTERNAL_ERR;
+				addRErrorMsg(&get_rei(_effect_handler).rsComm->rError, ec, msg.c_str());
+				return ERROR(ec, std::move(msg));
+			}
+
+			return write_json_output(statistics->to_json(), _rule_arguments, _ms_param_array);
+		}
+		catch (const irods::exception& e) {
+			return log_irods_exception(e, _effect_handler);
+		}
+		catch (const std::exception& e) {
+			return log_exception(e, _effect_handler);
+		}
 	}
 
 	auto logical_quotas_start_monitoring_collection(const std::string& _instance_name,
@@ -580,6 +3171,115 @@ namespace irods::handler
 			});
 	}
 
+	auto logical_quotas_compact_counters(const std::string& _instance_name,
+	                                     const instance_configuration_map& _instance_configs,
+	                                     std::list<boost::any>& _rule_arguments,
+	                                     MsParamArray* _ms_param_array,
+	                                     irods::callback& _effect_handler) -> irods::error
+	{
+		try {
+			const auto& path = *boost::any_cast<std::string*>(*std::begin(_rule_arguments));
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
+			const auto& attrs = config.attributes();
+			auto& conn = irods::connection_manager::get();
+
+			const auto gql = fmt::format("select META_COLL_ATTR_NAME, META_COLL_ATTR_VALUE "
+			                             "where COLL_NAME = '{}' and META_COLL_ATTR_NAME like '{}' || like '{}'",
+			                             irods::single_quotes_to_hex(path),
+			                             attrs.counter_shard_pattern(attrs.total_number_of_data_objects()),
+			                             attrs.counter_shard_pattern(attrs.total_size_in_bytes()));
+
+			// Every value is kept, because a shard may hold more than one.
+			std::vector<std::tuple<const std::string*, std::string, std::string>> shards;
+
+			for (auto&& row : make_query(conn, gql)) {
+				if (const auto* total = attrs.total_of_counter_shard(row[0]); total) {
+					shards.emplace_back(total, row[0], row[1]);
+				}
+			}
+
+			// Adds the deltas to the AVUs of the totals. Agents only write to the shards, so conflicts
+			// are limited to concurrent recalculations.
+			const auto add_to_totals = [&](const std::map<const std::string*, size_type>& _deltas) {
+				for (auto&& [total, delta] : _deltas) {
+					for (std::int64_t attempt = 0; 0 != delta; ++attempt) {
+						const auto info = get_monitored_collection_info(conn, attrs, path);
+
+						if (info.count(*total) == 0) {
+							break;
+						}
+
+						const auto value = get_stored_value(attrs, info, *total);
+
+						if (compare_and_swap_total(conn, path, *total, value, value + delta)) {
+							break;
+						}
+
+						if (attempt >= config.options().compare_and_swap_retries) {
+							THROW(SYS_INTERNAL_ERR,
+							      fmt::format("Logical Quotas Policy: Failed to update [{}] for collection [{}]. "
+							                  "The total was changed concurrently.",
+							                  *total,
+							                  path));
+						}
+
+						back_off_before_retry(attempt);
+					}
+				}
+			};
+
+			// The shards are added to the totals before they are removed. In between, readers see the
+			// shards counted twice, which errs on the side of enforcing the limits.
+			std::map<const std::string*, size_type> deltas;
+
+			for (auto&& [total, attr_name, value] : shards) {
+				deltas[total] += std::stoll(value);
+			}
+
+			add_to_totals(deltas);
+
+			// A shard is only removed if it still holds the value which was read. Otherwise, an agent
+			// changed it in the meantime. Its value is then taken back out of the total and the shard
+			// is left for the next compaction.
+			std::map<const std::string*, size_type> changed;
+			std::size_t removed = 0;
+
+			for (auto&& [total, attr_name, value] : shards) {
+				const auto ec = modify_collection_metadata(conn, "rm", path, attr_name, value);
+
+				if (CAT_SUCCESS_BUT_WITH_NO_INFO == ec) {
+					changed[total] -= std::stoll(value);
+				}
+				else if (ec < 0) {
+					THROW(ec,
+					      fmt::format("Logical Quotas Policy: Failed to remove [{}] from collection [{}]",
+					                  attr_name,
+					                  path));
+				}
+				else {
+					++removed;
+				}
+			}
+
+			add_to_totals(changed);
+
+			invalidate_cached_information(config, path);
+
+			log::rule_engine::info("Logical Quotas Policy: Compacted [{}] of [{}] counter shard(s) of [{}].",
+			                       removed,
+			                       shards.size(),
+			                       path);
+		}
+		catch (const irods::exception& e) {
+			return log_irods_exception(e, _effect_handler);
+		}
+		catch (const std::exception& e) {
+			return log_exception(e, _effect_handler);
+		}
+
+		return SUCCESS();
+	}
+
 	auto logical_quotas_count_total_number_of_data_objects(const std::string& _instance_name,
 	                                                       const instance_configuration_map& _instance_configs,
 	                                                       std::list<boost::any>& _rule_arguments,
@@ -589,27 +3289,143 @@ namespace irods::handler
 		try {
 			auto args_iter = std::begin(_rule_arguments);
 			const auto& path = *boost::any_cast<std::string*>(*args_iter);
-			std::vector args{path + '%'};
-			irods::experimental::client_connection conn;
+			auto& conn = irods::connection_manager::get();
+
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
+			const auto& attrs = config.attributes();
+
+			std::string objects;
+
+			// Only one total is written, so the subtree is always scanned in a single query. Counting in
+			// chunks would compute both totals and leave checkpoints describing both. Use
+			// logical_quotas_recalculate_totals for that.
+			if (const auto result = try_count_data_objects_and_sum_sizes_in_subtree(conn, path, true); result) {
+				objects = std::to_string(std::get<0>(*result));
+			}
+			else {
+				const auto row =
+					execute_recursive_specific_query(conn, "logical_quotas_count_data_objects_recursive", path);
+				objects = row.empty() ? std::string{} : row[0];
+			}
+
+			// Write any changes held in memory first. Otherwise, they would be applied on top of
+			// the recalculated total.
+			write_pending_quota_updates(conn, config);
+
+			// The counter shards hold changes which are part of the count.
+			const auto info = get_monitored_collection_info(conn, attrs, path);
+			remove_counter_shards(conn, attrs, path, info, attrs.total_number_of_data_objects());
+
+			set_collection_metadata(conn, path, attrs.total_number_of_data_objects(), objects.empty() ? "0" : objects);
+			discard_headroom_leases(conn, config, path);
+			invalidate_cached_information(config, path);
+		}
+		catch (const irods::exception& e) {
+			return log_irods_exception(e, _effect_handler);
+		}
+		catch (const std::exception& e) {
+			return log_exception(e, _effect_handler);
+		}
+
+		return SUCCESS();
+	}
+
+	auto logical_quotas_count_total_size_in_bytes(const std::string& _instance_name,
+	                                              const instance_configuration_map& _instance_configs,
+	                                              std::list<boost::any>& _rule_arguments,
+	                                              MsParamArray* _ms_param_array,
+	                                              irods::callback& _effect_handler) -> irods::error
+	{
+		try {
+			auto args_iter = std::begin(_rule_arguments);
+			const auto& path = *boost::any_cast<std::string*>(*args_iter);
+			auto& conn = irods::connection_manager::get();
+
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
+			const auto& attrs = config.attributes();
+
+			std::string bytes;
+
+			// Always a single scan. See logical_quotas_count_total_number_of_data_objects().
+			if (const auto result = try_count_data_objects_and_sum_sizes_in_subtree(conn, path, true); result) {
+				bytes = std::to_string(std::get<1>(*result));
+			}
+			else {
+				const auto row =
+					execute_recursive_specific_query(conn, "logical_quotas_sum_data_object_sizes_recursive", path);
+				bytes = row.empty() ? std::string{} : row[0];
+			}
+
+			// Write any changes held in memory first. Otherwise, they would be applied on top of
+			// the recalculated total.
+			write_pending_quota_updates(conn, config);
+
+			// The counter shards hold changes which are part of the count.
+			const auto info = get_monitored_collection_info(conn, attrs, path);
+			remove_counter_shards(conn, attrs, path, info, attrs.total_size_in_bytes());
+
+			set_collection_metadata(conn, path, attrs.total_size_in_bytes(), bytes.empty() ? "0" : bytes);
+			discard_headroom_leases(conn, config, path);
+			invalidate_cached_information(config, path);
+		}
+		catch (const irods::exception& e) {
+			return log_irods_exception(e, _effect_handler);
+		}
+		catch (const std::exception& e) {
+			return log_exception(e, _effect_handler);
+		}
+
+		return SUCCESS();
+	}
+
+	auto logical_quotas_recalculate_totals(const std::string& _instance_name,
+	                                       const instance_configuration_map& _instance_configs,
+	                                       std::list<boost::any>& _rule_arguments,
+	                                       MsParamArray* _ms_param_array,
+	                                       irods::callback& _effect_handler) -> irods::error
+	{
+		try {
+			auto args_iter = std::begin(_rule_arguments);
+			const auto& path = *boost::any_cast<std::string*>(*args_iter);
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
+			auto& conn = irods::connection_manager::get();
 
-			auto query = irods::experimental::query_builder{}
-#if IRODS_VERSION_INTEGER < 5000090
-			                 .type(irods::experimental::query_type::specific)
-#else
-			                 .type(irods::query_type::specific)
-#endif
-			                 .bind_arguments(args)
-			                 .build<RcComm>(conn, "logical_quotas_count_data_objects_recursive");
+			// The mode is optional. Rules written in other languages only pass the collection.
+			std::string_view mode = "full";
 
-			std::string objects;
-			for (auto&& row : query) {
-				objects = row[0];
+			if (++args_iter != std::end(_rule_arguments)) {
+				mode = *boost::any_cast<std::string*>(*args_iter);
 			}
 
-			const auto& attrs = get_instance_config(_instance_configs, _instance_name).attributes();
+			if ("incremental" == mode) {
+				// The changes held in memory must be written first so that the totals can be compared
+				// against the recounted values.
+				write_pending_quota_updates(conn, config);
+
+				// "info" is only what the recounted values are checked against. It is stale by the time
+				// the chunks are counted, so the totals are read again when they are replaced.
+				const auto info = get_monitored_collection_info(conn, config.attributes(), path);
+				const auto [objects, bytes] = count_data_objects_and_sum_sizes_incrementally(conn, config, path, info);
+				set_data_object_count_and_size(conn, config, path, objects, bytes);
+			}
+			else if ("full" == mode) {
+				const auto [objects, bytes] = recount_data_objects_and_sizes(conn, config, path);
+
+				// Write any changes held in memory first. Otherwise, they would be applied on top of
+				// the recalculated totals.
+				write_pending_quota_updates(conn, config);
+
+				set_data_object_count_and_size(conn, config, path, objects, bytes);
+			}
+			else {
+				auto msg = fmt::format("Logical Quotas Policy: Invalid recalculation mode [{}].", mode);
+				log::rule_engine::error(msg);
+				constexpr auto ec = SYS_INVALID_INPUT_PARAM;
+				addRErrorMsg(&get_rei(_effect_handler).rsComm->rError, ec, msg.c_str());
+				return ERROR(ec, std::move(msg));
+			}
 
-			fs::client::set_metadata(
-				fs::admin, conn, path, {attrs.total_number_of_data_objects(), objects.empty() ? "0" : objects});
+			invalidate_cached_information(config, path);
 		}
 		catch (const irods::exception& e) {
 			return log_irods_exception(e, _effect_handler);
@@ -621,35 +3437,32 @@ namespace irods::handler
 		return SUCCESS();
 	}
 
-	auto logical_quotas_count_total_size_in_bytes(const std::string& _instance_name,
-	                                              const instance_configuration_map& _instance_configs,
-	                                              std::list<boost::any>& _rule_arguments,
-	                                              MsParamArray* _ms_param_array,
-	                                              irods::callback& _effect_handler) -> irods::error
+	auto logical_quotas_recalculate_all(const std::string& _instance_name,
+	                                    const instance_configuration_map& _instance_configs,
+	                                    std::list<boost::any>& _rule_arguments,
+	                                    MsParamArray* _ms_param_array,
+	                                    irods::callback& _effect_handler) -> irods::error
 	{
 		try {
-			auto args_iter = std::begin(_rule_arguments);
-			const auto& path = *boost::any_cast<std::string*>(*args_iter);
-			std::vector args{path + '%'};
-			irods::experimental::client_connection conn;
-
-			auto query = irods::experimental::query_builder{}
-#if IRODS_VERSION_INTEGER < 5000090
-			                 .type(irods::experimental::query_type::specific)
-#else
-			                 .type(irods::query_type::specific)
-#endif
-			                 .bind_arguments(args)
-			                 .build<RcComm>(conn, "logical_quotas_sum_data_object_sizes_recursive");
-
-			std::string bytes;
-			for (auto&& row : query) {
-				bytes = row[0];
-			}
-
-			const auto& attrs = get_instance_config(_instance_configs, _instance_name).attributes();
-
-			fs::client::set_metadata(fs::admin, conn, path, {attrs.total_size_in_bytes(), bytes.empty() ? "0" : bytes});
+			// The collection is optional. When not provided, every monitored collection in the zone
+			// is recalculated.
+			const auto& collection = *boost::any_cast<std::string*>(*std::begin(_rule_arguments));
+			const fs::path root = collection.empty() ? "/" : collection;
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
+			auto& conn = irods::connection_manager::get();
+
+			// Write any changes held in memory first. Otherwise, they would be applied on top of
+			// the recalculated totals.
+			write_pending_quota_updates(conn, config);
+
+			const auto [monitored, updated] = recalculate_all_totals(conn, config, root);
+			invalidate_cached_information_for_tree(config, root.string());
+
+			log::rule_engine::info("Logical Quotas Policy: Recalculated totals of [{}] monitored collection(s) under "
+			                       "[{}]. [{}] collection(s) were updated.",
+			                       monitored,
+			                       root.c_str(),
+			                       updated);
 		}
 		catch (const irods::exception& e) {
 			return log_irods_exception(e, _effect_handler);
@@ -661,21 +3474,31 @@ namespace irods::handler
 		return SUCCESS();
 	}
 
-	auto logical_quotas_recalculate_totals(const std::string& _instance_name,
-	                                       const instance_configuration_map& _instance_configs,
-	                                       std::list<boost::any>& _rule_arguments,
-	                                       MsParamArray* _ms_param_array,
-	                                       irods::callback& _effect_handler) -> irods::error
+	auto logical_quotas_replay_journal(const std::string& _instance_name,
+	                                   const instance_configuration_map& _instance_configs,
+	                                   std::list<boost::any>& _rule_arguments,
+	                                   MsParamArray* _ms_param_array,
+	                                   irods::callback& _effect_handler) -> irods::error
 	{
-		auto functions = {logical_quotas_count_total_number_of_data_objects, logical_quotas_count_total_size_in_bytes};
+		try {
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
 
-		for (auto&& f : functions) {
-			if (const auto error =
-			        f(_instance_name, _instance_configs, _rule_arguments, _ms_param_array, _effect_handler);
-			    !error.ok())
-			{
-				return error;
+			if (!config.journal()) {
+				auto msg = std::string{"Logical Quotas Policy: The journal is not enabled."};
+				log::rule_engine::error(msg);
+				constexpr auto ec = SYS_INVALID_INPUT_PARAM;
+				addRErrorMsg(&get_rei(_effect_handler).rsComm->rError, ec, msg.c_str());
+				return ERROR(ec, std::move(msg));
 			}
+
+			const auto replayed = replay_orphaned_journals(irods::connection_manager::get(), config);
+			log::rule_engine::info(fmt::format("Logical Quotas Policy: Replayed [{}] journal(s).", replayed));
+		}
+		catch (const irods::exception& e) {
+			return log_irods_exception(e, _effect_handler);
+		}
+		catch (const std::exception& e) {
+			return log_exception(e, _effect_handler);
 		}
 
 		return SUCCESS();
@@ -695,10 +3518,12 @@ namespace irods::handler
 			const auto msg = fmt::format(
 				"Logical Quotas Policy: Invalid value for maximum number of data objects [{}]", max_objects);
 			throw_if_string_cannot_be_cast_to_an_integer(max_objects, msg);
-			const auto& attrs = get_instance_config(_instance_configs, _instance_name).attributes();
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
+			const auto& attrs = config.attributes();
 
-			irods::experimental::client_connection conn;
-			fs::client::set_metadata(fs::admin, conn, path, {attrs.maximum_number_of_data_objects(), max_objects});
+			auto& conn = irods::connection_manager::get();
+			set_collection_metadata(conn, path, attrs.maximum_number_of_data_objects(), max_objects);
+			invalidate_cached_information(config, path);
 		}
 		catch (const irods::exception& e) {
 			return log_irods_exception(e, _effect_handler);
@@ -724,10 +3549,12 @@ namespace irods::handler
 			const auto msg =
 				fmt::format("Logical Quotas Policy: Invalid value for maximum size in bytes [{}]", max_bytes);
 			throw_if_string_cannot_be_cast_to_an_integer(max_bytes, msg);
-			const auto& attrs = get_instance_config(_instance_configs, _instance_name).attributes();
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
+			const auto& attrs = config.attributes();
 
-			irods::experimental::client_connection conn;
-			fs::client::set_metadata(fs::admin, conn, path, {attrs.maximum_size_in_bytes(), max_bytes});
+			auto& conn = irods::connection_manager::get();
+			set_collection_metadata(conn, path, attrs.maximum_size_in_bytes(), max_bytes);
+			invalidate_cached_information(config, path);
 		}
 		catch (const irods::exception& e) {
 			return log_irods_exception(e, _effect_handler);
@@ -803,8 +3630,14 @@ namespace irods::handler
 
 		try {
 			auto* input = get_pointer<dataObjCopyInp_t>(_rule_arguments);
-			const auto& attrs = get_instance_config(_instance_configs, _instance_name).attributes();
-			irods::experimental::client_connection conn;
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
+
+			if (!may_be_monitored(config, input->destDataObjInp.objPath)) {
+				return CODE(RULE_ENGINE_CONTINUE);
+			}
+
+			const auto& attrs = config.attributes();
+			auto& conn = irods::connection_manager::get();
 
 			if (const auto status = fs::client::status(conn, input->srcDataObjInp.objPath);
 			    fs::client::is_data_object(status))
@@ -814,16 +3647,16 @@ namespace irods::handler
 			}
 			else if (fs::client::is_collection(status)) {
 				std::tie(data_objects_, size_in_bytes_) =
-					compute_data_object_count_and_size(conn, input->srcDataObjInp.objPath);
+					compute_data_object_count_and_size(conn, config, input->srcDataObjInp.objPath);
 			}
 			else {
 				throw logical_quotas_error{"Logical Quotas Policy: Invalid object type", INVALID_OBJECT_TYPE};
 			}
 
 			for_each_monitored_collection(
-				conn, attrs, input->destDataObjInp.objPath, [&conn, &attrs](auto& _collection, const auto& _info) {
-					throw_if_maximum_number_of_data_objects_violation(attrs, _info, data_objects_);
-					throw_if_maximum_size_in_bytes_violation(attrs, _info, size_in_bytes_);
+				conn, config, input->destDataObjInp.objPath, [&conn, &attrs](const auto& _collection) {
+					throw_if_maximum_number_of_data_objects_violation(attrs, _collection.info, data_objects_);
+					throw_if_maximum_size_in_bytes_violation(attrs, _collection.info, size_in_bytes_);
 				});
 		}
 		catch (const logical_quotas_error& e) {
@@ -847,14 +3680,19 @@ namespace irods::handler
 	{
 		try {
 			auto* input = get_pointer<dataObjCopyInp_t>(_rule_arguments);
-			const auto& attrs = get_instance_config(_instance_configs, _instance_name).attributes();
-			irods::experimental::client_connection conn;
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
+
+			if (!may_be_monitored(config, input->destDataObjInp.objPath)) {
+				return CODE(RULE_ENGINE_CONTINUE);
+			}
+
+			auto& conn = irods::connection_manager::get();
 			for_each_monitored_collection(conn,
-			                              attrs,
+			                              config,
 			                              input->destDataObjInp.objPath,
-			                              [&conn, &attrs](const auto& _collection, const auto& _info) {
+			                              [&conn, &config](const auto& _collection) {
 											  update_data_object_count_and_size(
-												  conn, attrs, _collection, _info, data_objects_, size_in_bytes_);
+												  conn, config, _collection, data_objects_, size_in_bytes_);
 										  });
 		}
 		catch (const irods::exception& e) {
@@ -875,11 +3713,13 @@ namespace irods::handler
 	{
 		try {
 			auto* input = get_pointer<dataObjInp_t>(_rule_arguments);
-			const auto& attrs = get_instance_config(_instance_configs, _instance_name).attributes();
-			irods::experimental::client_connection conn;
-			for_each_monitored_collection(conn, attrs, input->objPath, [&attrs, input](auto&, auto& _info) {
-				throw_if_maximum_number_of_data_objects_violation(attrs, _info, 1);
-			});
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
+
+			if (!may_be_monitored(config, input->objPath)) {
+				return CODE(RULE_ENGINE_CONTINUE);
+			}
+
+			admit_change(irods::connection_manager::get(), config, input->objPath, 1, 0);
 		}
 		catch (const logical_quotas_error& e) {
 			return log_logical_quotas_exception(e, _effect_handler);
@@ -902,14 +3742,20 @@ namespace irods::handler
 	{
 		try {
 			auto* input = get_pointer<dataObjInp_t>(_rule_arguments);
-			const auto& attrs = get_instance_config(_instance_configs, _instance_name).attributes();
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
+
+			if (!may_be_monitored(config, input->objPath)) {
+				return CODE(RULE_ENGINE_CONTINUE);
+			}
 
-			irods::experimental::client_connection conn;
+			auto& conn = irods::connection_manager::get();
 
 			for_each_monitored_collection(
-				conn, attrs, input->objPath, [&conn, &attrs, input](const auto& _collection, const auto& _info) {
-					update_data_object_count_and_size(conn, attrs, _collection, _info, 1, 0);
+				conn, config, input->objPath, [&conn, &config, input](const auto& _collection) {
+					update_data_object_count_and_size(conn, config, _collection, 1, 0);
 				});
+
+			release_reservations(config);
 		}
 		catch (const irods::exception& e) {
 			return log_irods_exception(e, _effect_handler);
@@ -921,6 +3767,22 @@ namespace irods::handler
 		return CODE(RULE_ENGINE_CONTINUE);
 	}
 
+	auto pep_api_release_reservations(const std::string& _instance_name,
+	                                  const instance_configuration_map& _instance_configs,
+	                                  std::list<boost::any>& _rule_arguments,
+	                                  MsParamArray* _ms_param_array,
+	                                  irods::callback& _effect_handler) -> irods::error
+	{
+		try {
+			release_reservations(get_instance_config(_instance_configs, _instance_name));
+		}
+		catch (const std::exception& e) {
+			return log_exception(e, _effect_handler);
+		}
+
+		return CODE(RULE_ENGINE_CONTINUE);
+	}
+
 	auto pep_api_data_obj_put::reset() noexcept -> void
 	{
 		size_diff_ = 0;
@@ -937,24 +3799,23 @@ namespace irods::handler
 
 		try {
 			auto* input = get_pointer<dataObjInp_t>(_rule_arguments);
-			const auto& attrs = get_instance_config(_instance_configs, _instance_name).attributes();
-			irods::experimental::client_connection conn;
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
+
+			if (!may_be_monitored(config, input->objPath)) {
+				return CODE(RULE_ENGINE_CONTINUE);
+			}
+
+			auto& conn = irods::connection_manager::get();
 
 			if (fs::client::exists(conn, input->objPath)) {
 				forced_overwrite_ = true;
 				const size_type existing_size = fs::client::data_object_size(conn, input->objPath);
 				size_diff_ = static_cast<size_type>(input->dataSize) - existing_size;
 
-				for_each_monitored_collection(
-					conn, attrs, input->objPath, [&conn, &attrs, input](const auto& _collection, auto& _info) {
-						throw_if_maximum_size_in_bytes_violation(attrs, _info, size_diff_);
-					});
+				admit_change(conn, config, input->objPath, 0, size_diff_);
 			}
 			else {
-				for_each_monitored_collection(conn, attrs, input->objPath, [&attrs, input](auto&, auto& _info) {
-					throw_if_maximum_number_of_data_objects_violation(attrs, _info, 1);
-					throw_if_maximum_size_in_bytes_violation(attrs, _info, input->dataSize);
-				});
+				admit_change(conn, config, input->objPath, 1, input->dataSize);
 			}
 		}
 		catch (const logical_quotas_error& e) {
@@ -978,21 +3839,28 @@ namespace irods::handler
 	{
 		try {
 			auto* input = get_pointer<dataObjInp_t>(_rule_arguments);
-			const auto& attrs = get_instance_config(_instance_configs, _instance_name).attributes();
-			irods::experimental::client_connection conn;
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
+
+			if (!may_be_monitored(config, input->objPath)) {
+				return CODE(RULE_ENGINE_CONTINUE);
+			}
+
+			auto& conn = irods::connection_manager::get();
 
 			if (forced_overwrite_) {
 				for_each_monitored_collection(
-					conn, attrs, input->objPath, [&conn, &attrs, input](const auto& _collection, const auto& _info) {
-						update_data_object_count_and_size(conn, attrs, _collection, _info, 0, size_diff_);
+					conn, config, input->objPath, [&conn, &config, input](const auto& _collection) {
+						update_data_object_count_and_size(conn, config, _collection, 0, size_diff_);
 					});
 			}
 			else {
 				for_each_monitored_collection(
-					conn, attrs, input->objPath, [&conn, &attrs, input](const auto& _collection, const auto& _info) {
-						update_data_object_count_and_size(conn, attrs, _collection, _info, 1, input->dataSize);
+					conn, config, input->objPath, [&conn, &config, input](const auto& _collection) {
+						update_data_object_count_and_size(conn, config, _collection, 1, input->dataSize);
 					});
 			}
+
+			release_reservations(config);
 		}
 		catch (const irods::exception& e) {
 			return log_irods_exception(e, _effect_handler);
@@ -1028,8 +3896,16 @@ namespace irods::handler
 				return CODE(RULE_ENGINE_CONTINUE);
 			}
 
-			const auto& attrs = get_instance_config(_instance_configs, _instance_name).attributes();
-			irods::experimental::client_connection conn;
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
+
+			if (!may_be_monitored(config, input->srcDataObjInp.objPath) &&
+			    !may_be_monitored(config, input->destDataObjInp.objPath))
+			{
+				return CODE(RULE_ENGINE_CONTINUE);
+			}
+
+			const auto& attrs = config.attributes();
+			auto& conn = irods::connection_manager::get();
 
 			if (const auto status = fs::client::status(conn, input->srcDataObjInp.objPath);
 			    fs::client::is_data_object(status))
@@ -1039,19 +3915,19 @@ namespace irods::handler
 			}
 			else if (fs::client::is_collection(status)) {
 				std::tie(data_objects_, size_in_bytes_) =
-					compute_data_object_count_and_size(conn, input->srcDataObjInp.objPath);
+					compute_data_object_count_and_size(conn, config, input->srcDataObjInp.objPath);
 			}
 			else {
 				throw logical_quotas_error{"Logical Quotas Policy: Invalid object type", INVALID_OBJECT_TYPE};
 			}
 
-			const auto in_violation = [&](const auto&, const auto& _info) {
-				throw_if_maximum_number_of_data_objects_violation(attrs, _info, data_objects_);
-				throw_if_maximum_size_in_bytes_violation(attrs, _info, size_in_bytes_);
+			const auto in_violation = [&](const auto& _collection) {
+				throw_if_maximum_number_of_data_objects_violation(attrs, _collection.info, data_objects_);
+				throw_if_maximum_size_in_bytes_violation(attrs, _collection.info, size_in_bytes_);
 			};
 
-			auto src_path = get_monitored_parent_collection(conn, attrs, input->srcDataObjInp.objPath);
-			auto dst_path = get_monitored_parent_collection(conn, attrs, input->destDataObjInp.objPath);
+			auto src_path = get_monitored_parent_collection(conn, config, input->srcDataObjInp.objPath);
+			auto dst_path = get_monitored_parent_collection(conn, config, input->destDataObjInp.objPath);
 
 			if (src_path && dst_path) {
 				if (*src_path == *dst_path) {
@@ -1061,30 +3937,30 @@ namespace irods::handler
 				// Moving object(s) from a parent collection to a child collection.
 				if (parent_path{*src_path}.of(*dst_path)) {
 					for_each_monitored_collection(
-						conn, attrs, input->destDataObjInp.objPath, [&](const auto& _collection, const auto& _info) {
+						conn, config, input->destDataObjInp.objPath, [&](const auto& _collection) {
 							// Return immediately if "_collection" is equal to "*src_path". At this point,
 						    // there is no need to check if any quotas will be violated. The totals will not
 						    // change for parents of the source collection.
-							if (_collection == *src_path) {
+							if (_collection.path == *src_path) {
 								return;
 							}
 
-							throw_if_maximum_number_of_data_objects_violation(attrs, _info, data_objects_);
-							throw_if_maximum_size_in_bytes_violation(attrs, _info, size_in_bytes_);
+							throw_if_maximum_number_of_data_objects_violation(attrs, _collection.info, data_objects_);
+							throw_if_maximum_size_in_bytes_violation(attrs, _collection.info, size_in_bytes_);
 						});
 				}
 				// Moving object(s) from a child collection to a parent collection.
 				else if (parent_path{*dst_path}.of(*src_path)) {
-					for_each_monitored_collection(conn, attrs, input->destDataObjInp.objPath, in_violation);
+					for_each_monitored_collection(conn, config, input->destDataObjInp.objPath, in_violation);
 				}
 				// Moving objects(s) between unrelated collection trees.
 				else {
-					for_each_monitored_collection(conn, attrs, input->destDataObjInp.objPath, in_violation);
+					for_each_monitored_collection(conn, config, input->destDataObjInp.objPath, in_violation);
 				}
 			}
 			else if (dst_path) {
 				using namespace std::string_literals;
-				for_each_monitored_collection(conn, attrs, input->destDataObjInp.objPath, in_violation);
+				for_each_monitored_collection(conn, config, input->destDataObjInp.objPath, in_violation);
 			}
 		}
 		catch (const logical_quotas_error& e) {
@@ -1106,18 +3982,29 @@ namespace irods::handler
 	                                   MsParamArray* _ms_param_array,
 	                                   irods::callback& _effect_handler) -> irods::error
 	{
-		// There is no change in state, therefore return immediately.
-		if (0 == data_objects_ && 0 == size_in_bytes_) {
-			return CODE(RULE_ENGINE_CONTINUE);
-		}
-
 		try {
 			auto* input = get_pointer<dataObjCopyInp_t>(_rule_arguments);
-			const auto& attrs = get_instance_config(_instance_configs, _instance_name).attributes();
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
+			const auto& attrs = config.attributes();
+
+			// The source path no longer exists. Any cached path under it is now invalid. The quota
+			// information of the collections which were moved is still valid.
+			invalidate_cached_paths_for_tree(config, input->srcDataObjInp.objPath);
 
-			irods::experimental::client_connection conn;
-			auto src_path = get_monitored_parent_collection(conn, attrs, input->srcDataObjInp.objPath);
-			auto dst_path = get_monitored_parent_collection(conn, attrs, input->destDataObjInp.objPath);
+			// There is no change in state, therefore return immediately.
+			if (0 == data_objects_ && 0 == size_in_bytes_) {
+				return CODE(RULE_ENGINE_CONTINUE);
+			}
+
+			if (!may_be_monitored(config, input->srcDataObjInp.objPath) &&
+			    !may_be_monitored(config, input->destDataObjInp.objPath))
+			{
+				return CODE(RULE_ENGINE_CONTINUE);
+			}
+
+			auto& conn = irods::connection_manager::get();
+			auto src_path = get_monitored_parent_collection(conn, config, input->srcDataObjInp.objPath);
+			auto dst_path = get_monitored_parent_collection(conn, config, input->destDataObjInp.objPath);
 
 			// Cases
 			// ~~~~~
@@ -1147,41 +4034,41 @@ namespace irods::handler
 
 				// Moving object(s) from a parent collection to a child collection.
 				if (parent_path{*src_path}.of(*dst_path)) {
-					auto info = get_monitored_collection_info(conn, attrs, *dst_path);
-					update_data_object_count_and_size(conn, attrs, *dst_path, info, data_objects_, size_in_bytes_);
+					const auto collection = get_monitored_collection(conn, attrs, *dst_path);
+					update_data_object_count_and_size(conn, config, collection, data_objects_, size_in_bytes_);
 				}
 				// Moving object(s) from a child collection to a parent collection.
 				else if (parent_path{*dst_path}.of(*src_path)) {
-					auto info = get_monitored_collection_info(conn, attrs, *src_path);
-					update_data_object_count_and_size(conn, attrs, *src_path, info, -data_objects_, -size_in_bytes_);
+					const auto collection = get_monitored_collection(conn, attrs, *src_path);
+					update_data_object_count_and_size(conn, config, collection, -data_objects_, -size_in_bytes_);
 				}
 				// Moving objects(s) between unrelated collection trees.
 				else {
 					for_each_monitored_collection(
-						conn, attrs, input->destDataObjInp.objPath, [&](const auto& _collection, const auto& _info) {
+						conn, config, input->destDataObjInp.objPath, [&](const auto& _collection) {
 							update_data_object_count_and_size(
-								conn, attrs, _collection, _info, data_objects_, size_in_bytes_);
+								conn, config, _collection, data_objects_, size_in_bytes_);
 						});
 
 					for_each_monitored_collection(
-						conn, attrs, input->srcDataObjInp.objPath, [&](const auto& _collection, const auto& _info) {
+						conn, config, input->srcDataObjInp.objPath, [&](const auto& _collection) {
 							update_data_object_count_and_size(
-								conn, attrs, _collection, _info, -data_objects_, -size_in_bytes_);
+								conn, config, _collection, -data_objects_, -size_in_bytes_);
 						});
 				}
 			}
 			else if (src_path) {
 				for_each_monitored_collection(
-					conn, attrs, input->srcDataObjInp.objPath, [&](const auto& _collection, const auto& _info) {
+					conn, config, input->srcDataObjInp.objPath, [&](const auto& _collection) {
 						update_data_object_count_and_size(
-							conn, attrs, _collection, _info, -data_objects_, -size_in_bytes_);
+							conn, config, _collection, -data_objects_, -size_in_bytes_);
 					});
 			}
 			else if (dst_path) {
 				for_each_monitored_collection(
-					conn, attrs, input->destDataObjInp.objPath, [&](const auto& _collection, const auto& _info) {
+					conn, config, input->destDataObjInp.objPath, [&](const auto& _collection) {
 						update_data_object_count_and_size(
-							conn, attrs, _collection, _info, data_objects_, size_in_bytes_);
+							conn, config, _collection, data_objects_, size_in_bytes_);
 					});
 			}
 		}
@@ -1213,10 +4100,15 @@ namespace irods::handler
 
 		try {
 			auto* input = get_pointer<dataObjInp_t>(_rule_arguments);
-			const auto& attrs = get_instance_config(_instance_configs, _instance_name).attributes();
-			irods::experimental::client_connection conn;
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
 
-			if (auto collection = get_monitored_parent_collection(conn, attrs, input->objPath); collection) {
+			if (!may_be_monitored(config, input->objPath)) {
+				return CODE(RULE_ENGINE_CONTINUE);
+			}
+
+			auto& conn = irods::connection_manager::get();
+
+			if (auto collection = get_monitored_parent_collection(conn, config, input->objPath); collection) {
 				try {
 					size_in_bytes_ = fs::client::data_object_size(conn, input->objPath);
 				}
@@ -1260,11 +4152,16 @@ namespace irods::handler
 	{
 		try {
 			auto* input = get_pointer<dataObjInp_t>(_rule_arguments);
-			const auto& attrs = get_instance_config(_instance_configs, _instance_name).attributes();
-			irods::experimental::client_connection conn;
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
+
+			if (!may_be_monitored(config, input->objPath)) {
+				return CODE(RULE_ENGINE_CONTINUE);
+			}
+
+			auto& conn = irods::connection_manager::get();
 			for_each_monitored_collection(
-				conn, attrs, input->objPath, [&conn, &attrs, input](const auto& _collection, const auto& _info) {
-					update_data_object_count_and_size(conn, attrs, _collection, _info, -1, -size_in_bytes_);
+				conn, config, input->objPath, [&conn, &config, input](const auto& _collection) {
+					update_data_object_count_and_size(conn, config, _collection, -1, -size_in_bytes_);
 				});
 		}
 		catch (const irods::exception& e) {
@@ -1285,30 +4182,44 @@ namespace irods::handler
 	{
 		try {
 			auto* input = get_pointer<dataObjInp_t>(_rule_arguments);
-			const auto& attrs = get_instance_config(_instance_configs, _instance_name).attributes();
-			irods::experimental::client_connection conn;
+			const auto creating = (O_CREAT == (input->openFlags & O_CREAT));
 
-			if (O_CREAT == (input->openFlags & O_CREAT)) {
-				if (!fs::client::exists(conn, input->objPath)) {
-					for_each_monitored_collection(conn, attrs, input->objPath, [&attrs, input](auto&, auto& _info) {
-						throw_if_maximum_number_of_data_objects_violation(attrs, _info, 1);
-					});
-				}
-			}
 			// Opening an existing data object for reading is fine as long as it does not result in
 			// the creation of a new data object.
-			else if (O_RDONLY == (input->openFlags & O_ACCMODE)) {
+			if (!creating && O_RDONLY == (input->openFlags & O_ACCMODE)) {
+				return CODE(RULE_ENGINE_CONTINUE);
+			}
+
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
+
+			if (!may_be_monitored(config, input->objPath)) {
 				return CODE(RULE_ENGINE_CONTINUE);
 			}
 
+			const auto& attrs = config.attributes();
+			auto& conn = irods::connection_manager::get();
+			const auto creates_data_object = creating && !fs::client::exists(conn, input->objPath);
+
+			if (creates_data_object) {
+				for_each_monitored_collection(conn, config, input->objPath, [&attrs, input](const auto& _collection) {
+					throw_if_maximum_number_of_data_objects_violation(attrs, _collection.info, 1);
+				});
+			}
+
 			// Because streaming operations can result in byte quotas being exceeded, the REP must
 			// verify that the quotas have not been violated by a previous streaming operation. This
 			// is because the REP does not track bytes written during streaming operations.
-			for_each_monitored_collection(conn, attrs, input->objPath, [&attrs, input](auto&, auto& _info) {
+			for_each_monitored_collection(conn, config, input->objPath, [&attrs, input](const auto& _collection) {
 				// We only need to check the byte count here. If the rest of the REP is implemented
 				// correctly, then the data object count should be in line already.
-				throw_if_maximum_size_in_bytes_violation(attrs, _info, 0);
+				throw_if_maximum_size_in_bytes_violation(attrs, _collection.info, 0);
 			});
+
+			// Only recorded once the open is admitted. If the open fails anyway, the except-PEP
+			// removes the path again.
+			if (creates_data_object) {
+				data_objects_pending_creation.insert(input->objPath);
+			}
 		}
 		catch (const logical_quotas_error& e) {
 			return log_logical_quotas_exception(e, _effect_handler);
@@ -1323,9 +4234,27 @@ namespace irods::handler
 		return CODE(RULE_ENGINE_CONTINUE);
 	}
 
+	auto pep_api_data_obj_open_except(const std::string& _instance_name,
+	                                  const instance_configuration_map& _instance_configs,
+	                                  std::list<boost::any>& _rule_arguments,
+	                                  MsParamArray* _ms_param_array,
+	                                  irods::callback& _effect_handler) -> irods::error
+	{
+		try {
+			data_objects_pending_creation.erase(get_pointer<dataObjInp_t>(_rule_arguments)->objPath);
+		}
+		catch (const std::exception& e) {
+			return log_exception(e, _effect_handler);
+		}
+
+		return CODE(RULE_ENGINE_CONTINUE);
+	}
+
 	auto pep_api_data_obj_close::reset() noexcept -> void
 	{
 		path_.clear();
+		data_objects_ = 0;
+		size_in_bytes_ = 0;
 	}
 
 	auto pep_api_data_obj_close::pre(const std::string& _instance_name,
@@ -1348,6 +4277,23 @@ namespace irods::handler
 			}
 
 			path_ = l1desc.dataObjInfo->objPath;
+
+			// The data object count only changes if the open created the data object.
+			if (data_objects_pending_creation.erase(path_) > 0 && CREATE_TYPE == l1desc.openType) {
+				data_objects_ = 1;
+			}
+
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
+
+			// Clearing the path tells the post-PEP there is nothing to do.
+			if (!may_be_monitored(config, path_)) {
+				path_.clear();
+				return CODE(RULE_ENGINE_CONTINUE);
+			}
+
+			if (!config.options().recalculate_totals_on_close) {
+				size_in_bytes_ = get_size_of_data_object_before_write(irods::connection_manager::get(), l1desc);
+			}
 		}
 		catch (const irods::exception& e) {
 			return log_irods_exception(e, _effect_handler);
@@ -1373,19 +4319,78 @@ namespace irods::handler
 				return CODE(RULE_ENGINE_CONTINUE);
 			}
 
-			const auto& attrs = get_instance_config(_instance_configs, _instance_name).attributes();
-			irods::experimental::client_connection conn;
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
+
+			if (config.options().recalculate_totals_on_close) {
+				recalculate_totals_on_close(_instance_name, _instance_configs, path_, _ms_param_array, _effect_handler);
+			}
+			else {
+				update_totals_on_close(irods::connection_manager::get(), config, path_, data_objects_, size_in_bytes_);
+			}
+		}
+		catch (const irods::exception& e) {
+			return log_irods_exception(e, _effect_handler);
+		}
+		catch (const std::exception& e) {
+			return log_exception(e, _effect_handler);
+		}
+
+		return CODE(RULE_ENGINE_CONTINUE);
+	}
+
+	auto pep_api_mod_avu_metadata_post(const std::string& _instance_name,
+	                                   const instance_configuration_map& _instance_configs,
+	                                   std::list<boost::any>& _rule_arguments,
+	                                   MsParamArray* _ms_param_array,
+	                                   irods::callback& _effect_handler) -> irods::error
+	{
+		try {
+			const auto* input = get_pointer<modAVUMetadataInp_t>(_rule_arguments);
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
+
+			// Any change to the metadata of a collection may change its monitored status or quota
+			// limits. Drop the cached information so that it is fetched again on next use. The shared
+			// table only needs to be reloaded if the operation may touch one of the quota attributes.
+			// This happens after the change has been committed; invalidating the shared table any
+			// earlier would allow another agent to reload it from the catalog's old state.
+			if (const std::string_view type = input->arg1; "-C" == type || "-c" == type) {
+				const auto& attrs = config.attributes();
+				const std::string_view op = input->arg0;
+				const std::string_view attr_name = input->arg3 ? input->arg3 : "";
+
+				// Changing the value of a total (e.g. the compare-and-swap performed by the plugin)
+				// neither changes whether the collection is monitored nor its limits, so the shared
+				// table remains valid.
+				const auto changes_value_of_total_only = [&] {
+					if ("mod" != op ||
+					    (attrs.total_number_of_data_objects() != attr_name && attrs.total_size_in_bytes() != attr_name))
+					{
+						return false;
+					}
 
-			for_each_monitored_collection(conn, attrs, path_, [&](auto& _collection, const auto& _info) {
-				std::string p = fs::path{path_}.parent_path();
-				std::list<boost::any> args{&p};
-				const auto err = logical_quotas_recalculate_totals(
-					_instance_name, _instance_configs, args, _ms_param_array, _effect_handler);
+					for (const char* arg : {input->arg5, input->arg6, input->arg7, input->arg8}) {
+						if (arg && std::string_view{arg}.starts_with("n:")) {
+							return false;
+						}
+					}
+
+					return true;
+				};
 
-				if (!err.ok()) {
-					THROW(err.code(), err.result());
+				if (changes_value_of_total_only()) {
+					config.cache().erase(input->arg2);
 				}
-			});
+				else if ("rmw" == op || "rmi" == op || "cp" == op ||
+				         attrs.maximum_number_of_data_objects() == attr_name ||
+				         attrs.maximum_size_in_bytes() == attr_name ||
+				         attrs.total_number_of_data_objects() == attr_name || attrs.total_size_in_bytes() == attr_name)
+				{
+					invalidate_cached_information(config, input->arg2);
+				}
+				else {
+					config.cache().erase(input->arg2);
+				}
+			}
 		}
 		catch (const irods::exception& e) {
 			return log_irods_exception(e, _effect_handler);
@@ -1405,13 +4410,13 @@ namespace irods::handler
 	{
 		try {
 			const auto* input = get_pointer<modAVUMetadataInp_t>(_rule_arguments);
-			irods::experimental::client_connection conn;
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
 
-			if (std::string_view{"add"} != input->arg0 || !fs::client::is_collection(conn, input->arg2)) {
+			if (std::string_view{"add"} != input->arg0) {
 				return CODE(RULE_ENGINE_CONTINUE);
 			}
 
-			const auto& attrs = get_instance_config(_instance_configs, _instance_name).attributes();
+			const auto& attrs = config.attributes();
 			const auto attr_list = {&attrs.maximum_number_of_data_objects(),
 			                        &attrs.maximum_size_in_bytes(),
 			                        &attrs.total_number_of_data_objects(),
@@ -1420,17 +4425,28 @@ namespace irods::handler
 			const auto iter = std::find_if(
 				std::begin(attr_list),
 				std::end(attr_list),
-				[attr_name = std::string_view{input->arg3}](const std::string* _attr) { return *_attr == attr_name; });
+				[attr_name = std::string_view{input->arg3 ? input->arg3 : ""}](const std::string* _attr) {
+					return *_attr == attr_name;
+				});
 
-			if (iter != std::end(attr_list)) {
-				const auto gql = fmt::format("select META_COLL_ATTR_NAME "
-				                             "where COLL_NAME = '{}' and META_COLL_ATTR_NAME = '{}'",
-				                             irods::single_quotes_to_hex(input->arg2),
-				                             **iter);
+			// Only the attributes owned by the plugin are of interest.
+			if (iter == std::end(attr_list)) {
+				return CODE(RULE_ENGINE_CONTINUE);
+			}
 
-				if (irods::query{static_cast<RcComm*>(conn), gql}.size() > 0) {
-					return ERROR(SYS_NOT_ALLOWED, "Logical Quotas Policy: Metadata attribute name already defined.");
-				}
+			auto& conn = irods::connection_manager::get();
+
+			if (!fs::client::is_collection(conn, input->arg2)) {
+				return CODE(RULE_ENGINE_CONTINUE);
+			}
+
+			const auto gql = fmt::format("select META_COLL_ATTR_NAME "
+			                             "where COLL_NAME = '{}' and META_COLL_ATTR_NAME = '{}'",
+			                             irods::single_quotes_to_hex(input->arg2),
+			                             **iter);
+
+			if (make_query(conn, gql).size() > 0) {
+				return ERROR(SYS_NOT_ALLOWED, "Logical Quotas Policy: Metadata attribute name already defined.");
 			}
 		}
 		catch (const irods::exception& e) {
@@ -1446,6 +4462,8 @@ namespace irods::handler
 	auto pep_api_replica_close::reset() noexcept -> void
 	{
 		path_.clear();
+		data_objects_ = 0;
+		size_in_bytes_ = 0;
 	}
 
 	auto pep_api_replica_close::pre(const std::string& _instance_name,
@@ -1459,6 +4477,15 @@ namespace irods::handler
 		try {
 			auto* input = get_pointer<BytesBuf>(_rule_arguments);
 			const auto json_input = nlohmann::json::parse(std::string_view(static_cast<char*>(input->buf), input->len));
+
+			// With parallel transfers, each thread opens and closes the replica through its own
+			// agent. Only the close which finalizes the replica updates its size and status in the
+			// catalog. The other closes leave the catalog untouched, so there is nothing to account
+			// for. Both properties default to true when they are not passed.
+			if (!json_input.value("update_size", true) && !json_input.value("update_status", true)) {
+				return CODE(RULE_ENGINE_CONTINUE);
+			}
+
 			const auto& l1desc = irods::get_l1desc(json_input.at("fd").get<int>());
 
 			// Return immediately if the client opened an existing data object for reading.
@@ -1469,6 +4496,23 @@ namespace irods::handler
 			}
 
 			path_ = l1desc.dataObjInfo->objPath;
+
+			// The data object count only changes if the open created the data object.
+			if (data_objects_pending_creation.erase(path_) > 0 && CREATE_TYPE == l1desc.openType) {
+				data_objects_ = 1;
+			}
+
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
+
+			// Clearing the path tells the post-PEP there is nothing to do.
+			if (!may_be_monitored(config, path_)) {
+				path_.clear();
+				return CODE(RULE_ENGINE_CONTINUE);
+			}
+
+			if (!config.options().recalculate_totals_on_close) {
+				size_in_bytes_ = get_size_of_data_object_before_write(irods::connection_manager::get(), l1desc);
+			}
 		}
 		catch (const irods::exception& e) {
 			return log_irods_exception(e, _effect_handler);
@@ -1488,25 +4532,20 @@ namespace irods::handler
 	{
 		try {
 			// If the path is empty, either the pre-PEP detected that the client opened an
-			// existing data object for reading and returned early, or an error occurred.
-			// This avoids unnecessary catalog updates.
+			// existing data object for reading or that the close does not finalize the replica
+			// and returned early, or an error occurred. This avoids unnecessary catalog updates.
 			if (path_.empty()) {
 				return CODE(RULE_ENGINE_CONTINUE);
 			}
 
-			const auto& attrs = get_instance_config(_instance_configs, _instance_name).attributes();
-			irods::experimental::client_connection conn;
-
-			for_each_monitored_collection(conn, attrs, path_, [&](auto& _collection, const auto& _info) {
-				std::string p = _collection.string();
-				std::list<boost::any> args{&p};
-				const auto err = logical_quotas_recalculate_totals(
-					_instance_name, _instance_configs, args, _ms_param_array, _effect_handler);
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
 
-				if (!err.ok()) {
-					THROW(err.code(), err.result());
-				}
-			});
+			if (config.options().recalculate_totals_on_close) {
+				recalculate_totals_on_close(_instance_name, _instance_configs, path_, _ms_param_array, _effect_handler);
+			}
+			else {
+				update_totals_on_close(irods::connection_manager::get(), config, path_, data_objects_, size_in_bytes_);
+			}
 		}
 		catch (const irods::exception& e) {
 			return log_irods_exception(e, _effect_handler);
@@ -1534,10 +4573,16 @@ namespace irods::handler
 
 		try {
 			auto* input = get_pointer<collInp_t>(_rule_arguments);
-			const auto& attrs = get_instance_config(_instance_configs, _instance_name).attributes();
-			irods::experimental::client_connection conn;
-			if (auto collection = get_monitored_parent_collection(conn, attrs, input->collName); collection) {
-				std::tie(data_objects_, size_in_bytes_) = compute_data_object_count_and_size(conn, input->collName);
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
+
+			if (!may_be_monitored(config, input->collName)) {
+				return CODE(RULE_ENGINE_CONTINUE);
+			}
+
+			auto& conn = irods::connection_manager::get();
+			if (auto collection = get_monitored_parent_collection(conn, config, input->collName); collection) {
+				std::tie(data_objects_, size_in_bytes_) =
+					compute_data_object_count_and_size(conn, config, input->collName);
 			}
 		}
 		catch (const irods::exception& e) {
@@ -1558,11 +4603,17 @@ namespace irods::handler
 	{
 		try {
 			auto* input = get_pointer<collInp_t>(_rule_arguments);
-			const auto& attrs = get_instance_config(_instance_configs, _instance_name).attributes();
-			irods::experimental::client_connection conn;
+			const auto& config = get_instance_config(_instance_configs, _instance_name);
+			invalidate_cached_information_for_tree(config, input->collName);
+
+			if (!may_be_monitored(config, input->collName)) {
+				return CODE(RULE_ENGINE_CONTINUE);
+			}
+
+			auto& conn = irods::connection_manager::get();
 			for_each_monitored_collection(
-				conn, attrs, input->collName, [&conn, &attrs, input](const auto& _collection, const auto& _info) {
-					update_data_object_count_and_size(conn, attrs, _collection, _info, -data_objects_, -size_in_bytes_);
+				conn, config, input->collName, [&conn, &config, input](const auto& _collection) {
+					update_data_object_count_and_size(conn, config, _collection, -data_objects_, -size_in_bytes_);
 				});
 		}
 		catch (const irods::exception& e) {
@@ -1594,7 +4645,12 @@ namespace irods::handler
 			auto* input = get_pointer<BytesBuf>(_rule_arguments);
 			const auto json_input = nlohmann::json::parse(std::string_view(static_cast<char*>(input->buf), input->len));
 			path_ = json_input.at("logical_path").get<std::string>();
-			irods::experimental::client_connection conn;
+
+			if (!may_be_monitored(get_instance_config(_instance_configs, _instance_name), path_)) {
+				return CODE(RULE_ENGINE_CONTINUE);
+			}
+
+			auto& conn = irods::connection_manager::get();
 			exists_ = fs::client::exists(conn, path_);
 
 			if (!exists_) {
@@ -1613,10 +4669,11 @@ namespace irods::handler
 					}
 				}
 
-				const auto& attrs = get_instance_config(_instance_configs, _instance_name).attributes();
+				const auto& config = get_instance_config(_instance_configs, _instance_name);
+				const auto& attrs = config.attributes();
 
-				for_each_monitored_collection(conn, attrs, path_, [&attrs](auto&, auto& _info) {
-					throw_if_maximum_number_of_data_objects_violation(attrs, _info, 1);
+				for_each_monitored_collection(conn, config, path_, [&attrs](const auto& _collection) {
+					throw_if_maximum_number_of_data_objects_violation(attrs, _collection.info, 1);
 				});
 
 				update_count_ = true;
@@ -1648,16 +4705,16 @@ namespace irods::handler
 		}
 
 		try {
-			irods::experimental::client_connection conn;
+			auto& conn = irods::connection_manager::get();
 
 			// Verify that the target object was created. This is necessary because the touch API
 			// does not always result in a new data object (i.e. no_create JSON option).
 			if (!exists_ && fs::client::exists(conn, path_)) {
-				const auto& attrs = get_instance_config(_instance_configs, _instance_name).attributes();
+				const auto& config = get_instance_config(_instance_configs, _instance_name);
 
 				for_each_monitored_collection(
-					conn, attrs, path_, [&conn, &attrs](const auto& _collection, const auto& _info) {
-						update_data_object_count_and_size(conn, attrs, _collection, _info, 1, 0);
+					conn, config, path_, [&conn, &config](const auto& _collection) {
+						update_data_object_count_and_size(conn, config, _collection, 1, 0);
 					});
 			}
 		}
@@ -18,12 +18,38 @@ namespace irods::handler
 	using file_position_type = std::int64_t;
 	// clang-format on
 
+	// Writes the changes to the totals held in memory to the catalog and returns the unused headroom
+	// leased by the agent. Errors are logged.
+	auto flush_pending_quota_updates(const instance_configuration& _config) noexcept -> void;
+
+	// Returns "_output" to the client. Rules invoked via exec_rule_text or exec_rule_expression receive
+	// the output through ruleExecOut. Rules invoked via exec_rule receive it through the second rule
+	// argument, as do the operations of a batch when "_ms_param_array" is null.
+	auto write_output(std::string _output, std::list<boost::any>& _rule_arguments, MsParamArray* _ms_param_array)
+		-> irods::error;
+
 	auto logical_quotas_get_collection_status(const std::string& _instance_name,
 	                                          const instance_configuration_map& _instance_configs,
 	                                          std::list<boost::any>& _rule_arguments,
 	                                          MsParamArray* _ms_param_array,
 	                                          irods::callback& _effect_handler) -> irods::error;
 
+	// Returns the status of many monitored collections at once, one JSON object per line. The
+	// collections are either every monitored collection under a subtree or a JSON array of paths.
+	auto logical_quotas_get_status_of_collections(const std::string& _instance_name,
+	                                              const instance_configuration_map& _instance_configs,
+	                                              std::list<boost::any>& _rule_arguments,
+	                                              MsParamArray* _ms_param_array,
+	                                              irods::callback& _effect_handler) -> irods::error;
+
+	// Returns the call counts, latencies and catalog request counters of every handler, summed over
+	// all agents on the server.
+	auto logical_quotas_get_statistics(const std::string& _instance_name,
+	                                   const instance_configuration_map& _instance_configs,
+	                                   std::list<boost::any>& _rule_arguments,
+	                                   MsParamArray* _ms_param_array,
+	                                   irods::callback& _effect_handler) -> irods::error;
+
 	auto logical_quotas_start_monitoring_collection(const std::string& _instance_name,
 	                                                const instance_configuration_map& _instance_configs,
 	                                                std::list<boost::any>& _rule_arguments,
@@ -36,6 +62,13 @@ namespace irods::handler
 	                                               MsParamArray* _ms_param_array,
 	                                               irods::callback& _effect_handler) -> irods::error;
 
+	// Folds the counter shards of a monitored collection into its totals and removes them.
+	auto logical_quotas_compact_counters(const std::string& _instance_name,
+	                                     const instance_configuration_map& _instance_configs,
+	                                     std::list<boost::any>& _rule_arguments,
+	                                     MsParamArray* _ms_param_array,
+	                                     irods::callback& _effect_handler) -> irods::error;
+
 	auto logical_quotas_count_total_number_of_data_objects(const std::string& _instance_name,
 	                                                       const instance_configuration_map& _instance_configs,
 	                                                       std::list<boost::any>& _rule_arguments,
@@ -48,12 +81,24 @@ namespace irods::handler
 	                                              MsParamArray* _ms_param_array,
 	                                              irods::callback& _effect_handler) -> irods::error;
 
+	auto logical_quotas_recalculate_all(const std::string& _instance_name,
+	                                    const instance_configuration_map& _instance_configs,
+	                                    std::list<boost::any>& _rule_arguments,
+	                                    MsParamArray* _ms_param_array,
+	                                    irods::callback& _effect_handler) -> irods::error;
+
 	auto logical_quotas_recalculate_totals(const std::string& _instance_name,
 	                                       const instance_configuration_map& _instance_configs,
 	                                       std::list<boost::any>& _rule_arguments,
 	                                       MsParamArray* _ms_param_array,
 	                                       irods::callback& _effect_handler) -> irods::error;
 
+	auto logical_quotas_replay_journal(const std::string& _instance_name,
+	                                   const instance_configuration_map& _instance_configs,
+	                                   std::list<boost::any>& _rule_arguments,
+	                                   MsParamArray* _ms_param_array,
+	                                   irods::callback& _effect_handler) -> irods::error;
+
 	auto logical_quotas_set_maximum_number_of_data_objects(const std::string& _instance_name,
 	                                                       const instance_configuration_map& _instance_configs,
 	                                                       std::list<boost::any>& _rule_arguments,
@@ -126,6 +171,14 @@ namespace irods::handler
 	                                  MsParamArray* _ms_param_array,
 	                                  irods::callback& _effect_handler) -> irods::error;
 
+	// Releases the reservations made by the pre-PEP of a create or put. Invoked via the finally-PEPs,
+	// which also run when the operation fails and the post-PEP is skipped.
+	auto pep_api_release_reservations(const std::string& _instance_name,
+	                                  const instance_configuration_map& _instance_configs,
+	                                  std::list<boost::any>& _rule_arguments,
+	                                  MsParamArray* _ms_param_array,
+	                                  irods::callback& _effect_handler) -> irods::error;
+
 	class pep_api_data_obj_put final
 	{
 	  public:
@@ -203,6 +256,14 @@ namespace irods::handler
 	                               MsParamArray* _ms_param_array,
 	                               irods::callback& _effect_handler) -> irods::error;
 
+	// Forgets that a failed open was about to create a data object, so that a later close of the
+	// same path is not counted as a creation.
+	auto pep_api_data_obj_open_except(const std::string& _instance_name,
+	                                  const instance_configuration_map& _instance_configs,
+	                                  std::list<boost::any>& _rule_arguments,
+	                                  MsParamArray* _ms_param_array,
+	                                  irods::callback& _effect_handler) -> irods::error;
+
 	class pep_api_data_obj_close final
 	{
 	  public:
@@ -224,8 +285,16 @@ namespace irods::handler
 
 	  private:
 		inline static std::string path_;
+		inline static size_type data_objects_ = 0;
+		inline static size_type size_in_bytes_ = 0;
 	}; // class pep_api_data_obj_close
 
+	auto pep_api_mod_avu_metadata_post(const std::string& _instance_name,
+	                                   const instance_configuration_map& _instance_configs,
+	                                   std::list<boost::any>& _rule_arguments,
+	                                   MsParamArray* _ms_param_array,
+	                                   irods::callback& _effect_handler) -> irods::error;
+
 	auto pep_api_mod_avu_metadata_pre(const std::string& _instance_name,
 	                                  const instance_configuration_map& _instance_configs,
 	                                  std::list<boost::any>& _rule_arguments,
@@ -253,6 +322,8 @@ namespace irods::handler
 
 	  private:
 		inline static std::string path_;
+		inline static size_type data_objects_ = 0;
+		inline static size_type size_in_bytes_ = 0;
 	}; // class pep_api_replica_close
 
 	class pep_api_rm_coll final
@@ -0,0 +1,124 @@
+#ifndef IRODS_LOGICAL_QUOTAS_HEADROOM_LEASES_HPP
+#define IRODS_LOGICAL_QUOTAS_HEADROOM_LEASES_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace irods
+{
+	// Holds the amount of headroom an agent leases from a monitored collection at once. Leasing is
+	// disabled when both are zero.
+	struct headroom_lease_options
+	{
+		std::int64_t data_objects = 0;
+		std::int64_t size_in_bytes = 0;
+	}; // struct headroom_lease_options
+
+	// The headroom an agent has leased from monitored collections and not used yet.
+	//
+	// Leased headroom is added to the totals in the catalog when it is leased, so every other agent
+	// sees it as used. The agent admits changes against its leases without consulting the catalog
+	// and, as the changes are already part of the totals, does not write them either. Whatever is
+	// left is taken out of the totals when the lease is returned. Like the pending updates, the
+	// leases are held in memory and are not shared with other agents.
+	class headroom_leases final
+	{
+	  public:
+		struct lease
+		{
+			std::int64_t data_objects = 0;
+			std::int64_t size_in_bytes = 0;
+		}; // struct lease
+
+		using lease_map_type = std::unordered_map<std::string, lease>;
+
+		explicit headroom_leases(headroom_lease_options _options) noexcept
+			: options_{_options}
+		{
+		}
+
+		headroom_leases(const headroom_leases&) = delete;
+		auto operator=(const headroom_leases&) -> headroom_leases& = delete;
+
+		auto enabled() const noexcept -> bool
+		{
+			return options_.data_objects > 0 || options_.size_in_bytes > 0;
+		}
+
+		auto options() const noexcept -> const headroom_lease_options&
+		{
+			return options_;
+		}
+
+		auto empty() const noexcept -> bool
+		{
+			return leases_.empty();
+		}
+
+		auto contains(const std::string& _path) const -> bool
+		{
+			return leases_.count(_path) > 0;
+		}
+
+		// Returns the unused headroom leased from "_path". Collections without a lease produce a
+		// lease of zero.
+		auto find(const std::string& _path) const -> lease
+		{
+			if (const auto iter = leases_.find(_path); iter != std::end(leases_)) {
+				return iter->second;
+			}
+
+			return {};
+		}
+
+		// Adds headroom to the lease of "_path", creating the lease if necessary.
+		auto add(const std::string& _path, std::int64_t _data_objects, std::int64_t _size_in_bytes) -> void
+		{
+			auto& l = leases_[_path];
+			l.data_objects += _data_objects;
+			l.size_in_bytes += _size_in_bytes;
+		}
+
+		// Forgets the headroom leased from "_path" without returning it, e.g. because the catalog
+		// no longer accounts for it.
+		auto discard(const std::string& _path) -> void
+		{
+			leases_.erase(_path);
+		}
+
+		// Takes up to "_data_objects" and "_size_in_bytes" from the lease of "_path" and returns the
+		// amounts taken. Negative amounts are never taken.
+		auto consume(const std::string& _path, std::int64_t _data_objects, std::int64_t _size_in_bytes) -> lease
+		{
+			const auto iter = leases_.find(_path);
+
+			if (iter == std::end(leases_)) {
+				return {};
+			}
+
+			auto& l = iter->second;
+			const lease taken{std::clamp<std::int64_t>(_data_objects, 0, l.data_objects),
+			                  std::clamp<std::int64_t>(_size_in_bytes, 0, l.size_in_bytes)};
+
+			l.data_objects -= taken.data_objects;
+			l.size_in_bytes -= taken.size_in_bytes;
+
+			return taken;
+		}
+
+		// Removes and returns every lease.
+		auto take() -> lease_map_type
+		{
+			return std::exchange(leases_, {});
+		}
+
+	  private:
+		headroom_lease_options options_;
+		lease_map_type leases_;
+	}; // class headroom_leases
+} // namespace irods
+
+#endif // IRODS_LOGICAL_QUOTAS_HEADROOM_LEASES_HPP
@@ -2,17 +2,91 @@
 #define IRODS_LOGICAL_QUOTAS_INSTANCE_CONFIGURATION_HPP
 
 #include "attributes.hpp"
+#include "headroom_leases.hpp"
+#include "monitored_collection_cache.hpp"
+#include "monitored_collection_index.hpp"
+#include "pending_quota_updates.hpp"
+#include "plugin_statistics.hpp"
+#include "quota_journal.hpp"
+#include "reservation_ledger.hpp"
 
+#include <chrono>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <unordered_map>
 
 namespace irods
 {
+	// Holds the optional properties of the plugin configuration. Each member is initialized to
+	// the value used when the property is not defined.
+	struct instance_options
+	{
+		// The number of seconds an agent may reuse quota information it has already fetched
+		// from the catalog. Zero disables caching.
+		std::chrono::seconds cache_time_to_live{0};
+
+		// The number of seconds the table of monitored collections shared by all agents remains
+		// valid before it is reloaded from the catalog. Zero disables the shared table.
+		std::chrono::seconds index_time_to_live{0};
+
+		// When true, closing a data object which was written to recalculates the totals of every
+		// monitored parent collection instead of applying the change in size.
+		bool recalculate_totals_on_close = false;
+
+		// Controls whether changes to the totals are held in memory and written to the catalog in
+		// batches. Disabled by default.
+		write_behind_options write_behind;
+
+		// The directory holding the journals of changes held in memory for write-behind. An empty
+		// string disables the journal.
+		std::string journal_directory;
+
+		// The number of connections used to recalculate the totals of a single collection. The
+		// subtree is split into chunks by child collection which are counted concurrently. Zero
+		// disables chunking, in which case the subtree is counted with a single query.
+		std::int64_t recalculation_threads = 0;
+
+		// The number of times a change to the totals is retried after another agent changed them
+		// first. When non-zero, each total is only replaced if it still holds the value it was read
+		// with. Zero replaces the totals unconditionally.
+		std::int64_t compare_and_swap_retries = 0;
+
+		// The number of shards each total is split into. When non-zero, agents apply their changes
+		// to the shard selected by their process ID instead of the total itself, so that agents
+		// writing under the same collection rarely contend for the same AVU. Requires
+		// compare_and_swap_retries. Zero applies changes to the totals directly.
+		std::int64_t counter_shards = 0;
+
+		// The amount of headroom an agent leases from a monitored collection with limits when its
+		// current lease cannot admit a change. Requires compare_and_swap_retries. Disabled by
+		// default.
+		headroom_lease_options headroom_lease;
+
+		// When true, agents reserve what a change adds to the totals before performing it, so that
+		// concurrent changes are admitted against each other as well as the totals. Disabled by
+		// default.
+		bool reserve_in_flight_changes = false;
+	}; // struct instance_options
+
 	class instance_configuration final
 	{
 	  public:
-		instance_configuration(attributes _attrs) noexcept
+		instance_configuration(attributes _attrs,
+		                       instance_options _options = {},
+		                       std::shared_ptr<monitored_collection_index> _index = nullptr,
+		                       std::shared_ptr<quota_journal> _journal = nullptr,
+		                       std::shared_ptr<plugin_statistics> _statistics = nullptr,
+		                       std::shared_ptr<reservation_ledger> _reservations = nullptr)
 			: attrs_{std::move(_attrs)}
+			, options_{std::move(_options)}
+			, cache_{std::make_shared<monitored_collection_cache>(options_.cache_time_to_live)}
+			, pending_updates_{std::make_shared<pending_quota_updates>(options_.write_behind)}
+			, headroom_leases_{std::make_shared<class headroom_leases>(options_.headroom_lease)}
+			, index_{std::move(_index)}
+			, journal_{std::move(_journal)}
+			, statistics_{std::move(_statistics)}
+			, reservations_{std::move(_reservations)}
 		{
 		}
 
@@ -21,8 +95,69 @@ namespace irods
 			return attrs_;
 		}
 
+		const instance_options& options() const noexcept
+		{
+			return options_;
+		}
+
+		// The cache is shared between copies of this configuration and lives as long as the agent.
+		monitored_collection_cache& cache() const noexcept
+		{
+			return *cache_;
+		}
+
+		// Holds changes to the totals which have not been written to the catalog yet. Like the cache,
+		// it is shared between copies of this configuration.
+		pending_quota_updates& pending_updates() const noexcept
+		{
+			return *pending_updates_;
+		}
+
+		// Holds the headroom leased by the agent. Like the cache, it is shared between copies of this
+		// configuration.
+		class headroom_leases& headroom_leases() const noexcept
+		{
+			return *headroom_leases_;
+		}
+
+		// Returns a pointer to the table of monitored collections shared by all agents, or nullptr
+		// if the shared table is disabled.
+		monitored_collection_index* index() const noexcept
+		{
+			return index_.get();
+		}
+
+		// Returns a pointer to the journal of changes held in memory, or nullptr if the journal is
+		// disabled.
+		quota_journal* journal() const noexcept
+		{
+			return journal_.get();
+		}
+
+		// Returns a pointer to the counters shared by all agents, or nullptr if they are not
+		// available.
+		plugin_statistics* statistics() const noexcept
+		{
+			return statistics_.get();
+		}
+
+		// Returns a pointer to the reservations shared by all agents, or nullptr if reservations are
+		// disabled.
+		reservation_ledger* reservations() const noexcept
+		{
+			return reservations_.get();
+		}
+
 	  private:
 		class attributes attrs_;
+		instance_options options_;
+		std::shared_ptr<monitored_collection_cache> cache_;
+		std::shared_ptr<pending_quota_updates> pending_updates_;
+		std::shared_ptr<class headroom_leases> headroom_leases_;
+		std::shared_ptr<monitored_collection_index> index_;
+		std::shared_ptr<quota_journal> journal_;
+		std::shared_ptr<plugin_statistics> statistics_;
+		std::shared_ptr<reservation_ledger> reservations_;
 	}; // class instance_config
 
 	using instance_configuration_map = std::unordered_map<std::string, instance_configuration>;
@@ -1,5 +1,6 @@
 #include "instance_configuration.hpp"
 
+#include "connection_manager.hpp"
 #include "handler.hpp"
 #include "utilities.hpp"
 
@@ -41,13 +42,18 @@ namespace
 	using handler_map_type = std::map<std::string_view, handler_type>;
 
 	const handler_map_type logical_quotas_handlers{
+		{"logical_quotas_compact_counters",                     handler::logical_quotas_compact_counters},
 		{"logical_quotas_count_total_number_of_data_objects",   handler::logical_quotas_count_total_number_of_data_objects},
 		{"logical_quotas_count_total_size_in_bytes",            handler::logical_quotas_count_total_size_in_bytes},
+		{"logical_quotas_recalculate_all",                      handler::logical_quotas_recalculate_all},
 		{"logical_quotas_recalculate_totals",                   handler::logical_quotas_recalculate_totals},
+		{"logical_quotas_replay_journal",                       handler::logical_quotas_replay_journal},
 		{"logical_quotas_set_maximum_number_of_data_objects",   handler::logical_quotas_set_maximum_number_of_data_objects},
 		{"logical_quotas_set_maximum_size_in_bytes",            handler::logical_quotas_set_maximum_size_in_bytes},
 		{"logical_quotas_start_monitoring_collection",          handler::logical_quotas_start_monitoring_collection},
 		{"logical_quotas_get_collection_status",                handler::logical_quotas_get_collection_status},
+		{"logical_quotas_get_statistics",                       handler::logical_quotas_get_statistics},
+		{"logical_quotas_get_status_of_collections",            handler::logical_quotas_get_status_of_collections},
 		{"logical_quotas_stop_monitoring_collection",           handler::logical_quotas_stop_monitoring_collection},
 		{"logical_quotas_unset_maximum_number_of_data_objects", handler::logical_quotas_unset_maximum_number_of_data_objects},
 		{"logical_quotas_unset_maximum_size_in_bytes",          handler::logical_quotas_unset_maximum_size_in_bytes},
@@ -56,33 +62,65 @@ namespace
 	};
 
 	const handler_map_type pep_handlers{
-		{"pep_api_data_obj_close_post",           handler::pep_api_data_obj_close::post},
-		{"pep_api_data_obj_close_pre",            handler::pep_api_data_obj_close::pre},
-		{"pep_api_data_obj_copy_post",            handler::pep_api_data_obj_copy::post},
-		{"pep_api_data_obj_copy_pre",             handler::pep_api_data_obj_copy::pre},
-		{"pep_api_data_obj_create_and_stat_post", handler::pep_api_data_obj_create_post},
-		{"pep_api_data_obj_create_and_stat_pre",  handler::pep_api_data_obj_create_pre},
-		{"pep_api_data_obj_create_post",          handler::pep_api_data_obj_create_post},
-		{"pep_api_data_obj_create_pre",           handler::pep_api_data_obj_create_pre},
-		{"pep_api_data_obj_open_and_stat_pre",    handler::pep_api_data_obj_open_pre},
-		{"pep_api_data_obj_open_pre",             handler::pep_api_data_obj_open_pre},
-		{"pep_api_data_obj_put_post",             handler::pep_api_data_obj_put::post},
-		{"pep_api_data_obj_put_pre",              handler::pep_api_data_obj_put::pre},
-		{"pep_api_data_obj_rename_post",          handler::pep_api_data_obj_rename::post},
-		{"pep_api_data_obj_rename_pre",           handler::pep_api_data_obj_rename::pre},
-		{"pep_api_data_obj_unlink_post",          handler::pep_api_data_obj_unlink::post},
-		{"pep_api_data_obj_unlink_pre",           handler::pep_api_data_obj_unlink::pre},
-		{"pep_api_mod_avu_metadata_pre",          handler::pep_api_mod_avu_metadata_pre},
-		{"pep_api_replica_close_post",            handler::pep_api_replica_close::post},
-		{"pep_api_replica_close_pre",             handler::pep_api_replica_close::pre},
-		{"pep_api_replica_open_pre",              handler::pep_api_data_obj_open_pre},
-		{"pep_api_rm_coll_post",                  handler::pep_api_rm_coll::post},
-		{"pep_api_rm_coll_pre",                   handler::pep_api_rm_coll::pre},
-		{"pep_api_touch_post",                    handler::pep_api_touch::post},
-		{"pep_api_touch_pre",                     handler::pep_api_touch::pre}
+		{"pep_api_data_obj_close_post",              handler::pep_api_data_obj_close::post},
+		{"pep_api_data_obj_close_pre",               handler::pep_api_data_obj_close::pre},
+		{"pep_api_data_obj_copy_post",               handler::pep_api_data_obj_copy::post},
+		{"pep_api_data_obj_copy_pre",                handler::pep_api_data_obj_copy::pre},
+		{"pep_api_data_obj_create_and_stat_finally", handler::pep_api_release_reservations},
+		{"pep_api_data_obj_create_and_stat_post",    handler::pep_api_data_obj_create_post},
+		{"pep_api_data_obj_create_and_stat_pre",     handler::pep_api_data_obj_create_pre},
+		{"pep_api_data_obj_create_finally",          handler::pep_api_release_reservations},
+		{"pep_api_data_obj_create_post",             handler::pep_api_data_obj_create_post},
+		{"pep_api_data_obj_create_pre",              handler::pep_api_data_obj_create_pre},
+		{"pep_api_data_obj_open_and_stat_except",    handler::pep_api_data_obj_open_except},
+		{"pep_api_data_obj_open_and_stat_pre",       handler::pep_api_data_obj_open_pre},
+		{"pep_api_data_obj_open_except",             handler::pep_api_data_obj_open_except},
+		{"pep_api_data_obj_open_pre",                handler::pep_api_data_obj_open_pre},
+		{"pep_api_data_obj_put_finally",             handler::pep_api_release_reservations},
+		{"pep_api_data_obj_put_post",                handler::pep_api_data_obj_put::post},
+		{"pep_api_data_obj_put_pre",                 handler::pep_api_data_obj_put::pre},
+		{"pep_api_data_obj_rename_post",             handler::pep_api_data_obj_rename::post},
+		{"pep_api_data_obj_rename_pre",              handler::pep_api_data_obj_rename::pre},
+		{"pep_api_data_obj_unlink_post",             handler::pep_api_data_obj_unlink::post},
+		{"pep_api_data_obj_unlink_pre",              handler::pep_api_data_obj_unlink::pre},
+		{"pep_api_mod_avu_metadata_post",            handler::pep_api_mod_avu_metadata_post},
+		{"pep_api_mod_avu_metadata_pre",             handler::pep_api_mod_avu_metadata_pre},
+		{"pep_api_replica_close_post",               handler::pep_api_replica_close::post},
+		{"pep_api_replica_close_pre",                handler::pep_api_replica_close::pre},
+		{"pep_api_replica_open_except",              handler::pep_api_data_obj_open_except},
+		{"pep_api_replica_open_pre",                 handler::pep_api_data_obj_open_pre},
+		{"pep_api_rm_coll_post",                     handler::pep_api_rm_coll::post},
+		{"pep_api_rm_coll_pre",                      handler::pep_api_rm_coll::pre},
+		{"pep_api_touch_post",                       handler::pep_api_touch::post},
+		{"pep_api_touch_pre",                        handler::pep_api_touch::pre}
 	};
 	// clang-format on
 
+	// Invokes a handler and records its latency and outcome in the statistics of the instance.
+	auto invoke(const handler_map_type::value_type& _handler,
+	            const std::string& _instance_name,
+	            std::list<boost::any>& _rule_arguments,
+	            MsParamArray* _ms_param_array,
+	            irods::callback& _effect_handler) -> irods::error
+	{
+		irods::plugin_statistics* statistics{};
+
+		if (const auto iter = instance_configs.find(_instance_name); iter != std::end(instance_configs)) {
+			statistics = iter->second.statistics();
+		}
+
+		irods::plugin_statistics::scoped_call call{statistics, _handler.first};
+
+		auto result =
+			(_handler.second)(_instance_name, instance_configs, _rule_arguments, _ms_param_array, _effect_handler);
+
+		if (!result.ok()) {
+			call.failed();
+		}
+
+		return result;
+	}
+
 	//
 	// Rule Engine Plugin
 	//
@@ -149,12 +187,183 @@ namespace
 						}
 					}();
 
+					irods::instance_options options;
+
+					if (const auto iter = plugin_config.find("cache_time_to_live_in_seconds");
+					    iter != std::end(plugin_config)) {
+						options.cache_time_to_live = std::chrono::seconds{iter->get<std::int64_t>()};
+					}
+
+					if (const auto iter = plugin_config.find("index_time_to_live_in_seconds");
+					    iter != std::end(plugin_config)) {
+						options.index_time_to_live = std::chrono::seconds{iter->get<std::int64_t>()};
+					}
+
+					if (const auto iter = plugin_config.find("recalculate_totals_on_close");
+					    iter != std::end(plugin_config)) {
+						options.recalculate_totals_on_close = iter->get<bool>();
+					}
+
+					if (const auto iter = plugin_config.find("reserve_in_flight_changes");
+					    iter != std::end(plugin_config)) {
+						options.reserve_in_flight_changes = iter->get<bool>();
+					}
+
+					if (const auto iter = plugin_config.find("write_behind_maximum_pending_updates");
+					    iter != std::end(plugin_config)) {
+						options.write_behind.maximum_pending_updates = iter->get<std::int64_t>();
+					}
+
+					if (const auto iter = plugin_config.find("write_behind_maximum_pending_bytes");
+					    iter != std::end(plugin_config)) {
+						options.write_behind.maximum_pending_bytes = iter->get<std::int64_t>();
+					}
+
+					if (const auto iter = plugin_config.find("write_behind_flush_interval_in_seconds");
+					    iter != std::end(plugin_config)) {
+						options.write_behind.flush_interval = std::chrono::seconds{iter->get<std::int64_t>()};
+					}
+
+					if (const auto iter = plugin_config.find("journal_directory"); iter != std::end(plugin_config)) {
+						options.journal_directory = iter->get<std::string>();
+					}
+
+					if (const auto iter = plugin_config.find("recalculation_threads"); iter != std::end(plugin_config)) {
+						options.recalculation_threads = iter->get<std::int64_t>();
+
+						if (options.recalculation_threads < 0) {
+							throw std::runtime_error{"Logical Quotas Policy: [recalculation_threads] must be a "
+							                         "non-negative integer"};
+						}
+					}
+
+					if (const auto iter = plugin_config.find("compare_and_swap_retries");
+					    iter != std::end(plugin_config)) {
+						options.compare_and_swap_retries = iter->get<std::int64_t>();
+
+						if (options.compare_and_swap_retries < 0) {
+							throw std::runtime_error{"Logical Quotas Policy: [compare_and_swap_retries] must be a "
+							                         "non-negative integer"};
+						}
+					}
+
+					if (const auto iter = plugin_config.find("counter_shards"); iter != std::end(plugin_config)) {
+						options.counter_shards = iter->get<std::int64_t>();
+
+						if (options.counter_shards < 0) {
+							throw std::runtime_error{"Logical Quotas Policy: [counter_shards] must be a "
+							                         "non-negative integer"};
+						}
+
+						// Shards are always updated conditionally. Two agents may map to the same shard.
+						if (options.counter_shards > 0 && 0 == options.compare_and_swap_retries) {
+							throw std::runtime_error{"Logical Quotas Policy: [counter_shards] requires "
+							                         "[compare_and_swap_retries] to be set"};
+						}
+					}
+
+					if (const auto iter = plugin_config.find("headroom_lease_data_objects");
+					    iter != std::end(plugin_config)) {
+						options.headroom_lease.data_objects = iter->get<std::int64_t>();
+
+						if (options.headroom_lease.data_objects < 0) {
+							throw std::runtime_error{"Logical Quotas Policy: [headroom_lease_data_objects] must be a "
+							                         "non-negative integer"};
+						}
+					}
+
+					if (const auto iter = plugin_config.find("headroom_lease_size_in_bytes");
+					    iter != std::end(plugin_config)) {
+						options.headroom_lease.size_in_bytes = iter->get<std::int64_t>();
+
+						if (options.headroom_lease.size_in_bytes < 0) {
+							throw std::runtime_error{"Logical Quotas Policy: [headroom_lease_size_in_bytes] must be a "
+							                         "non-negative integer"};
+						}
+					}
+
+					// Headroom is leased by conditionally adding it to the totals.
+					if ((options.headroom_lease.data_objects > 0 || options.headroom_lease.size_in_bytes > 0) &&
+					    0 == options.compare_and_swap_retries)
+					{
+						throw std::runtime_error{"Logical Quotas Policy: [headroom_lease_data_objects] and "
+						                         "[headroom_lease_size_in_bytes] require [compare_and_swap_retries] "
+						                         "to be set"};
+					}
+
+					// The first agent to reach this point creates the shared memory segment. All other
+					// agents attach to it. Failing to do so is not fatal. The plugin simply falls back
+					// to querying the catalog.
+					std::shared_ptr<irods::monitored_collection_index> index;
+
+					if (options.index_time_to_live.count() > 0) {
+						try {
+							index = std::make_shared<irods::monitored_collection_index>(_instance_name,
+							                                                             options.index_time_to_live);
+						}
+						catch (const std::exception& e) {
+							// clang-format off
+							log::rule_engine::warn({{"rule_engine_plugin", "logical_quotas"},
+							                        {"rule_engine_plugin_function", __func__},
+							                        {"log_message", "Failed to attach to shared table of monitored collections"},
+							                        {"exception", e.what()}});
+							// clang-format on
+						}
+					}
+
+					// The journal only protects changes held in memory, so it is not needed unless
+					// write-behind is enabled.
+					std::shared_ptr<irods::quota_journal> journal;
+
+					if (options.write_behind.maximum_pending_updates > 0 && !options.journal_directory.empty()) {
+						journal = std::make_shared<irods::quota_journal>(options.journal_directory, _instance_name);
+					}
+
+					// Like the shared table, the statistics are optional. The plugin keeps working without
+					// them.
+					std::shared_ptr<irods::plugin_statistics> statistics;
+
+					try {
+						statistics = std::make_shared<irods::plugin_statistics>(_instance_name);
+					}
+					catch (const std::exception& e) {
+						// clang-format off
+						log::rule_engine::warn({{"rule_engine_plugin", "logical_quotas"},
+						                        {"rule_engine_plugin_function", __func__},
+						                        {"log_message", "Failed to attach to shared statistics"},
+						                        {"exception", e.what()}});
+						// clang-format on
+					}
+
+					// Like the shared table, the reservations are optional. Without them, changes are
+					// admitted against the totals alone.
+					std::shared_ptr<irods::reservation_ledger> reservations;
+
+					if (options.reserve_in_flight_changes) {
+						try {
+							reservations = std::make_shared<irods::reservation_ledger>(_instance_name);
+						}
+						catch (const std::exception& e) {
+							// clang-format off
+							log::rule_engine::warn({{"rule_engine_plugin", "logical_quotas"},
+							                        {"rule_engine_plugin_function", __func__},
+							                        {"log_message", "Failed to attach to shared reservations"},
+							                        {"exception", e.what()}});
+							// clang-format on
+						}
+					}
+
 					irods::instance_configuration instance_config{
 						{get_prop(plugin_config, "namespace"),
 					     get_prop(attr_names, "maximum_number_of_data_objects"),
 					     get_prop(attr_names, "maximum_size_in_bytes"),
 					     get_prop(attr_names, "total_number_of_data_objects"),
-					     get_prop(attr_names, "total_size_in_bytes")}};
+					     get_prop(attr_names, "total_size_in_bytes")},
+						options,
+						std::move(index),
+						std::move(journal),
+						std::move(statistics),
+						std::move(reservations)};
 
 					instance_configs.insert_or_assign(_instance_name, instance_config);
 
@@ -175,6 +384,29 @@ namespace
 		return ERROR(SYS_CONFIG_FILE_ERR, "[logical_quotas] Bad rule engine plugin configuration");
 	} // setup
 
+	auto stop(irods::default_re_ctx&, const std::string& _instance_name) -> irods::error
+	{
+		if (const auto iter = instance_configs.find(_instance_name); iter != std::end(instance_configs)) {
+			handler::flush_pending_quota_updates(iter->second);
+
+			if (auto* reservations = iter->second.reservations(); reservations) {
+				reservations->release();
+			}
+		}
+
+		return SUCCESS();
+	} // stop
+
+	auto teardown(irods::default_re_ctx& _ctx, const std::string& _instance_name) -> irods::error
+	{
+		stop(_ctx, _instance_name);
+
+		// The connection is shared by all instances of the plugin within the agent. Releasing it more
+		// than once is harmless.
+		irods::connection_manager::release();
+		return SUCCESS();
+	} // teardown
+
 	auto rule_exists(const std::string& _instance_name,
 	                 irods::default_re_ctx&,
 	                 const std::string& _rule_name,
@@ -206,11 +438,11 @@ namespace
 	               irods::callback _effect_handler) -> irods::error
 	{
 		if (const auto iter = pep_handlers.find(_rule_name); iter != std::end(pep_handlers)) {
-			return (iter->second)(_instance_name, instance_configs, _rule_arguments, nullptr, _effect_handler);
+			return invoke(*iter, _instance_name, _rule_arguments, nullptr, _effect_handler);
 		}
 
 		if (const auto iter = logical_quotas_handlers.find(_rule_name); iter != std::end(logical_quotas_handlers)) {
-			return (iter->second)(_instance_name, instance_configs, _rule_arguments, nullptr, _effect_handler);
+			return invoke(*iter, _instance_name, _rule_arguments, nullptr, _effect_handler);
 		}
 
 		log::rule_engine::error(fmt::format("Rule not supported in rule engine plugin [rule => {}]", _rule_name));
@@ -218,6 +450,111 @@ namespace
 		return CODE(RULE_ENGINE_CONTINUE);
 	}
 
+	// Executes the operation described by "_json_args". Operations which produce output write it to
+	// "_output" if it is not null. Otherwise, the output is written to "_ms_param_array".
+	auto exec_operation(const std::string& _instance_name,
+	                    const json& _json_args,
+	                    MsParamArray* _ms_param_array,
+	                    irods::callback& _effect_handler,
+	                    std::string* _output) -> irods::error
+	{
+		const auto& op = _json_args.at("operation").get_ref<const std::string&>();
+
+		const auto iter = logical_quotas_handlers.find(op);
+
+		if (iter == std::end(logical_quotas_handlers)) {
+			return ERROR(INVALID_OPERATION, fmt::format("Invalid operation [{}]", op));
+		}
+
+		// Replaying the journal and fetching the statistics are not tied to a collection.
+		// Recalculating all totals treats the collection as an optional prefix. Fetching the
+		// status of many collections accepts a list of collections instead of a subtree.
+		const auto collection_is_optional =
+			(op == "logical_quotas_replay_journal" || op == "logical_quotas_get_statistics" ||
+			 op == "logical_quotas_recalculate_all" || op == "logical_quotas_get_status_of_collections");
+		auto collection = collection_is_optional ? _json_args.value("collection", "")
+		                                         : _json_args.at("collection").get<std::string>();
+
+		if (op == "logical_quotas_get_status_of_collections" && _json_args.contains("collections")) {
+			collection = _json_args.at("collections").dump();
+		}
+
+		std::list<boost::any> args{&collection};
+		std::string value;
+
+		// clang-format off
+		if (op == "logical_quotas_set_maximum_number_of_data_objects" ||
+			op == "logical_quotas_set_maximum_size_in_bytes")
+		{
+			value = _json_args.at("value").get<std::string>();
+			args.push_back(&value);
+		}
+		else if (op == "logical_quotas_recalculate_totals" && _json_args.contains("mode")) {
+			value = _json_args.at("mode").get<std::string>();
+			args.push_back(&value);
+		}
+		// clang-format on
+
+		if (!_output) {
+			return invoke(*iter, _instance_name, args, _ms_param_array, _effect_handler);
+		}
+
+		// Without a MsParamArray, operations return their output through the argument following
+		// the collection, just like when they are invoked via exec_rule.
+		if (op == "logical_quotas_get_collection_status" || op == "logical_quotas_get_status_of_collections" ||
+		    op == "logical_quotas_get_statistics")
+		{
+			args.push_back(_output);
+		}
+
+		return invoke(*iter, _instance_name, args, nullptr, _effect_handler);
+	}
+
+	// Executes a batch of operations in order and returns the result of every operation to the client
+	// in a single JSON array. A failed operation does not prevent the ones following it from running.
+	// All operations share the agent's connection.
+	auto exec_operations(const std::string& _instance_name,
+	                     const json& _operations,
+	                     MsParamArray* _ms_param_array,
+	                     irods::callback& _effect_handler) -> irods::error
+	{
+		auto results = json::array();
+
+		for (const auto& op : _operations) {
+			std::string output;
+			auto error = SUCCESS();
+
+			try {
+				error = exec_operation(_instance_name, op, _ms_param_array, _effect_handler, &output);
+			}
+			catch (const json::exception& e) {
+				error = ERROR(SYS_INVALID_INPUT_PARAM, e.what());
+			}
+			catch (const std::exception& e) {
+				error = ERROR(SYS_INTERNAL_ERR, e.what());
+			}
+
+			auto result = json{{"error_code", error.code()}, {"error_message", error.ok() ? "" : error.user_result()}};
+
+			if (!output.empty()) {
+				// Output which is not a single JSON document (e.g. newline-delimited JSON) is
+				// returned as a string.
+				if (auto doc = json::parse(output, nullptr, false); !doc.is_discarded()) {
+					result["output"] = std::move(doc);
+				}
+				else {
+					result["output"] = std::move(output);
+				}
+			}
+
+			results.push_back(std::move(result));
+		}
+
+		std::list<boost::any> args;
+
+		return handler::write_output(results.dump(), args, _ms_param_array);
+	}
+
 	auto exec_rule_text_impl(const std::string& _instance_name,
 	                         std::string_view _rule_text,
 	                         MsParamArray* _ms_param_array,
@@ -272,27 +609,12 @@ namespace
 
 			log::rule_engine::debug({{"function", __func__}, {"json_arguments", json_args.dump()}});
 
-			const auto& op = json_args.at("operation").get_ref<const std::string&>();
-
-			if (const auto iter = logical_quotas_handlers.find(op); iter != std::end(logical_quotas_handlers)) {
-				auto collection = json_args.at("collection").get<std::string>();
-
-				std::list<boost::any> args{&collection};
-				std::string value;
-
-				// clang-format off
-				if (op == "logical_quotas_set_maximum_number_of_data_objects" ||
-					op == "logical_quotas_set_maximum_size_in_bytes")
-				{
-					value = json_args.at("value").get<std::string>();
-					args.push_back(&value);
-				}
-				// clang-format on
-
-				return (iter->second)(_instance_name, instance_configs, args, _ms_param_array, _effect_handler);
+			// An array holds a batch of operations.
+			if (json_args.is_array()) {
+				return exec_operations(_instance_name, json_args, _ms_param_array, _effect_handler);
 			}
 
-			return ERROR(INVALID_OPERATION, fmt::format("Invalid operation [{}]", op));
+			return exec_operation(_instance_name, json_args, _ms_param_array, _effect_handler, nullptr);
 		}
 		catch (const json::parse_error& e) {
 			// clang-format off
@@ -377,9 +699,9 @@ extern "C" auto plugin_factory(const std::string& _instance_name, const std::str
 	auto* re = new pluggable_rule_engine{_instance_name, _context};
 
 	re->add_operation("setup", operation<const std::string&>{setup});
-	re->add_operation("teardown", operation<const std::string&>{no_op});
+	re->add_operation("teardown", operation<const std::string&>{teardown});
 	re->add_operation("start", operation<const std::string&>{no_op});
-	re->add_operation("stop", operation<const std::string&>{no_op});
+	re->add_operation("stop", operation<const std::string&>{stop});
 	re->add_operation("rule_exists", operation<const std::string&, bool&>{rule_exists_wrapper});
 	re->add_operation("list_rules", operation<std::vector<std::string>&>{list_rules});
 	re->add_operation(
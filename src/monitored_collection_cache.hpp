@@ -0,0 +1,198 @@
+#ifndef IRODS_LOGICAL_QUOTAS_MONITORED_COLLECTION_CACHE_HPP
+#define IRODS_LOGICAL_QUOTAS_MONITORED_COLLECTION_CACHE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace irods
+{
+	using quotas_info_type = std::unordered_map<std::string, std::int64_t>;
+
+	// An in-process cache which maps logical collection paths to their quota information.
+	//
+	// Paths are mapped to collection IDs and quota information is held per collection ID. A path
+	// mapped to std::nullopt is known to NOT be monitored. Renaming a collection only invalidates
+	// the paths, so the quota information of the collections which were renamed is reused once
+	// their new paths are resolved. Entries expire once the configured time-to-live has elapsed
+	// so that changes made by other agents are eventually observed. A time-to-live of zero
+	// disables the cache.
+	class monitored_collection_cache final
+	{
+	  public:
+		using clock_type = std::chrono::steady_clock;
+
+		struct collection
+		{
+			std::int64_t id = 0;
+			quotas_info_type info;
+		}; // struct collection
+
+		using value_type = std::optional<collection>;
+
+		explicit monitored_collection_cache(std::chrono::seconds _time_to_live) noexcept
+			: ttl_{_time_to_live}
+		{
+		}
+
+		monitored_collection_cache(const monitored_collection_cache&) = delete;
+		auto operator=(const monitored_collection_cache&) -> monitored_collection_cache& = delete;
+
+		auto enabled() const noexcept -> bool
+		{
+			return ttl_.count() > 0;
+		}
+
+		// Returns the cached value for "_path" or std::nullopt if the path is not cached, the
+		// quota information of the collection it maps to is not cached, or either has expired.
+		auto find(const std::string& _path) -> std::optional<value_type>
+		{
+			if (!enabled()) {
+				return std::nullopt;
+			}
+
+			const auto iter = paths_.find(_path);
+
+			if (iter == std::end(paths_)) {
+				return std::nullopt;
+			}
+
+			if (clock_type::now() >= iter->second.expires_at) {
+				paths_.erase(iter);
+				return std::nullopt;
+			}
+
+			if (!iter->second.id) {
+				return value_type{};
+			}
+
+			if (const auto* info = find(*iter->second.id); info) {
+				return value_type{collection{*iter->second.id, *info}};
+			}
+
+			return std::nullopt;
+		}
+
+		// Returns a pointer to the cached quota information of the collection identified by "_id"
+		// or nullptr if it is not cached or the entry has expired.
+		auto find(std::int64_t _id) -> const quotas_info_type*
+		{
+			if (!enabled()) {
+				return nullptr;
+			}
+
+			const auto iter = collections_.find(_id);
+
+			if (iter == std::end(collections_)) {
+				return nullptr;
+			}
+
+			if (clock_type::now() >= iter->second.expires_at) {
+				collections_.erase(iter);
+				return nullptr;
+			}
+
+			return &iter->second.info;
+		}
+
+		auto insert(const std::string& _path, value_type _value) -> void
+		{
+			if (!enabled()) {
+				return;
+			}
+
+			const auto expires_at = clock_type::now() + ttl_;
+
+			if (!_value) {
+				paths_.insert_or_assign(_path, path_entry{std::nullopt, expires_at});
+				return;
+			}
+
+			paths_.insert_or_assign(_path, path_entry{_value->id, expires_at});
+			collections_.insert_or_assign(_value->id, collection_entry{std::move(_value->info), expires_at});
+		}
+
+		// Updates the value of a single attribute for a cached monitored collection. Collections
+		// which are not cached are left untouched.
+		auto update(std::int64_t _id, const std::string& _attribute_name, std::int64_t _value) -> void
+		{
+			if (const auto iter = collections_.find(_id); iter != std::end(collections_)) {
+				iter->second.info[_attribute_name] = _value;
+			}
+		}
+
+		// Removes "_path" and the quota information of the collection it maps to.
+		auto erase(const std::string& _path) -> void
+		{
+			if (const auto iter = paths_.find(_path); iter != std::end(paths_)) {
+				if (iter->second.id) {
+					collections_.erase(*iter->second.id);
+				}
+
+				paths_.erase(iter);
+			}
+		}
+
+		// Removes "_path" and every cached path under it, along with the quota information of the
+		// collections they map to.
+		auto erase_tree(std::string_view _path) -> void
+		{
+			erase_paths_in_tree(_path, true);
+		}
+
+		// Like erase_tree(), but keeps the quota information. Used when the collections under
+		// "_path" are renamed, which changes their paths but not their IDs.
+		auto erase_paths_in_tree(std::string_view _path) -> void
+		{
+			erase_paths_in_tree(_path, false);
+		}
+
+		auto clear() noexcept -> void
+		{
+			paths_.clear();
+			collections_.clear();
+		}
+
+	  private:
+		struct path_entry
+		{
+			std::optional<std::int64_t> id;
+			clock_type::time_point expires_at;
+		}; // struct path_entry
+
+		struct collection_entry
+		{
+			quotas_info_type info;
+			clock_type::time_point expires_at;
+		}; // struct collection_entry
+
+		auto erase_paths_in_tree(std::string_view _path, bool _erase_collections) -> void
+		{
+			for (auto iter = std::begin(paths_); iter != std::end(paths_);) {
+				const std::string_view p = iter->first;
+
+				if (p == _path || (p.size() > _path.size() && p.substr(0, _path.size()) == _path &&
+				                   ('/' == p[_path.size()] || "/" == _path)))
+				{
+					if (_erase_collections && iter->second.id) {
+						collections_.erase(*iter->second.id);
+					}
+
+					iter = paths_.erase(iter);
+				}
+				else {
+					++iter;
+				}
+			}
+		}
+
+		std::chrono::seconds ttl_;
+		std::unordered_map<std::string, path_entry> paths_;
+		std::unordered_map<std::int64_t, collection_entry> collections_;
+	}; // class monitored_collection_cache
+} // namespace irods
+
+#endif // IRODS_LOGICAL_QUOTAS_MONITORED_COLLECTION_CACHE_HPP
@@ -0,0 +1,223 @@
+#include "monitored_collection_index.hpp"
+
+#include <boost/interprocess/managed_shared_memory.hpp>
+#include <boost/interprocess/sync/interprocess_mutex.hpp>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <string_view>
+
+namespace
+{
+	namespace bi = boost::interprocess;
+
+	// The maximum number of monitored collections the table can hold. If a zone monitors more
+	// collections than this, the table is marked as overflowed and agents fall back to the catalog.
+	constexpr std::size_t max_number_of_entries = 4096;
+
+	// Matches MAX_NAME_LEN defined by iRODS.
+	constexpr std::size_t max_path_length = 1088;
+
+	struct shared_entry
+	{
+		char path[max_path_length];
+		std::int64_t collection_id;
+		std::int64_t maximum_number_of_data_objects;
+		std::int64_t maximum_size_in_bytes;
+	}; // struct shared_entry
+
+	auto to_seconds_since_epoch(std::chrono::system_clock::time_point _tp) -> std::int64_t
+	{
+		return std::chrono::duration_cast<std::chrono::seconds>(_tp.time_since_epoch()).count();
+	}
+} // anonymous namespace
+
+namespace irods
+{
+	struct monitored_collection_index::segment
+	{
+		bi::interprocess_mutex writer_mutex;
+
+		// Odd while a writer is modifying the table.
+		std::atomic<std::uint64_t> generation{0};
+
+		// The time the table was last loaded from the catalog. Zero means the table must be loaded.
+		std::atomic<std::int64_t> loaded_at{0};
+
+		// Incremented by every invalidation. Allows a writer to detect that the table was invalidated
+		// while it was loading the entries from the catalog.
+		std::atomic<std::uint64_t> invalidations{0};
+
+		std::atomic<bool> overflowed{false};
+
+		std::size_t size = 0;
+
+		// Sorted by path.
+		shared_entry entries[max_number_of_entries];
+	}; // struct monitored_collection_index::segment
+
+	monitored_collection_index::monitored_collection_index(const std::string& _instance_name,
+	                                                       std::chrono::seconds _time_to_live)
+		: ttl_{_time_to_live}
+		, shm_{}
+		, segment_{}
+	{
+		const auto shm_name = fmt::format("irods_logical_quotas_index_v3_{}", std::hash<std::string>{}(_instance_name));
+		const auto shm_size = sizeof(segment) + 64 * 1024; // Leave room for the segment's bookkeeping.
+
+		shm_ = std::make_unique<bi::managed_shared_memory>(bi::open_or_create, shm_name.c_str(), shm_size);
+		segment_ = shm_->find_or_construct<segment>("monitored_collection_index")();
+	}
+
+	monitored_collection_index::~monitored_collection_index() = default;
+
+	auto monitored_collection_index::usable() const noexcept -> bool
+	{
+		if (segment_->overflowed.load(std::memory_order_acquire)) {
+			return false;
+		}
+
+		const auto loaded_at = segment_->loaded_at.load(std::memory_order_acquire);
+
+		if (0 == loaded_at) {
+			return false;
+		}
+
+		return to_seconds_since_epoch(std::chrono::system_clock::now()) - loaded_at < ttl_.count();
+	}
+
+	auto monitored_collection_index::lookup(const std::vector<std::string>& _paths) const
+		-> std::optional<lookup_result_type>
+	{
+		constexpr int max_attempts = 8;
+
+		for (int attempt = 0; attempt < max_attempts; ++attempt) {
+			if (!usable()) {
+				return std::nullopt;
+			}
+
+			const auto generation = segment_->generation.load(std::memory_order_acquire);
+
+			// A writer is modifying the table.
+			if (generation & 1) {
+				continue;
+			}
+
+			lookup_result_type result;
+			result.reserve(_paths.size());
+
+			const auto* first = segment_->entries;
+			const auto* last = first + std::min(segment_->size, max_number_of_entries);
+
+			for (auto&& p : _paths) {
+				const auto iter = std::lower_bound(first, last, p, [](const shared_entry& _e, const std::string& _p) {
+					return std::string_view{_e.path} < _p;
+				});
+
+				if (iter != last && std::string_view{iter->path} == p) {
+					result.push_back(match{
+						iter->collection_id, {iter->maximum_number_of_data_objects, iter->maximum_size_in_bytes}});
+				}
+				else {
+					result.push_back(std::nullopt);
+				}
+			}
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+
+			if (segment_->generation.load(std::memory_order_relaxed) == generation) {
+				return result;
+			}
+		}
+
+		return std::nullopt;
+	}
+
+	auto monitored_collection_index::contains_tree(const std::string& _path) const -> bool
+	{
+		// The result only needs to be approximately correct, therefore the generation counter is
+		// not checked. A false positive only results in the table being reloaded.
+		const auto* first = segment_->entries;
+		const auto* last = first + std::min(segment_->size, max_number_of_entries);
+
+		const auto less = [](const shared_entry& _e, const std::string& _p) { return std::string_view{_e.path} < _p; };
+
+		if (const auto iter = std::lower_bound(first, last, _path, less); iter != last && iter->path == _path) {
+			return true;
+		}
+
+		// Descendants of "_path" are stored contiguously, starting at the first entry which is not
+		// less than "_path/".
+		const auto prefix = ("/" == _path) ? _path : _path + '/';
+		const auto iter = std::lower_bound(first, last, prefix, less);
+
+		return iter != last && std::string_view{iter->path}.substr(0, prefix.size()) == prefix;
+	}
+
+	auto monitored_collection_index::invalidate() noexcept -> void
+	{
+		segment_->invalidations.fetch_add(1);
+		segment_->loaded_at.store(0);
+	}
+
+	auto monitored_collection_index::invalidation_epoch() const noexcept -> std::uint64_t
+	{
+		return segment_->invalidations.load();
+	}
+
+	auto monitored_collection_index::try_lock() -> bool
+	{
+		return segment_->writer_mutex.try_lock();
+	}
+
+	auto monitored_collection_index::unlock() -> void
+	{
+		segment_->writer_mutex.unlock();
+	}
+
+	auto monitored_collection_index::replace(std::vector<entry>& _entries, std::uint64_t _invalidation_epoch) -> void
+	{
+		std::sort(std::begin(_entries), std::end(_entries), [](const entry& _lhs, const entry& _rhs) {
+			return _lhs.path < _rhs.path;
+		});
+
+		const auto overflowed =
+			_entries.size() > max_number_of_entries ||
+			std::any_of(std::begin(_entries), std::end(_entries), [](const entry& _e) {
+				return _e.path.size() >= max_path_length;
+			});
+
+		segment_->generation.fetch_add(1, std::memory_order_acq_rel);
+
+		if (!overflowed) {
+			for (std::size_t i = 0; i < _entries.size(); ++i) {
+				auto& dst = segment_->entries[i];
+				std::memset(dst.path, 0, sizeof(dst.path));
+				std::memcpy(dst.path, _entries[i].path.data(), _entries[i].path.size());
+				dst.collection_id = _entries[i].value.collection_id;
+				dst.maximum_number_of_data_objects = _entries[i].value.limits.maximum_number_of_data_objects;
+				dst.maximum_size_in_bytes = _entries[i].value.limits.maximum_size_in_bytes;
+			}
+
+			segment_->size = _entries.size();
+		}
+
+		segment_->overflowed.store(overflowed, std::memory_order_release);
+
+		// The entries are published either way, but the table is only marked as loaded if it was not
+		// invalidated since "_invalidation_epoch" was read. The epoch is checked again after the store
+		// because an invalidation may happen in between, and its own store may have come first.
+		if (segment_->invalidations.load() == _invalidation_epoch) {
+			segment_->loaded_at.store(to_seconds_since_epoch(std::chrono::system_clock::now()));
+
+			if (segment_->invalidations.load() != _invalidation_epoch) {
+				segment_->loaded_at.store(0);
+			}
+		}
+
+		segment_->generation.fetch_add(1, std::memory_order_acq_rel);
+	}
+} // namespace irods
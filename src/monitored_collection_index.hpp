@@ -0,0 +1,109 @@
+#ifndef IRODS_LOGICAL_QUOTAS_MONITORED_COLLECTION_INDEX_HPP
+#define IRODS_LOGICAL_QUOTAS_MONITORED_COLLECTION_INDEX_HPP
+
+#include <boost/interprocess/interprocess_fwd.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace irods
+{
+	// A table of monitored collections which is shared by all agents on a server.
+	//
+	// The table lives in a shared memory segment which is created by the first agent to load the
+	// plugin. Every other agent attaches to the existing segment. The table allows an agent to
+	// determine which collections are monitored without querying the catalog.
+	//
+	// Readers never block. Writers increment a generation counter before and after modifying the
+	// table. Readers retry a lookup if the generation counter changed while they were reading.
+	class monitored_collection_index final
+	{
+	  public:
+		// The quota limits of a monitored collection. A negative value means the limit is not set.
+		struct quota_limits
+		{
+			std::int64_t maximum_number_of_data_objects = -1;
+			std::int64_t maximum_size_in_bytes = -1;
+		}; // struct quota_limits
+
+		// A monitored collection, as found by lookup().
+		struct match
+		{
+			std::int64_t collection_id = 0;
+			quota_limits limits;
+		}; // struct match
+
+		struct entry
+		{
+			std::string path;
+			match value;
+		}; // struct entry
+
+		using lookup_result_type = std::vector<std::optional<match>>;
+
+		monitored_collection_index(const std::string& _instance_name, std::chrono::seconds _time_to_live);
+
+		~monitored_collection_index();
+
+		monitored_collection_index(const monitored_collection_index&) = delete;
+		auto operator=(const monitored_collection_index&) -> monitored_collection_index& = delete;
+
+		// Returns true if the table holds a complete, unexpired copy of the monitored collections.
+		auto usable() const noexcept -> bool;
+
+		// Looks up each path in the table. The result holds the collection ID and limits for every
+		// monitored path and std::nullopt for every unmonitored path. Returns std::nullopt if the table is not
+		// usable or a consistent view could not be obtained.
+		auto lookup(const std::vector<std::string>& _paths) const -> std::optional<lookup_result_type>;
+
+		// Returns true if "_path" or any collection under it is in the table.
+		auto contains_tree(const std::string& _path) const -> bool;
+
+		// Attempts to replace the contents of the table. "_load" is only invoked if no other agent
+		// is updating the table. Returns true if the table was replaced. The table is not marked as
+		// loaded if it was invalidated while "_load" was running, because the entries may predate
+		// the change which caused the invalidation.
+		template <typename Function>
+		auto try_reload(Function _load) -> bool
+		{
+			if (!try_lock()) {
+				return false;
+			}
+
+			try {
+				const auto epoch = invalidation_epoch();
+				auto entries = _load();
+				replace(entries, epoch);
+			}
+			catch (...) {
+				unlock();
+				throw;
+			}
+
+			unlock();
+
+			return true;
+		}
+
+		// Forces the next reader to reload the table from the catalog.
+		auto invalidate() noexcept -> void;
+
+	  private:
+		struct segment;
+
+		auto try_lock() -> bool;
+		auto unlock() -> void;
+		auto invalidation_epoch() const noexcept -> std::uint64_t;
+		auto replace(std::vector<entry>& _entries, std::uint64_t _invalidation_epoch) -> void;
+
+		std::chrono::seconds ttl_;
+		std::unique_ptr<boost::interprocess::managed_shared_memory> shm_;
+		segment* segment_;
+	}; // class monitored_collection_index
+} // namespace irods
+
+#endif // IRODS_LOGICAL_QUOTAS_MONITORED_COLLECTION_INDEX_HPP
@@ -0,0 +1,121 @@
+#ifndef IRODS_LOGICAL_QUOTAS_PENDING_QUOTA_UPDATES_HPP
+#define IRODS_LOGICAL_QUOTAS_PENDING_QUOTA_UPDATES_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace irods
+{
+	// Holds the settings which control when pending quota updates are written to the catalog. A
+	// maximum number of pending updates of zero disables write-behind.
+	struct write_behind_options
+	{
+		// The number of updates which may be held in memory before they are written to the catalog.
+		std::int64_t maximum_pending_updates = 0;
+
+		// The absolute number of bytes which may be held in memory for a single collection before
+		// the pending updates are written to the catalog. Zero means no limit.
+		std::int64_t maximum_pending_bytes = 0;
+
+		// The number of seconds an update may be held in memory before it is written to the catalog.
+		std::chrono::seconds flush_interval{5};
+	}; // struct write_behind_options
+
+	// An in-process buffer which accumulates changes to the totals of monitored collections.
+	//
+	// Changes are coalesced per collection so that many updates to the same collection result in a
+	// single catalog write. The buffer does not write anything itself. The caller decides when to
+	// flush by calling should_flush() and take().
+	class pending_quota_updates final
+	{
+	  public:
+		using clock_type = std::chrono::steady_clock;
+
+		struct delta
+		{
+			std::int64_t data_objects = 0;
+			std::int64_t size_in_bytes = 0;
+		}; // struct delta
+
+		using delta_map_type = std::unordered_map<std::string, delta>;
+
+		explicit pending_quota_updates(write_behind_options _options) noexcept
+			: options_{_options}
+		{
+		}
+
+		pending_quota_updates(const pending_quota_updates&) = delete;
+		auto operator=(const pending_quota_updates&) -> pending_quota_updates& = delete;
+
+		auto enabled() const noexcept -> bool
+		{
+			return options_.maximum_pending_updates > 0;
+		}
+
+		auto empty() const noexcept -> bool
+		{
+			return deltas_.empty();
+		}
+
+		auto add(const std::string& _path, std::int64_t _data_objects_delta, std::int64_t _size_in_bytes_delta)
+			-> void
+		{
+			if (deltas_.empty()) {
+				oldest_ = clock_type::now();
+			}
+
+			auto& d = deltas_[_path];
+			d.data_objects += _data_objects_delta;
+			d.size_in_bytes += _size_in_bytes_delta;
+
+			++number_of_updates_;
+
+			if (options_.maximum_pending_bytes > 0 && std::abs(d.size_in_bytes) >= options_.maximum_pending_bytes) {
+				byte_limit_reached_ = true;
+			}
+		}
+
+		// Returns the pending changes for "_path". Collections without pending changes produce a
+		// delta of zero.
+		auto find(const std::string& _path) const -> delta
+		{
+			if (const auto iter = deltas_.find(_path); iter != std::end(deltas_)) {
+				return iter->second;
+			}
+
+			return {};
+		}
+
+		// Returns true if the pending changes should be written to the catalog.
+		auto should_flush() const noexcept -> bool
+		{
+			if (deltas_.empty()) {
+				return false;
+			}
+
+			return number_of_updates_ >= options_.maximum_pending_updates || byte_limit_reached_ ||
+			       clock_type::now() - oldest_ >= options_.flush_interval;
+		}
+
+		// Removes and returns every pending change.
+		auto take() -> delta_map_type
+		{
+			number_of_updates_ = 0;
+			byte_limit_reached_ = false;
+			return std::exchange(deltas_, {});
+		}
+
+	  private:
+		write_behind_options options_;
+		delta_map_type deltas_;
+		std::int64_t number_of_updates_ = 0;
+		bool byte_limit_reached_ = false;
+		clock_type::time_point oldest_;
+	}; // class pending_quota_updates
+} // namespace irods
+
+#endif // IRODS_LOGICAL_QUOTAS_PENDING_QUOTA_UPDATES_HPP
@@ -0,0 +1,239 @@
+#include "plugin_statistics.hpp"
+
+#include <boost/interprocess/managed_shared_memory.hpp>
+#include <boost/interprocess/sync/interprocess_mutex.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
+
+namespace
+{
+	namespace bi = boost::interprocess;
+
+	// The plugin has fewer handlers than this. Handlers which do not fit are not measured.
+	constexpr std::size_t max_number_of_handlers = 64;
+
+	constexpr std::size_t max_handler_name_length = 64;
+
+	// Bucket N counts the invocations which took less than 2^N microseconds. The last bucket counts
+	// everything else.
+	constexpr std::size_t number_of_latency_buckets = 24;
+
+	constexpr std::size_t number_of_events = 4;
+
+	// The counters which are summed over all handlers.
+	constexpr const char* event_names[number_of_events] = {
+		"gen_queries", "specific_queries", "metadata_writes", "quota_violations"};
+
+	auto to_seconds_since_epoch(std::chrono::system_clock::time_point _tp) -> std::int64_t
+	{
+		return std::chrono::duration_cast<std::chrono::seconds>(_tp.time_since_epoch()).count();
+	}
+} // anonymous namespace
+
+namespace irods
+{
+	struct plugin_statistics::handler_slot
+	{
+		char name[max_handler_name_length];
+		std::atomic<std::uint64_t> calls{0};
+		std::atomic<std::uint64_t> errors{0};
+		std::atomic<std::uint64_t> total_latency_in_microseconds{0};
+		std::atomic<std::uint64_t> events[number_of_events]{};
+		std::atomic<std::uint64_t> latency_buckets[number_of_latency_buckets]{};
+	}; // struct plugin_statistics::handler_slot
+
+	struct plugin_statistics::segment
+	{
+		// Only held while a handler is added.
+		bi::interprocess_mutex writer_mutex;
+
+		std::int64_t created_at = to_seconds_since_epoch(std::chrono::system_clock::now());
+
+		// A slot is fully initialized before it is counted.
+		std::atomic<std::size_t> size{0};
+
+		handler_slot slots[max_number_of_handlers];
+	}; // struct plugin_statistics::segment
+
+	thread_local plugin_statistics::handler_slot* plugin_statistics::active_slot_ = nullptr;
+
+	plugin_statistics::scoped_call::scoped_call(plugin_statistics* _statistics, std::string_view _handler_name)
+		: slot_{_statistics ? _statistics->find_or_add_slot(_handler_name) : nullptr}
+		, previous_slot_{active_slot_}
+		, start_{std::chrono::steady_clock::now()}
+		, failed_{false}
+	{
+		if (slot_) {
+			active_slot_ = slot_;
+		}
+	}
+
+	plugin_statistics::scoped_call::~scoped_call()
+	{
+		if (!slot_) {
+			return;
+		}
+
+		active_slot_ = previous_slot_;
+
+		using std::chrono::duration_cast;
+		using std::chrono::microseconds;
+
+		const auto elapsed = duration_cast<microseconds>(std::chrono::steady_clock::now() - start_).count();
+		const auto us = static_cast<std::uint64_t>(std::max<std::int64_t>(elapsed, 0));
+		const auto bucket = std::min<std::size_t>(std::bit_width(us), number_of_latency_buckets - 1);
+
+		slot_->calls.fetch_add(1, std::memory_order_relaxed);
+		slot_->total_latency_in_microseconds.fetch_add(us, std::memory_order_relaxed);
+		slot_->latency_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+
+		if (failed_) {
+			slot_->errors.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	auto plugin_statistics::scoped_call::failed() noexcept -> void
+	{
+		failed_ = true;
+	}
+
+	plugin_statistics::attribution::attribution() noexcept
+		: slot_{active_slot_}
+	{
+	}
+
+	plugin_statistics::attribution::scope::scope(const attribution& _attribution) noexcept
+		: previous_slot_{active_slot_}
+	{
+		active_slot_ = _attribution.slot_;
+	}
+
+	plugin_statistics::attribution::scope::~scope()
+	{
+		active_slot_ = previous_slot_;
+	}
+
+	plugin_statistics::plugin_statistics(const std::string& _instance_name)
+		: shm_{}
+		, segment_{}
+		, slots_{}
+	{
+		const auto shm_name =
+			fmt::format("irods_logical_quotas_statistics_v1_{}", std::hash<std::string>{}(_instance_name));
+		const auto shm_size = sizeof(segment) + 64 * 1024; // Leave room for the segment's bookkeeping.
+
+		shm_ = std::make_unique<bi::managed_shared_memory>(bi::open_or_create, shm_name.c_str(), shm_size);
+		segment_ = shm_->find_or_construct<segment>("plugin_statistics")();
+	}
+
+	plugin_statistics::~plugin_statistics() = default;
+
+	auto plugin_statistics::record(event _event) noexcept -> void
+	{
+		if (active_slot_) {
+			active_slot_->events[static_cast<std::size_t>(_event)].fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	auto plugin_statistics::to_json() const -> nlohmann::json
+	{
+		auto handlers = nlohmann::json::object();
+		auto totals = nlohmann::json::object({{"calls", 0}, {"errors", 0}});
+
+		for (const auto* name : event_names) {
+			totals[name] = 0;
+		}
+
+		const auto size = std::min(segment_->size.load(std::memory_order_acquire), max_number_of_handlers);
+
+		for (std::size_t i = 0; i < size; ++i) {
+			const auto& slot = segment_->slots[i];
+
+			const auto calls = slot.calls.load(std::memory_order_relaxed);
+			const auto errors = slot.errors.load(std::memory_order_relaxed);
+
+			auto histogram = nlohmann::json::array();
+
+			for (std::size_t b = 0; b < number_of_latency_buckets; ++b) {
+				// The last bucket has no upper bound.
+				const auto upper_bound = (b + 1 < number_of_latency_buckets) ? nlohmann::json(std::uint64_t{1} << b)
+				                                                             : nlohmann::json(nullptr);
+
+				histogram.push_back({{"less_than_microseconds", upper_bound},
+				                     {"count", slot.latency_buckets[b].load(std::memory_order_relaxed)}});
+			}
+
+			auto h = nlohmann::json::object({{"calls", calls},
+			                                 {"errors", errors},
+			                                 {"total_latency_in_microseconds",
+			                                  slot.total_latency_in_microseconds.load(std::memory_order_relaxed)},
+			                                 {"latency_histogram", std::move(histogram)}});
+
+			totals["calls"] = totals["calls"].get<std::uint64_t>() + calls;
+			totals["errors"] = totals["errors"].get<std::uint64_t>() + errors;
+
+			for (std::size_t e = 0; e < number_of_events; ++e) {
+				const auto n = slot.events[e].load(std::memory_order_relaxed);
+				h[event_names[e]] = n;
+				totals[event_names[e]] = totals[event_names[e]].get<std::uint64_t>() + n;
+			}
+
+			handlers[slot.name] = std::move(h);
+		}
+
+		return {{"collecting_since", segment_->created_at},
+		        {"totals", std::move(totals)},
+		        {"handlers", std::move(handlers)}};
+	}
+
+	auto plugin_statistics::find_or_add_slot(std::string_view _handler_name) -> handler_slot*
+	{
+		if (const auto iter = slots_.find(_handler_name); iter != std::end(slots_)) {
+			return iter->second;
+		}
+
+		if (_handler_name.size() >= max_handler_name_length) {
+			return nullptr;
+		}
+
+		const auto find = [this, _handler_name](std::size_t _size) -> handler_slot* {
+			for (std::size_t i = 0; i < _size; ++i) {
+				if (_handler_name == segment_->slots[i].name) {
+					return &segment_->slots[i];
+				}
+			}
+
+			return nullptr;
+		};
+
+		auto* slot = find(std::min(segment_->size.load(std::memory_order_acquire), max_number_of_handlers));
+
+		if (!slot) {
+			bi::scoped_lock lock{segment_->writer_mutex};
+
+			const auto size = segment_->size.load(std::memory_order_relaxed);
+			slot = find(size);
+
+			if (!slot) {
+				if (size == max_number_of_handlers) {
+					return nullptr;
+				}
+
+				slot = &segment_->slots[size];
+				std::memset(slot->name, 0, sizeof(slot->name));
+				std::memcpy(slot->name, _handler_name.data(), _handler_name.size());
+				segment_->size.store(size + 1, std::memory_order_release);
+			}
+		}
+
+		slots_.emplace(_handler_name, slot);
+
+		return slot;
+	}
+} // namespace irods
@@ -0,0 +1,117 @@
+#ifndef IRODS_LOGICAL_QUOTAS_PLUGIN_STATISTICS_HPP
+#define IRODS_LOGICAL_QUOTAS_PLUGIN_STATISTICS_HPP
+
+#include <boost/interprocess/interprocess_fwd.hpp>
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace irods
+{
+	// Call counts, latency histograms and catalog request counters for each handler of the plugin.
+	//
+	// The counters live in a shared memory segment, so they cover every agent on the server. Like
+	// the table of monitored collections, the segment is created by the first agent to load the
+	// plugin and every other agent attaches to it. Counters are only ever incremented, using relaxed
+	// atomic operations, so recording never blocks.
+	class plugin_statistics final
+	{
+		struct handler_slot;
+
+	  public:
+		enum class event
+		{
+			gen_query,
+			specific_query,
+			metadata_write,
+			quota_violation
+		}; // enum class event
+
+		// Measures a single invocation of a handler. Events recorded while the object is alive are
+		// attributed to the handler.
+		class scoped_call final
+		{
+		  public:
+			// "_statistics" may be null, in which case nothing is recorded.
+			scoped_call(plugin_statistics* _statistics, std::string_view _handler_name);
+
+			~scoped_call();
+
+			scoped_call(const scoped_call&) = delete;
+			auto operator=(const scoped_call&) -> scoped_call& = delete;
+
+			// Marks the invocation as failed.
+			auto failed() noexcept -> void;
+
+		  private:
+			handler_slot* slot_;
+			handler_slot* previous_slot_;
+			std::chrono::steady_clock::time_point start_;
+			bool failed_;
+		}; // class scoped_call
+
+		// Carries the handler being measured by one thread to other threads working on its behalf.
+		class attribution final
+		{
+		  public:
+			// Captures the handler being measured by the calling thread.
+			attribution() noexcept;
+
+			// Attributes the events recorded by the calling thread to the captured handler while
+			// the returned object is alive.
+			class scope final
+			{
+			  public:
+				explicit scope(const attribution& _attribution) noexcept;
+
+				~scope();
+
+				scope(const scope&) = delete;
+				auto operator=(const scope&) -> scope& = delete;
+
+			  private:
+				handler_slot* previous_slot_;
+			}; // class scope
+
+		  private:
+			handler_slot* slot_;
+		}; // class attribution
+
+		explicit plugin_statistics(const std::string& _instance_name);
+
+		~plugin_statistics();
+
+		plugin_statistics(const plugin_statistics&) = delete;
+		auto operator=(const plugin_statistics&) -> plugin_statistics& = delete;
+
+		// Records an event against the handler currently being measured. Does nothing if no handler
+		// is being measured.
+		static auto record(event _event) noexcept -> void;
+
+		// Returns the counters of every handler invoked since the segment was created.
+		auto to_json() const -> nlohmann::json;
+
+	  private:
+		struct segment;
+
+		auto find_or_add_slot(std::string_view _handler_name) -> handler_slot*;
+
+		// The slot of the handler being measured. Agents handle one request at a time, so there is
+		// at most one such handler.
+		static thread_local handler_slot* active_slot_;
+
+		std::unique_ptr<boost::interprocess::managed_shared_memory> shm_;
+		segment* segment_;
+
+		// Maps handler names to their slot in the segment so that a slot is only searched for once
+		// per agent.
+		std::map<std::string, handler_slot*, std::less<>> slots_;
+	}; // class plugin_statistics
+} // namespace irods
+
+#endif // IRODS_LOGICAL_QUOTAS_PLUGIN_STATISTICS_HPP
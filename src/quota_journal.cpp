@@ -0,0 +1,327 @@
+#include "quota_journal.hpp"
+
+#include <fmt/format.h>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+	constexpr std::uint64_t journal_magic = 0x4c514a524e4c0001; // "LQJRNL" + version.
+
+	// The maximum number of records a journal can hold.
+	constexpr std::uint64_t max_number_of_records = 1024;
+
+	// Matches MAX_NAME_LEN defined by iRODS.
+	constexpr std::size_t max_path_length = 1088;
+
+	// A record whose path is empty has been applied. Clearing the first character of the path is a
+	// single store, so a record is never left half applied.
+	struct record
+	{
+		std::int64_t data_objects;
+		std::int64_t size_in_bytes;
+		char path[max_path_length];
+	}; // struct record
+
+	auto path_of(const record& _r) -> std::string_view
+	{
+		return {_r.path, strnlen(_r.path, sizeof(_r.path))};
+	}
+
+	auto mark_applied(record* _first, record* _last, std::string_view _path) noexcept -> void
+	{
+		for (; _first != _last; ++_first) {
+			if (path_of(*_first) == _path) {
+				_first->path[0] = '\0';
+			}
+		}
+	}
+
+	auto is_running(pid_t _pid) -> bool
+	{
+		return 0 == kill(_pid, 0) || EPERM == errno;
+	}
+
+	auto throw_system_error(const std::string& _msg) -> void
+	{
+		throw std::system_error{errno, std::generic_category(), _msg};
+	}
+} // anonymous namespace
+
+namespace irods
+{
+	struct quota_journal::header
+	{
+		std::uint64_t magic;
+
+		// The number of complete records. A record is only counted once it has been written in
+		// full, therefore a partially written record is never replayed.
+		std::atomic<std::uint64_t> size;
+
+		record records[max_number_of_records];
+	}; // struct quota_journal::header
+
+	quota_journal::quota_journal(std::string _directory, const std::string& _instance_name)
+		: directory_{std::move(_directory)}
+		, prefix_{fmt::format("irods_logical_quotas_{}.", std::hash<std::string>{}(_instance_name))}
+		, owner_pid_{-1}
+		, fd_{-1}
+		, mapping_{}
+	{
+		std::filesystem::create_directories(directory_);
+	}
+
+	quota_journal::~quota_journal()
+	{
+		close();
+	}
+
+	auto quota_journal::append(const std::string& _path,
+	                           std::int64_t _data_objects_delta,
+	                           std::int64_t _size_in_bytes_delta) -> bool
+	{
+		if (_path.size() >= max_path_length) {
+			return false;
+		}
+
+		if (getpid() != owner_pid_) {
+			open_for_current_process();
+		}
+
+		auto* h = static_cast<header*>(mapping_);
+		const auto size = h->size.load(std::memory_order_relaxed);
+
+		if (size >= max_number_of_records) {
+			return false;
+		}
+
+		auto& r = h->records[size];
+		r.data_objects = _data_objects_delta;
+		r.size_in_bytes = _size_in_bytes_delta;
+		std::memset(r.path, 0, sizeof(r.path));
+		std::memcpy(r.path, _path.data(), _path.size());
+
+		h->size.store(size + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	auto quota_journal::mark_applied(const std::string& _path) noexcept -> void
+	{
+		if (mapping_ && getpid() == owner_pid_) {
+			auto* h = static_cast<header*>(mapping_);
+			const auto size = std::min(h->size.load(std::memory_order_acquire), max_number_of_records);
+			::mark_applied(h->records, h->records + size, _path);
+		}
+	}
+
+	auto quota_journal::reset() noexcept -> void
+	{
+		if (mapping_ && getpid() == owner_pid_) {
+			static_cast<header*>(mapping_)->size.store(0, std::memory_order_release);
+		}
+	}
+
+	auto quota_journal::replay(const apply_function_type& _apply) const -> int
+	{
+		int replayed = 0;
+
+		for (auto&& entry : std::filesystem::directory_iterator{directory_}) {
+			const auto filename = entry.path().filename().string();
+
+			// Journals are named "<prefix><pid>.<timestamp>.journal".
+			if (filename.compare(0, prefix_.size(), prefix_) != 0) {
+				continue;
+			}
+
+			pid_t pid{};
+
+			try {
+				pid = std::stoi(filename.substr(prefix_.size()));
+			}
+			catch (const std::exception&) {
+				continue;
+			}
+
+			// Skip the journal in use by this agent and the journals of other running agents. A
+			// journal of this agent which is not in use was left behind by a failed replay.
+			if (entry.path() == path_ || (getpid() != pid && is_running(pid))) {
+				continue;
+			}
+
+			// Claim the journal by renaming it so that it appears to belong to this process. Only
+			// one agent can succeed. If this agent dies during the replay, the journal is orphaned
+			// again and another agent will pick it up.
+			const auto claimed_path = make_path_for_current_process();
+
+			if (::rename(entry.path().c_str(), claimed_path.c_str()) != 0) {
+				if (ENOENT == errno) {
+					continue;
+				}
+
+				throw_system_error(fmt::format("Failed to claim journal [{}]", entry.path().string()));
+			}
+
+			const auto fd = ::open(claimed_path.c_str(), O_RDWR);
+
+			if (fd < 0) {
+				throw_system_error(fmt::format("Failed to open journal [{}]", claimed_path.string()));
+			}
+
+			struct stat st{};
+
+			if (::fstat(fd, &st) != 0) {
+				::close(fd);
+				throw_system_error(fmt::format("Failed to stat journal [{}]", claimed_path.string()));
+			}
+
+			// A journal is sized and initialized when it is created. Anything else was abandoned
+			// before a record could be written to it.
+			if (static_cast<std::size_t>(st.st_size) != sizeof(header)) {
+				::close(fd);
+				std::filesystem::remove(claimed_path);
+				continue;
+			}
+
+			auto* mapping = ::mmap(nullptr, sizeof(header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			::close(fd);
+
+			if (MAP_FAILED == mapping) {
+				throw_system_error(fmt::format("Failed to map journal [{}]", claimed_path.string()));
+			}
+
+			auto* h = static_cast<header*>(mapping);
+
+			if (journal_magic != h->magic) {
+				::munmap(mapping, sizeof(header));
+				std::filesystem::remove(claimed_path);
+				continue;
+			}
+
+			const auto size = std::min(h->size.load(std::memory_order_acquire), max_number_of_records);
+
+			std::unordered_map<std::string, std::pair<std::int64_t, std::int64_t>> deltas;
+
+			for (std::uint64_t i = 0; i < size; ++i) {
+				const auto& r = h->records[i];
+
+				if (const auto path = path_of(r); !path.empty()) {
+					auto& d = deltas[std::string{path}];
+					d.first += r.data_objects;
+					d.second += r.size_in_bytes;
+				}
+			}
+
+			try {
+				// The records of a collection are marked as applied as soon as its change has been
+				// applied. If the replay fails or this agent dies, the next replay only applies the
+				// changes which are left.
+				for (auto&& [path, delta] : deltas) {
+					if (0 != delta.first || 0 != delta.second) {
+						_apply(path, delta.first, delta.second);
+					}
+
+					::mark_applied(h->records, h->records + size, path);
+				}
+			}
+			catch (...) {
+				::munmap(mapping, sizeof(header));
+				throw;
+			}
+
+			::munmap(mapping, sizeof(header));
+			std::filesystem::remove(claimed_path);
+			++replayed;
+		}
+
+		return replayed;
+	}
+
+	auto quota_journal::open_for_current_process() -> void
+	{
+		// A journal inherited from a parent process belongs to the parent.
+		if (mapping_) {
+			::munmap(mapping_, sizeof(header));
+			::close(fd_);
+			mapping_ = nullptr;
+			fd_ = -1;
+		}
+
+		const auto path = make_path_for_current_process();
+
+		fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+		path_ = path.string();
+
+		if (fd_ < 0) {
+			throw_system_error(fmt::format("Failed to create journal [{}]", path.string()));
+		}
+
+		if (::ftruncate(fd_, sizeof(header)) != 0) {
+			const auto ec = errno;
+			::close(fd_);
+			fd_ = -1;
+			errno = ec;
+			throw_system_error(fmt::format("Failed to resize journal [{}]", path.string()));
+		}
+
+		mapping_ = ::mmap(nullptr, sizeof(header), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+
+		if (MAP_FAILED == mapping_) {
+			const auto ec = errno;
+			mapping_ = nullptr;
+			::close(fd_);
+			fd_ = -1;
+			errno = ec;
+			throw_system_error(fmt::format("Failed to map journal [{}]", path.string()));
+		}
+
+		auto* h = static_cast<header*>(mapping_);
+		h->magic = journal_magic;
+		h->size.store(0, std::memory_order_release);
+
+		owner_pid_ = getpid();
+	}
+
+	auto quota_journal::make_path_for_current_process() const -> std::filesystem::path
+	{
+		// The timestamp keeps a new agent from reusing the journal of a dead agent with the same PID.
+		const auto now = std::chrono::system_clock::now().time_since_epoch().count();
+		return std::filesystem::path{directory_} / fmt::format("{}{}.{}.journal", prefix_, getpid(), now);
+	}
+
+	auto quota_journal::close() noexcept -> void
+	{
+		if (!mapping_) {
+			return;
+		}
+
+		// Only the owner may remove the journal, and only if every change has been applied.
+		const auto remove = getpid() == owner_pid_ && 0 == static_cast<header*>(mapping_)->size.load();
+
+		::munmap(mapping_, sizeof(header));
+		::close(fd_);
+
+		if (remove) {
+			::unlink(path_.c_str());
+		}
+
+		mapping_ = nullptr;
+		fd_ = -1;
+	}
+} // namespace irods
@@ -0,0 +1,68 @@
+#ifndef IRODS_LOGICAL_QUOTAS_QUOTA_JOURNAL_HPP
+#define IRODS_LOGICAL_QUOTAS_QUOTA_JOURNAL_HPP
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+
+namespace irods
+{
+	// An append-only journal of changes to the totals of monitored collections.
+	//
+	// Each agent records a change in its own memory-mapped file before the change is held in memory
+	// for write-behind. If the agent dies before the change is written to the catalog, the change
+	// can be recovered from the file via replay(). Storing a change costs a memory store instead of
+	// a catalog transaction. The pages are shared with the kernel, so a record survives the death of
+	// the agent. A crash of the host can still lose records which have not been written back.
+	class quota_journal final
+	{
+	  public:
+		using apply_function_type =
+			std::function<void(const std::string& _path, std::int64_t _data_objects, std::int64_t _size_in_bytes)>;
+
+		quota_journal(std::string _directory, const std::string& _instance_name);
+
+		~quota_journal();
+
+		quota_journal(const quota_journal&) = delete;
+		auto operator=(const quota_journal&) -> quota_journal& = delete;
+
+		// Records a change. Returns false if the journal is full, in which case nothing is recorded.
+		// The journal should be emptied by writing all pending changes to the catalog and calling
+		// reset().
+		auto append(const std::string& _path, std::int64_t _data_objects_delta, std::int64_t _size_in_bytes_delta)
+			-> bool;
+
+		// Marks every record of "_path" as applied, so that it is not replayed. Must be called as soon
+		// as the recorded changes of "_path" are in the catalog.
+		auto mark_applied(const std::string& _path) noexcept -> void;
+
+		// Discards every record. Must only be called once all recorded changes are in the catalog.
+		auto reset() noexcept -> void;
+
+		// Replays the journals left behind by agents which are no longer running. Changes are summed
+		// per collection and passed to "_apply". Records which were marked as applied are skipped. A
+		// journal is removed once all of its changes have been applied. Returns the number of journals
+		// replayed.
+		auto replay(const apply_function_type& _apply) const -> int;
+
+	  private:
+		struct header;
+
+		auto open_for_current_process() -> void;
+		auto make_path_for_current_process() const -> std::filesystem::path;
+		auto close() noexcept -> void;
+
+		std::string directory_;
+		std::string prefix_;
+		std::string path_;
+		pid_t owner_pid_;
+		int fd_;
+		void* mapping_;
+	}; // class quota_journal
+} // namespace irods
+
+#endif // IRODS_LOGICAL_QUOTAS_QUOTA_JOURNAL_HPP
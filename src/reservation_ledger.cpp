@@ -0,0 +1,168 @@
+#include "reservation_ledger.hpp"
+
+#include <boost/interprocess/managed_shared_memory.hpp>
+
+#include <fmt/format.h>
+
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <ctime>
+
+namespace
+{
+	namespace bi = boost::interprocess;
+
+	// The maximum number of reservations held at once. Each change reserves one slot per monitored
+	// collection it affects. Changes which do not fit are admitted against the totals alone.
+	constexpr std::size_t max_number_of_slots = 1024;
+
+	// How long an agent waits for the lock before admitting a change against the totals alone.
+	constexpr long lock_timeout_in_milliseconds = 50;
+
+	auto is_running(pid_t _pid) -> bool
+	{
+		return 0 == kill(_pid, 0) || EPERM == errno;
+	}
+} // anonymous namespace
+
+namespace irods
+{
+	struct reservation_ledger::slot
+	{
+		// The process holding the reservation. Zero means the slot is free. The other members are
+		// written before the slot is claimed.
+		std::atomic<pid_t> pid{0};
+		std::int64_t collection_id = 0;
+		std::int64_t data_objects = 0;
+		std::int64_t size_in_bytes = 0;
+	}; // struct reservation_ledger::slot
+
+	struct reservation_ledger::segment
+	{
+		segment()
+		{
+			// The mutex is robust so that it is not held forever if an agent dies while holding it.
+			// The next agent to lock it is told instead and takes it over.
+			pthread_mutexattr_t attr;
+			pthread_mutexattr_init(&attr);
+			pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+			pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+			pthread_mutex_init(&mutex, &attr);
+			pthread_mutexattr_destroy(&attr);
+		}
+
+		// Held while reservations are summed and added.
+		pthread_mutex_t mutex;
+
+		slot slots[max_number_of_slots];
+	}; // struct reservation_ledger::segment
+
+	reservation_ledger::reservation_ledger(const std::string& _instance_name)
+		: shm_{}
+		, segment_{}
+	{
+		const auto shm_name =
+			fmt::format("irods_logical_quotas_reservations_v2_{}", std::hash<std::string>{}(_instance_name));
+		const auto shm_size = sizeof(segment) + 64 * 1024; // Leave room for the segment's bookkeeping.
+
+		shm_ = std::make_unique<bi::managed_shared_memory>(bi::open_or_create, shm_name.c_str(), shm_size);
+		segment_ = shm_->find_or_construct<segment>("reservation_ledger")();
+	}
+
+	reservation_ledger::~reservation_ledger() = default;
+
+	auto reservation_ledger::release() noexcept -> void
+	{
+		const auto pid = getpid();
+
+		for (auto&& s : segment_->slots) {
+			if (s.pid.load(std::memory_order_relaxed) == pid) {
+				s.pid.store(0, std::memory_order_release);
+			}
+		}
+	}
+
+	auto reservation_ledger::try_lock() -> bool
+	{
+		timespec deadline{};
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += lock_timeout_in_milliseconds * 1'000'000;
+		deadline.tv_sec += deadline.tv_nsec / 1'000'000'000;
+		deadline.tv_nsec %= 1'000'000'000;
+
+		switch (pthread_mutex_timedlock(&segment_->mutex, &deadline)) {
+			case 0:
+				return true;
+
+			// The previous holder died while holding the lock. The slots remain valid because a slot
+			// is only claimed by the last write to it, so the lock is taken over as is.
+			case EOWNERDEAD:
+				pthread_mutex_consistent(&segment_->mutex);
+				return true;
+
+			default:
+				return false;
+		}
+	}
+
+	auto reservation_ledger::unlock() -> void
+	{
+		pthread_mutex_unlock(&segment_->mutex);
+	}
+
+	auto reservation_ledger::find_free_slot() -> slot*
+	{
+		const auto first = std::begin(segment_->slots);
+		const auto last = std::end(segment_->slots);
+
+		if (const auto iter = std::find_if(first, last, [](const slot& _s) { return 0 == _s.pid.load(); });
+		    iter != last)
+		{
+			return iter;
+		}
+
+		// Only look for reservations left behind by agents which are no longer running when the
+		// ledger is full.
+		const auto iter = std::find_if(first, last, [](const slot& _s) { return !is_running(_s.pid.load()); });
+
+		return iter != last ? iter : nullptr;
+	}
+
+	auto reservation_ledger::reserved_by_others(std::int64_t _collection_id) -> amounts
+	{
+		const auto self = getpid();
+		amounts reserved;
+
+		for (auto&& s : segment_->slots) {
+			const auto pid = s.pid.load(std::memory_order_acquire);
+
+			if (0 == pid || self == pid || s.collection_id != _collection_id) {
+				continue;
+			}
+
+			// The agent died before releasing its reservations.
+			if (!is_running(pid)) {
+				s.pid.store(0, std::memory_order_release);
+				continue;
+			}
+
+			reserved.data_objects += s.data_objects;
+			reserved.size_in_bytes += s.size_in_bytes;
+		}
+
+		return reserved;
+	}
+
+	auto reservation_ledger::add(slot* _slot, std::int64_t _collection_id, amounts _amounts) -> void
+	{
+		_slot->collection_id = _collection_id;
+		_slot->data_objects = std::max<std::int64_t>(_amounts.data_objects, 0);
+		_slot->size_in_bytes = std::max<std::int64_t>(_amounts.size_in_bytes, 0);
+		_slot->pid.store(getpid(), std::memory_order_release);
+	}
+} // namespace irods
@@ -0,0 +1,91 @@
+#ifndef IRODS_LOGICAL_QUOTAS_RESERVATION_LEDGER_HPP
+#define IRODS_LOGICAL_QUOTAS_RESERVATION_LEDGER_HPP
+
+#include <boost/interprocess/interprocess_fwd.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace irods
+{
+	// The changes admitted by agents which have not reached the totals yet.
+	//
+	// An agent reserves what a change adds to each monitored collection before the change is
+	// performed and releases the reservation once the totals have been updated. Admission checks
+	// the totals plus whatever other agents have reserved, so changes which start at the same time
+	// cannot exceed a limit together.
+	//
+	// Like the table of monitored collections, the ledger lives in a shared memory segment which is
+	// created by the first agent to load the plugin, so it covers the agents on one server only.
+	// Reservations are only added while holding a lock, which is taken over by the next agent if its
+	// holder dies. Releasing them never blocks. Reservations held by agents which are no longer running
+	// are reclaimed by the next agent that finds them.
+	class reservation_ledger final
+	{
+	  public:
+		struct amounts
+		{
+			std::int64_t data_objects = 0;
+			std::int64_t size_in_bytes = 0;
+		}; // struct amounts
+
+		explicit reservation_ledger(const std::string& _instance_name);
+
+		~reservation_ledger();
+
+		reservation_ledger(const reservation_ledger&) = delete;
+		auto operator=(const reservation_ledger&) -> reservation_ledger& = delete;
+
+		// Reserves "_amounts" against the collection identified by "_collection_id" on behalf of the
+		// calling process. "_admit" is invoked with the amounts reserved against the collection by
+		// other processes and must throw if the change cannot be admitted, in which case nothing is
+		// reserved. Returns false without invoking "_admit" if the ledger could not be locked in time
+		// or is full. Negative amounts are never reserved.
+		template <typename Function>
+		auto try_reserve(std::int64_t _collection_id, amounts _amounts, Function _admit) -> bool
+		{
+			if (!try_lock()) {
+				return false;
+			}
+
+			try {
+				auto* slot = find_free_slot();
+
+				if (!slot) {
+					unlock();
+					return false;
+				}
+
+				_admit(reserved_by_others(_collection_id));
+				add(slot, _collection_id, _amounts);
+			}
+			catch (...) {
+				unlock();
+				throw;
+			}
+
+			unlock();
+
+			return true;
+		}
+
+		// Releases every reservation held by the calling process.
+		auto release() noexcept -> void;
+
+	  private:
+		struct slot;
+		struct segment;
+
+		auto try_lock() -> bool;
+		auto unlock() -> void;
+		auto find_free_slot() -> slot*;
+		auto reserved_by_others(std::int64_t _collection_id) -> amounts;
+		auto add(slot* _slot, std::int64_t _collection_id, amounts _amounts) -> void;
+
+		std::unique_ptr<boost::interprocess::managed_shared_memory> shm_;
+		segment* segment_;
+	}; // class reservation_ledger
+} // namespace irods
+
+#endif // IRODS_LOGICAL_QUOTAS_RESERVATION_LEDGER_HPP